@@ -0,0 +1,63 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catalog.hpp"
+
+namespace relive {
+
+Catalog::Catalog(uint64_t version, std::vector<StationPtr> stations, std::unordered_map<int64_t, StreamListPtr> streamsOfStation)
+    : _version(version)
+    , _stations(std::move(stations))
+    , _streamsOfStation(std::move(streamsOfStation))
+{
+    for (const auto& [stationId, streams] : _streamsOfStation) {
+        for (const auto& stream : *streams) {
+            _streams.emplace(stream->_id, stream);
+        }
+    }
+}
+
+Catalog::StationPtr Catalog::station(int64_t stationId) const
+{
+    for (const auto& station : _stations) {
+        if (station->_id == stationId) {
+            return station;
+        }
+    }
+    return StationPtr();
+}
+
+Catalog::StreamListPtr Catalog::streams(int64_t stationId) const
+{
+    static const StreamListPtr noStreams = std::make_shared<StreamList>();
+    auto iter = _streamsOfStation.find(stationId);
+    return iter != _streamsOfStation.end() ? iter->second : noStreams;
+}
+
+Catalog::StreamPtr Catalog::stream(int64_t streamId) const
+{
+    auto iter = _streams.find(streamId);
+    return iter != _streams.end() ? iter->second : StreamPtr();
+}
+
+std::shared_ptr<const Catalog> Catalog::withStream(StreamPtr stream, uint64_t version) const
+{
+    auto iter = _streamsOfStation.find(stream->_stationId);
+    if (!_streams.count(stream->_id) || iter == _streamsOfStation.end()) {
+        return std::shared_ptr<const Catalog>();
+    }
+    // only the list of the affected station is copied, all other lists stay shared
+    auto streams = std::make_shared<StreamList>(*iter->second);
+    for (auto& entry : *streams) {
+        if (entry->_id == stream->_id) {
+            entry = stream;
+        }
+    }
+    auto streamsOfStation = _streamsOfStation;
+    streamsOfStation[stream->_stationId] = std::move(streams);
+    return std::make_shared<Catalog>(version, _stations, std::move(streamsOfStation));
+}
+
+}  // namespace relive
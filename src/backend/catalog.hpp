@@ -0,0 +1,49 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "rldata.hpp"
+#include <cstdint>
+#include <memory>
+#include <unordered_map>
+#include <vector>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Immutable in-memory snapshot of stations, streams and tracks. Snapshots share all
+// objects, a change creates a new snapshot reusing everything it didn't touch, so
+// holders of an older one are never affected. Stations come with their urls but an
+// empty _streams list, streams with their station and their tracks, and the tracks
+// link to a copy of their stream that has no tracks of its own.
+//---------------------------------------------------------------------------------------
+class Catalog
+{
+public:
+    using StationPtr = std::shared_ptr<const Station>;
+    using StreamPtr = std::shared_ptr<const Stream>;
+    using StreamList = std::vector<StreamPtr>;
+    using StreamListPtr = std::shared_ptr<const StreamList>;
+
+    Catalog(uint64_t version, std::vector<StationPtr> stations, std::unordered_map<int64_t, StreamListPtr> streamsOfStation);
+
+    uint64_t version() const { return _version; }
+    const std::vector<StationPtr>& stations() const { return _stations; }
+    StationPtr station(int64_t stationId) const;
+    // streams of a station newest first, never null
+    StreamListPtr streams(int64_t stationId) const;
+    StreamPtr stream(int64_t streamId) const;
+    // a new snapshot with the stream of the same id replaced, null if it isn't part of this one
+    std::shared_ptr<const Catalog> withStream(StreamPtr stream, uint64_t version) const;
+
+private:
+    uint64_t _version;
+    std::vector<StationPtr> _stations;
+    std::unordered_map<int64_t, StreamListPtr> _streamsOfStation;
+    std::unordered_map<int64_t, StreamPtr> _streams;
+};
+
+}  // namespace relive
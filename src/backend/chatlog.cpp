@@ -0,0 +1,293 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "chatlog.hpp"
+#include "logging.hpp"
+#include "mappedfile.hpp"
+#include "system.hpp"
+
+#include <cstring>
+
+namespace fs = ghc::filesystem;
+
+namespace relive {
+
+static const char g_chatLogMagic[8] = {'R', 'L', 'C', 'H', 'A', 'T', 0, 1};
+
+// the image starts with this header, followed by the columns in the order of the
+// ChatLog members, all 32 bit columns first so they stay aligned
+struct ChatLogHeader
+{
+    char _magic[8];
+    uint32_t _numMessages;
+    uint32_t _numTexts;
+    uint32_t _numNicks;
+    uint32_t _blobSize;
+};
+
+static uint64_t imageSize(const ChatLogHeader& header)
+{
+    uint64_t n = header._numMessages;
+    return sizeof(ChatLogHeader) + (n * 3 + 1 + header._numTexts + 1 + header._numNicks + 1) * sizeof(uint32_t) + n + header._blobSize;
+}
+
+template <typename T>
+static void appendColumn(std::vector<uint8_t>& image, const std::vector<T>& column)
+{
+    auto bytes = reinterpret_cast<const uint8_t*>(column.data());
+    image.insert(image.end(), bytes, bytes + column.size() * sizeof(T));
+}
+
+static bool isAscending(const uint32_t* values, size_t count, uint32_t last)
+{
+    for (size_t i = 1; i < count; ++i) {
+        if (values[i] < values[i - 1]) {
+            return false;
+        }
+    }
+    return values[count - 1] <= last;
+}
+
+void ChatLog::Builder::reserve(size_t messages)
+{
+    _times.reserve(messages);
+    _types.reserve(messages);
+    _nicks.reserve(messages);
+    _firstText.reserve(messages + 1);
+    _textOffsets.reserve(messages + 1);
+}
+
+uint32_t ChatLog::Builder::intern(const std::string& nick)
+{
+    auto iter = _nickIds.find(nick);
+    if (iter != _nickIds.end()) {
+        return iter->second;
+    }
+    auto id = static_cast<uint32_t>(_nickIds.size());
+    _nickIds.emplace(nick, id);
+    _nickNames += nick;
+    _nickOffsets.push_back(static_cast<uint32_t>(_nickNames.size()));
+    return id;
+}
+
+void ChatLog::Builder::add(int time, MessageType type, const std::vector<std::string>& strings)
+{
+    _times.push_back(time);
+    _types.push_back(static_cast<uint8_t>(type));
+    _nicks.push_back(strings.empty() ? NoNick : intern(strings.front()));
+    for (size_t i = 1; i < strings.size(); ++i) {
+        _texts += strings[i];
+        _textOffsets.push_back(static_cast<uint32_t>(_texts.size()));
+    }
+    _firstText.push_back(static_cast<uint32_t>(_textOffsets.size() - 1));
+}
+
+ChatLog ChatLog::Builder::build()
+{
+    // nick names follow the texts in the blob
+    for (auto& offset : _nickOffsets) {
+        offset += static_cast<uint32_t>(_texts.size());
+    }
+    ChatLogHeader header;
+    std::memcpy(header._magic, g_chatLogMagic, sizeof(header._magic));
+    header._numMessages = static_cast<uint32_t>(_times.size());
+    header._numTexts = static_cast<uint32_t>(_textOffsets.size() - 1);
+    header._numNicks = static_cast<uint32_t>(_nickOffsets.size() - 1);
+    header._blobSize = static_cast<uint32_t>(_texts.size() + _nickNames.size());
+    auto image = std::make_shared<std::vector<uint8_t>>();
+    image->reserve(static_cast<size_t>(imageSize(header)));
+    auto headerBytes = reinterpret_cast<const uint8_t*>(&header);
+    image->insert(image->end(), headerBytes, headerBytes + sizeof(header));
+    appendColumn(*image, _times);
+    appendColumn(*image, _nicks);
+    appendColumn(*image, _firstText);
+    appendColumn(*image, _textOffsets);
+    appendColumn(*image, _nickOffsets);
+    appendColumn(*image, _types);
+    image->insert(image->end(), _texts.begin(), _texts.end());
+    image->insert(image->end(), _nickNames.begin(), _nickNames.end());
+    *this = Builder();
+    ChatLog chat;
+    std::shared_ptr<const uint8_t> data(image, image->data());
+    chat.attach(std::move(data), image->size());
+    return chat;
+}
+
+ChatLog::ChatLog(ChatLog&& other) noexcept
+{
+    swap(other);
+}
+
+ChatLog& ChatLog::operator=(ChatLog&& other) noexcept
+{
+    ChatLog tmp(std::move(other));
+    swap(tmp);
+    return *this;
+}
+
+void ChatLog::swap(ChatLog& other) noexcept
+{
+    std::swap(_image, other._image);
+    std::swap(_byteSize, other._byteSize);
+    std::swap(_numMessages, other._numMessages);
+    std::swap(_numNicks, other._numNicks);
+    std::swap(_times, other._times);
+    std::swap(_nicks, other._nicks);
+    std::swap(_firstText, other._firstText);
+    std::swap(_textOffsets, other._textOffsets);
+    std::swap(_nickOffsets, other._nickOffsets);
+    std::swap(_types, other._types);
+    std::swap(_blob, other._blob);
+}
+
+bool ChatLog::attach(std::shared_ptr<const uint8_t> image, size_t size)
+{
+    ChatLogHeader header;
+    if (size < sizeof(header)) {
+        return false;
+    }
+    std::memcpy(&header, image.get(), sizeof(header));
+    if (std::memcmp(header._magic, g_chatLogMagic, sizeof(header._magic)) != 0 || imageSize(header) != size) {
+        return false;
+    }
+    size_t n = header._numMessages;
+    auto columns = reinterpret_cast<const uint32_t*>(image.get() + sizeof(header));
+    auto times = reinterpret_cast<const int32_t*>(columns);
+    auto nicks = columns + n;
+    auto firstText = nicks + n;
+    auto textOffsets = firstText + n + 1;
+    auto nickOffsets = textOffsets + header._numTexts + 1;
+    auto types = reinterpret_cast<const uint8_t*>(nickOffsets + header._numNicks + 1);
+    auto blob = reinterpret_cast<const char*>(types + n);
+    // a cache file might be damaged, make sure no offset leads out of the image
+    if (firstText[0] != 0 || !isAscending(firstText, n + 1, header._numTexts) || firstText[n] != header._numTexts || !isAscending(textOffsets, header._numTexts + 1, header._blobSize) ||
+        !isAscending(nickOffsets, header._numNicks + 1, header._blobSize)) {
+        return false;
+    }
+    for (size_t i = 0; i < n; ++i) {
+        if ((nicks[i] >= header._numNicks && nicks[i] != NoNick) || types[i] > ChatMessage::eKick) {
+            return false;
+        }
+    }
+    _image = std::move(image);
+    _byteSize = size;
+    _numMessages = n;
+    _numNicks = header._numNicks;
+    _times = times;
+    _nicks = nicks;
+    _firstText = firstText;
+    _textOffsets = textOffsets;
+    _nickOffsets = nickOffsets;
+    _types = types;
+    _blob = blob;
+    return true;
+}
+
+std::string_view ChatLog::nickString(uint32_t nickId) const
+{
+    return std::string_view(_blob + _nickOffsets[nickId], _nickOffsets[nickId + 1] - _nickOffsets[nickId]);
+}
+
+size_t ChatLog::numStrings(size_t index) const
+{
+    return (_nicks[index] != NoNick ? 1 : 0) + _firstText[index + 1] - _firstText[index];
+}
+
+std::string_view ChatLog::string(size_t index, size_t n) const
+{
+    if (_nicks[index] != NoNick) {
+        if (!n) {
+            return nickString(_nicks[index]);
+        }
+        --n;
+    }
+    if (n >= _firstText[index + 1] - _firstText[index]) {
+        return std::string_view();
+    }
+    auto text = _firstText[index] + n;
+    return std::string_view(_blob + _textOffsets[text], _textOffsets[text + 1] - _textOffsets[text]);
+}
+
+std::string_view ChatLog::lastString(size_t index) const
+{
+    auto count = numStrings(index);
+    return count ? string(index, count - 1) : std::string_view();
+}
+
+bool ChatLog::hasNick(size_t index) const
+{
+    return _nicks[index] != NoNick && _nickOffsets[_nicks[index] + 1] != _nickOffsets[_nicks[index]] && type(index) != ChatMessage::eUnknown;
+}
+
+std::string_view ChatLog::nick(size_t index) const
+{
+    if (!hasNick(index)) {
+        return std::string_view();
+    }
+    auto result = nickString(_nicks[index]);
+    if (result.back() == '@') {
+        result.remove_suffix(1);
+    }
+    return result;
+}
+
+ChatMessage ChatLog::message(size_t index) const
+{
+    ChatMessage msg;
+    msg._time = time(index);
+    msg._type = type(index);
+    msg._strings.reserve(numStrings(index));
+    for (size_t i = 0; i < numStrings(index); ++i) {
+        msg._strings.emplace_back(string(index, i));
+    }
+    return msg;
+}
+
+bool ChatLog::load(const std::string& filename)
+{
+    *this = ChatLog();
+    std::error_code ec;
+    if (!fs::exists(fs::path(filename), ec)) {
+        return false;
+    }
+    auto file = std::make_shared<MappedFile>(filename);
+    if (!file->isOpen()) {
+        return false;
+    }
+    std::shared_ptr<const uint8_t> image(file, file->data());
+    if (!attach(std::move(image), file->size())) {
+        ERROR_LOG(1, "Ignoring invalid chat cache " << filename);
+        return false;
+    }
+    DEBUG_LOG(2, "Mapped chat with " << _numMessages << " messages from " << filename);
+    return true;
+}
+
+bool ChatLog::save(const std::string& filename) const
+{
+    std::error_code ec;
+    fs::create_directories(fs::path(filename).parent_path(), ec);
+    auto tmpFile = fs::path(filename + ".tmp");
+    {
+        fs::ofstream os(tmpFile, std::ios::binary | std::ios::trunc);
+        if (_image) {
+            os.write(reinterpret_cast<const char*>(_image.get()), _byteSize);
+        }
+        if (!_image || !os.flush()) {
+            ERROR_LOG(1, "Couldn't write chat cache " << tmpFile.string());
+            os.close();
+            fs::remove(tmpFile, ec);
+            return false;
+        }
+    }
+    fs::rename(tmpFile, fs::path(filename), ec);
+    if (ec) {
+        ERROR_LOG(1, "Couldn't store chat cache " << filename << ": " << ec.message());
+        return false;
+    }
+    return true;
+}
+
+}  // namespace relive
@@ -0,0 +1,96 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "rldata.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Immutable chat of one stream in columnar form. Times, types and nick ids are
+// plain arrays, nicks are interned and all strings live in one blob, addressed by
+// offset tables. The columns are a single contiguous image that is also the on-disk
+// cache format, so a saved chat is used directly from a read-only mapping.
+// The first string of a message is its nick column, the remaining ones its texts.
+//---------------------------------------------------------------------------------------
+class ChatLog
+{
+public:
+    using MessageType = ChatMessage::MessageType;
+    enum : uint32_t { NoNick = 0xffffffffu };
+
+    class Builder
+    {
+    public:
+        Builder() = default;
+        void reserve(size_t messages);
+        void add(int time, MessageType type, const std::vector<std::string>& strings);
+        // the builder is empty afterwards
+        ChatLog build();
+
+    private:
+        uint32_t intern(const std::string& nick);
+        std::vector<int32_t> _times;
+        std::vector<uint8_t> _types;
+        std::vector<uint32_t> _nicks;
+        std::vector<uint32_t> _firstText{0};
+        std::vector<uint32_t> _textOffsets{0};
+        std::vector<uint32_t> _nickOffsets{0};
+        std::string _texts;
+        std::string _nickNames;
+        std::unordered_map<std::string, uint32_t> _nickIds;
+    };
+
+    ChatLog() = default;
+    ChatLog(const ChatLog&) = default;
+    ChatLog(ChatLog&& other) noexcept;
+    ChatLog& operator=(const ChatLog&) = default;
+    ChatLog& operator=(ChatLog&& other) noexcept;
+
+    size_t size() const { return _numMessages; }
+    bool empty() const { return !_numMessages; }
+    size_t numNicks() const { return _numNicks; }
+    // bytes used by the columns of this chat, whether in memory or mapped
+    size_t byteSize() const { return _byteSize; }
+
+    int time(size_t index) const { return _times[index]; }
+    MessageType type(size_t index) const { return static_cast<MessageType>(_types[index]); }
+    // all strings of a message, the nick column counting as the first one
+    size_t numStrings(size_t index) const;
+    std::string_view string(size_t index, size_t n) const;
+    std::string_view lastString(size_t index) const;
+    // same semantics as ChatMessage::hasNick() and ChatMessage::nick()
+    bool hasNick(size_t index) const;
+    std::string_view nick(size_t index) const;
+    ChatMessage message(size_t index) const;
+
+    bool load(const std::string& filename);
+    bool save(const std::string& filename) const;
+
+private:
+    bool attach(std::shared_ptr<const uint8_t> image, size_t size);
+    void swap(ChatLog& other) noexcept;
+    std::string_view nickString(uint32_t nickId) const;
+    std::shared_ptr<const uint8_t> _image;  // owned buffer or a mapped file
+    size_t _byteSize = 0;
+    size_t _numMessages = 0;
+    size_t _numNicks = 0;
+    const int32_t* _times = nullptr;
+    const uint32_t* _nicks = nullptr;
+    const uint32_t* _firstText = nullptr;
+    const uint32_t* _textOffsets = nullptr;
+    const uint32_t* _nickOffsets = nullptr;
+    const uint8_t* _types = nullptr;
+    const char* _blob = nullptr;
+};
+
+}  // namespace relive
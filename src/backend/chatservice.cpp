@@ -0,0 +1,164 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "chatservice.hpp"
+#include "daemonclient.hpp"
+#include "logging.hpp"
+
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+namespace relive {
+
+using Clock = std::chrono::steady_clock;
+
+struct ChatService::impl
+{
+    ReLiveDB& _rdb;
+    DaemonClient _daemon;  // used by the worker only
+    std::string _daemonSocket;
+    mutable std::mutex _mutex;
+    std::condition_variable _workCond;
+    std::thread _worker;
+    bool _shutdown = false;
+    uint64_t _generation = 0;  // of the latest request
+    uint64_t _processed = 0;   // generation the worker has taken up last
+    bool _running = false;
+    Stream _stream;
+    Result _result;
+    bool _ready = false;  // _result holds an unpolled chat of the latest request
+
+    explicit impl(ReLiveDB& rdb)
+        : _rdb(rdb)
+    {
+    }
+
+    bool pending() const { return _processed != _generation; }
+
+    ChatLog fetchChat(const Stream& stream)
+    {
+        std::string socketPath;
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            socketPath = _daemonSocket;
+        }
+        if (!socketPath.empty()) {
+            try {
+                if (_daemon.connectedTo(socketPath) || _daemon.connect(socketPath)) {
+                    return _daemon.fetchChat(stream._id);
+                }
+                ERROR_LOG3(ChatService, 0, "Loading the chat from the database, no daemon serves " << socketPath);
+            }
+            catch (const IpcError& ex) {
+                ERROR_LOG3(ChatService, 0, "Loading the chat from the database, the daemon failed: " << ex.what());
+                if (_daemon.connected()) {
+                    // an error reply, the daemon stays in use
+                    return _rdb.fetchChat(stream);
+                }
+            }
+            _daemon.disconnect();
+            std::lock_guard<std::mutex> lock{_mutex};
+            if (_daemonSocket == socketPath) {
+                _daemonSocket.clear();
+            }
+        }
+        return _rdb.fetchChat(stream);
+    }
+};
+
+ChatService::ChatService(ReLiveDB& rdb)
+    : _impl(std::make_unique<impl>(rdb))
+{
+    _impl->_worker = std::thread(&ChatService::worker, this);
+}
+
+ChatService::~ChatService()
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        _impl->_shutdown = true;
+    }
+    _impl->_workCond.notify_all();
+    _impl->_worker.join();
+}
+
+uint64_t ChatService::load(const Stream& stream)
+{
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        generation = ++_impl->_generation;
+        // tracks are not needed for the chat, don't copy them over to the worker
+        _impl->_stream = stream;
+        _impl->_stream._tracks.clear();
+        _impl->_result = Result();
+        _impl->_ready = false;
+    }
+    _impl->_workCond.notify_all();
+    return generation;
+}
+
+void ChatService::cancel()
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    _impl->_processed = ++_impl->_generation;
+    _impl->_result = Result();
+    _impl->_ready = false;
+}
+
+bool ChatService::poll(Result& result)
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    if (!_impl->_ready) {
+        return false;
+    }
+    _impl->_ready = false;
+    result = std::move(_impl->_result);
+    _impl->_result = Result();
+    return true;
+}
+
+bool ChatService::busy() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_running || _impl->pending();
+}
+
+void ChatService::useDaemon(const std::string& socketPath)
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    _impl->_daemonSocket = socketPath;
+}
+
+void ChatService::worker()
+{
+    std::unique_lock<std::mutex> lock{_impl->_mutex};
+    while (!_impl->_shutdown) {
+        _impl->_running = false;
+        _impl->_workCond.wait(lock, [this]() { return _impl->_shutdown || _impl->pending(); });
+        if (_impl->_shutdown) {
+            break;
+        }
+        auto generation = _impl->_processed = _impl->_generation;
+        auto stream = _impl->_stream;
+        _impl->_running = true;
+        lock.unlock();
+        auto start = Clock::now();
+        auto chat = _impl->fetchChat(stream);
+        lock.lock();
+        bool current = generation == _impl->_generation;
+        DEBUG_LOG(2, "chat of stream " << stream._id << " with " << chat.size() << " messages " << (current ? "loaded" : "superseded") << " after " << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count() << "ms");
+        if (current) {
+            _impl->_result._generation = generation;
+            _impl->_result._streamId = stream._id;
+            _impl->_result._chat = std::move(chat);
+            _impl->_ready = true;
+        }
+    }
+}
+
+}  // namespace relive
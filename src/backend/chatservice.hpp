@@ -0,0 +1,52 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "chatlog.hpp"
+#include "relivedb.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Loads the chat of the selected stream on a worker thread, so selecting a stream
+// can start playback right away while the chat is downloaded or mapped from the
+// cache. A newer request supersedes older ones, a chat that finishes downloading
+// after being superseded is dropped. The UI polls for the result once per frame.
+// With a sync daemon the daemon downloads and caches the chats.
+//---------------------------------------------------------------------------------------
+class ChatService
+{
+public:
+    struct Result {
+        uint64_t _generation = 0;  // the request this result belongs to
+        int64_t _streamId = 0;
+        ChatLog _chat;
+    };
+    explicit ChatService(ReLiveDB& rdb);
+    ~ChatService();
+
+    // request the chat of a stream, supersedes all earlier requests, returns its generation
+    uint64_t load(const Stream& stream);
+    // drop the current request
+    void cancel();
+    // non-blocking, moves out the chat of the latest request and returns true once it is ready
+    bool poll(Result& result);
+    // true while a request is pending or running
+    bool busy() const;
+    // load chats via the sync daemon at the socket, the database is only used if it
+    // fails, an empty path goes back to the database
+    void useDaemon(const std::string& socketPath);
+
+private:
+    void worker();
+    struct impl;
+    std::unique_ptr<impl> _impl;
+};
+
+}  // namespace relive
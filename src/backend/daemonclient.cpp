@@ -0,0 +1,222 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "daemonclient.hpp"
+#include "logging.hpp"
+
+#include <cstring>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace relive {
+
+DaemonClient::~DaemonClient()
+{
+    close();
+}
+
+bool DaemonClient::connect(const std::string& socketPath, std::chrono::milliseconds timeout)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    close();
+#ifdef _WIN32
+    return false;
+#else
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path)) {
+        return false;
+    }
+    std::memcpy(addr.sun_path, socketPath.c_str(), socketPath.size() + 1);
+    _fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_fd < 0) {
+        return false;
+    }
+    if (::connect(_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0) {
+        close();
+        return false;
+    }
+    prepareSocket(_fd);
+    // a hanging daemon must not block a frontend for good
+    timeval tv{};
+    tv.tv_sec = static_cast<decltype(tv.tv_sec)>(timeout.count() / 1000);
+    tv.tv_usec = static_cast<decltype(tv.tv_usec)>(timeout.count() % 1000 * 1000);
+    ::setsockopt(_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    ::setsockopt(_fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    try {
+        IpcWriter hello;
+        hello.u8(Ipc::eHello);
+        hello.varint(Ipc::ProtocolVersion);
+        auto reply = call(hello);
+        IpcReader reader(std::string_view(reply).substr(1));
+        if (reader.varint() == Ipc::ProtocolVersion) {
+            DEBUG_LOG(1, "Connected to the daemon at " << socketPath);
+            _socketPath = socketPath;
+            return true;
+        }
+    }
+    catch (const IpcError& ex) {
+        ERROR_LOG(0, "Daemon at " << socketPath << " refused the connection: " << ex.what());
+    }
+    close();
+    return false;
+#endif
+}
+
+bool DaemonClient::connected() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return _fd >= 0;
+}
+
+bool DaemonClient::connectedTo(const std::string& socketPath) const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return _fd >= 0 && _socketPath == socketPath;
+}
+
+void DaemonClient::disconnect()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    close();
+}
+
+void DaemonClient::close()
+{
+#ifndef _WIN32
+    if (_fd >= 0) {
+        ::close(_fd);
+    }
+#endif
+    _fd = -1;
+    _socketPath.clear();
+    _catalog.reset();
+}
+
+DaemonClient::Status DaemonClient::status()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    IpcWriter request;
+    request.u8(Ipc::eStatus);
+    auto reply = call(request);
+    IpcReader reader(std::string_view(reply).substr(1));
+    Status status;
+    status._catalogVersion = reader.varint();
+    status._lastSync = reader.svarint();
+    status._syncing = reader.u8() != 0;
+    status._clients = static_cast<size_t>(reader.varint());
+    return status;
+}
+
+std::shared_ptr<const Catalog> DaemonClient::catalog()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    IpcWriter request;
+    request.u8(Ipc::eCatalog);
+    // version 0 is never a catalog of the daemon, it always gets the first one
+    request.varint(_catalog ? _catalog->version() : 0);
+    auto reply = call(request);
+    IpcReader reader(std::string_view(reply).substr(1));
+    if (reader.u8()) {
+        _catalog = reader.catalog();
+    }
+    return _catalog;
+}
+
+std::vector<Stream> DaemonClient::searchStreams(const std::string& query, int limit, int offset)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    IpcWriter request;
+    request.u8(Ipc::eSearchStreams);
+    request.string(query);
+    request.varint(static_cast<uint64_t>(limit));
+    request.varint(static_cast<uint64_t>(offset));
+    auto reply = call(request);
+    IpcReader reader(std::string_view(reply).substr(1));
+    std::vector<Stream> result;
+    for (auto n = reader.count(17); n; --n) {
+        result.push_back(reader.stream());
+    }
+    return result;
+}
+
+std::vector<ReLiveDB::FindTracksInfo> DaemonClient::searchTracks(const std::string& query, ReLiveDB::FindTracksFilter filter, int limit, int offset)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    IpcWriter request;
+    request.u8(Ipc::eSearchTracks);
+    request.string(query);
+    request.u8(static_cast<uint8_t>(filter));
+    request.varint(static_cast<uint64_t>(limit));
+    request.varint(static_cast<uint64_t>(offset));
+    auto reply = call(request);
+    IpcReader reader(std::string_view(reply).substr(1));
+    std::vector<ReLiveDB::FindTracksInfo> result;
+    for (auto n = reader.count(5); n; --n) {
+        ReLiveDB::FindTracksInfo info;
+        info._trackId = reader.svarint();
+        info._streamName = reader.string();
+        info._artist = reader.string();
+        info._trackName = reader.string();
+        info._timestamp = reader.svarint();
+        result.push_back(std::move(info));
+    }
+    return result;
+}
+
+ChatLog DaemonClient::fetchChat(int64_t streamId)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    IpcWriter request;
+    request.u8(Ipc::eChat);
+    request.svarint(streamId);
+    auto reply = call(request);
+    IpcReader reader(std::string_view(reply).substr(1));
+    return reader.chat();
+}
+
+void DaemonClient::requestSync(bool force)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    IpcWriter request;
+    request.u8(Ipc::eSync);
+    request.u8(force ? 1 : 0);
+    call(request);
+}
+
+void DaemonClient::setPlayed(int64_t streamId)
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    IpcWriter request;
+    request.u8(Ipc::eSetPlayed);
+    request.svarint(streamId);
+    call(request);
+}
+
+std::string DaemonClient::call(const IpcWriter& request)
+{
+    std::string reply;
+    if (_fd < 0) {
+        throw IpcError("Not connected to the daemon");
+    }
+#ifndef _WIN32
+    if (!sendFrame(_fd, request.data()) || !receiveFrame(_fd, reply)) {
+        close();
+        throw IpcError("Lost the connection to the daemon or it didn't reply in time");
+    }
+#endif
+    IpcReader reader(reply);
+    if (reader.u8() != Ipc::eOk) {
+        throw IpcError("Daemon error: " + reader.string());
+    }
+    return reply;
+}
+
+}  // namespace relive
@@ -0,0 +1,67 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "ipcprotocol.hpp"
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Connection of a frontend to a SyncDaemon. Queries block until the reply arrived,
+// a broken connection, a daemon that stays silent longer than the timeout or an error
+// reply of the daemon throw IpcError. Only error replies leave the client connected. Queries of
+// several threads are serialized, threads that query a lot should use their own
+// client. On Windows there is no daemon and connect() always fails.
+//---------------------------------------------------------------------------------------
+class DaemonClient
+{
+public:
+    struct Status {
+        uint64_t _catalogVersion = 0;
+        int64_t _lastSync = 0;  // unix timestamp
+        bool _syncing = false;
+        size_t _clients = 0;
+    };
+    DaemonClient() = default;
+    ~DaemonClient();
+    DaemonClient(const DaemonClient&) = delete;
+    DaemonClient& operator=(const DaemonClient&) = delete;
+
+    // false if no daemon serves the socket or it speaks another protocol version, the
+    // timeout applies to every send and receive on the socket
+    bool connect(const std::string& socketPath = daemonSocketPath(), std::chrono::milliseconds timeout = std::chrono::seconds(10));
+    bool connected() const;
+    // connected to the daemon at the given socket
+    bool connectedTo(const std::string& socketPath) const;
+    void disconnect();
+
+    Status status();
+    // the catalog of the daemon, only transferred again if it changed since the last call
+    std::shared_ptr<const Catalog> catalog();
+    std::vector<Stream> searchStreams(const std::string& query, int limit = 100, int offset = 0);
+    std::vector<ReLiveDB::FindTracksInfo> searchTracks(const std::string& query, ReLiveDB::FindTracksFilter filter = ReLiveDB::eNone, int limit = 100, int offset = 0);
+    ChatLog fetchChat(int64_t streamId);
+    // starts a sync of the daemon unless one is running, returns right away
+    void requestSync(bool force = false);
+    // marks the stream as played in the database of the daemon
+    void setPlayed(int64_t streamId);
+
+private:
+    // sends the request and returns the payload of an eOk reply, called with the lock held
+    std::string call(const IpcWriter& request);
+    void close();
+    mutable std::mutex _mutex;
+    int _fd = -1;
+    std::string _socketPath;
+    std::shared_ptr<const Catalog> _catalog;
+};
+
+}  // namespace relive
@@ -0,0 +1,269 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "hostlimiter.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace relive {
+
+using Clock = std::chrono::steady_clock;
+
+struct HostLimiter::impl : public std::enable_shared_from_this<impl>
+{
+    struct Pending
+    {
+        Job _job;
+        TaskScheduler::Priority _priority;
+        std::shared_ptr<TaskScheduler::Counter> _counter;
+        int _attempt = 0;
+    };
+    struct Host
+    {
+        std::deque<Pending> _waiting;
+        int _limit = 1;
+        int _running = 0;
+        int _credit = 0;  // jobs done since the last change of the limit
+        double _latencyMs = 0;
+        double _bestLatencyMs = 0;
+        Clock::time_point _pausedUntil;
+        uint64_t _jobs = 0;
+        uint64_t _retries = 0;
+        uint64_t _failures = 0;
+    };
+    impl(TaskScheduler& scheduler, const Config& config)
+        : _scheduler(scheduler)
+        , _config(config)
+        , _rng(std::random_device()())
+    {
+    }
+    // start waiting jobs of the host up to its limit, called with the lock held
+    void dispatch(const std::string& key, Host& host)
+    {
+        if (_shutdown || _cancelled || host._pausedUntil > Clock::now()) {
+            return;
+        }
+        while (host._running < host._limit && !host._waiting.empty()) {
+            auto pending = std::move(host._waiting.front());
+            host._waiting.pop_front();
+            ++host._running;
+            auto priority = pending._priority;
+            _scheduler.submit([self = shared_from_this(), key, pending = std::move(pending)]() mutable { self->run(key, std::move(pending)); }, priority);
+        }
+    }
+    void run(const std::string& key, Pending pending)
+    {
+        auto start = Clock::now();
+        auto outcome = eDone;
+        // dispatched before a cancel(), but not started yet
+        bool skipped = _cancelled;
+        if (!skipped) {
+            try {
+                outcome = pending._job();
+            }
+            catch (const std::exception& ex) {
+                ERROR_LOG3(HostLimiter, 0, "Job for " << key << " failed: " << ex.what());
+            }
+        }
+        auto ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        std::shared_ptr<TaskScheduler::Counter> finished;
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            auto& host = _hosts[key];
+            --host._running;
+            if (skipped || (outcome == eRetry && _cancelled)) {
+                // neither done nor failed, it was cancelled
+                finished = std::move(pending._counter);
+            }
+            else if (outcome == eRetry && pending._attempt < _config.maxRetries && !_shutdown) {
+                ++host._retries;
+                host._limit = (std::max)(1, host._limit / 2);
+                host._credit = 0;
+                auto delay = backoff(++pending._attempt);
+                DEBUG_LOG3(HostLimiter, 1, key << " failed, retry " << pending._attempt << " in " << delay.count() << "ms");
+                host._pausedUntil = (std::max)(host._pausedUntil, Clock::now() + delay);
+                host._waiting.push_front(std::move(pending));
+                _timers.emplace(host._pausedUntil, key);
+                _timerCond.notify_one();
+            }
+            else {
+                if (outcome == eRetry) {
+                    ++host._failures;
+                    ERROR_LOG3(HostLimiter, 0, "Giving up a job for " << key << " after " << (pending._attempt + 1) << " attempts");
+                }
+                else {
+                    ++host._jobs;
+                    adapt(host, ms);
+                }
+                finished = std::move(pending._counter);
+            }
+            dispatch(key, host);
+        }
+        if (finished) {
+            finished->complete();
+        }
+    }
+    // additive increase while the latency stays near the best seen, decrease when it climbs
+    void adapt(Host& host, double ms)
+    {
+        host._latencyMs = host._jobs > 1 ? host._latencyMs * 0.8 + ms * 0.2 : ms;
+        if (host._jobs == 1 || host._latencyMs < host._bestLatencyMs) {
+            host._bestLatencyMs = host._latencyMs;
+        }
+        if (++host._credit < host._limit) {
+            return;
+        }
+        host._credit = 0;
+        // a few milliseconds of jitter on fast hosts are no congestion
+        if (host._latencyMs > 4 * host._bestLatencyMs + 5) {
+            host._limit = (std::max)(1, host._limit - 1);
+        }
+        else if (host._latencyMs <= 2 * host._bestLatencyMs + 5 && !host._waiting.empty()) {
+            host._limit = (std::min)(host._limit + 1, _config.maxConcurrency);
+        }
+    }
+    // exponential with "equal jitter", between half and all of the capped exponential delay
+    std::chrono::milliseconds backoff(int attempt)
+    {
+        auto cap = (std::min)(_config.maxBackoff.count(), _config.baseBackoff.count() << (std::min)(attempt - 1, 16));
+        std::uniform_int_distribution<long long> jitter(cap / 2, cap);
+        return std::chrono::milliseconds(jitter(_rng));
+    }
+    // removes the waiting jobs and returns their counters to be completed outside the lock,
+    // called with the lock held
+    std::vector<std::shared_ptr<TaskScheduler::Counter>> dropWaiting()
+    {
+        std::vector<std::shared_ptr<TaskScheduler::Counter>> dropped;
+        for (auto& [key, host] : _hosts) {
+            for (auto& pending : host._waiting) {
+                if (pending._counter) {
+                    dropped.push_back(std::move(pending._counter));
+                }
+            }
+            host._waiting.clear();
+        }
+        return dropped;
+    }
+    // restarts hosts when their backoff is over
+    void timer()
+    {
+        std::unique_lock<std::mutex> lock{_mutex};
+        while (!_shutdown) {
+            if (_timers.empty()) {
+                _timerCond.wait(lock);
+            }
+            else if (_timers.begin()->first > Clock::now()) {
+                _timerCond.wait_until(lock, _timers.begin()->first);
+            }
+            else {
+                auto key = _timers.begin()->second;
+                _timers.erase(_timers.begin());
+                dispatch(key, _hosts[key]);
+            }
+        }
+    }
+    TaskScheduler& _scheduler;
+    Config _config;
+    mutable std::mutex _mutex;
+    std::condition_variable _timerCond;
+    std::map<std::string, Host> _hosts;
+    std::multimap<Clock::time_point, std::string> _timers;
+    std::mt19937 _rng;
+    bool _shutdown = false;
+    std::atomic_bool _cancelled{false};
+    std::thread _timerThread;
+};
+
+HostLimiter::HostLimiter(TaskScheduler& scheduler)
+    : HostLimiter(scheduler, Config())
+{
+}
+
+HostLimiter::HostLimiter(TaskScheduler& scheduler, const Config& config)
+    : _impl(std::make_shared<impl>(scheduler, config))
+{
+    _impl->_timerThread = std::thread(&impl::timer, _impl.get());
+}
+
+HostLimiter::~HostLimiter()
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        _impl->_shutdown = true;
+    }
+    _impl->_timerCond.notify_all();
+    _impl->_timerThread.join();
+    std::vector<std::shared_ptr<TaskScheduler::Counter>> dropped;
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        dropped = _impl->dropWaiting();
+    }
+    for (auto& counter : dropped) {
+        counter->complete();
+    }
+}
+
+void HostLimiter::cancel()
+{
+    std::vector<std::shared_ptr<TaskScheduler::Counter>> dropped;
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        _impl->_cancelled = true;
+        dropped = _impl->dropWaiting();
+    }
+    DEBUG_LOG(1, "Cancelled, dropped " << dropped.size() << " waiting jobs");
+    for (auto& counter : dropped) {
+        counter->complete();
+    }
+}
+
+void HostLimiter::submit(const ghc::net::uri& uri, Job job, TaskScheduler::Priority priority, std::shared_ptr<TaskScheduler::Counter> counter)
+{
+    auto key = uri.scheme() + "://" + uri.host() + ":" + std::to_string(uri.port());
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    if (_impl->_cancelled) {
+        return;
+    }
+    if (counter) {
+        counter->add();
+    }
+    auto iter = _impl->_hosts.find(key);
+    if (iter == _impl->_hosts.end()) {
+        iter = _impl->_hosts.emplace(key, impl::Host()).first;
+        iter->second._limit = (std::max)(1, (std::min)(_impl->_config.initialConcurrency, _impl->_config.maxConcurrency));
+    }
+    auto& host = iter->second;
+    impl::Pending pending{std::move(job), priority, std::move(counter), 0};
+    if (priority == TaskScheduler::eHigh) {
+        auto pos = std::find_if(host._waiting.begin(), host._waiting.end(), [](const impl::Pending& waiting) { return waiting._priority != TaskScheduler::eHigh; });
+        host._waiting.insert(pos, std::move(pending));
+    }
+    else {
+        host._waiting.push_back(std::move(pending));
+    }
+    _impl->dispatch(key, host);
+}
+
+std::map<std::string, HostLimiter::HostStats> HostLimiter::stats() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    std::map<std::string, HostStats> result;
+    for (const auto& [key, host] : _impl->_hosts) {
+        result[key] = HostStats{host._limit, host._running, host._waiting.size(), host._latencyMs, host._jobs, host._retries, host._failures};
+    }
+    return result;
+}
+
+}  // namespace relive
@@ -0,0 +1,68 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "httppool.hpp"
+#include "scheduler.hpp"
+#include <ghc/uri.hpp>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Runs network jobs on a TaskScheduler with a concurrency limit per host. Jobs beyond
+// the limit wait here instead of occupying a worker, so a slow host can't starve the
+// others. Each host's limit adapts to its measured job latency: it grows while the
+// latency stays near the best seen and shrinks when the latency or failures climb.
+// Jobs reporting a transient failure are retried after a jittered exponential
+// backoff, during which no other job of that host is started.
+//---------------------------------------------------------------------------------------
+class HostLimiter
+{
+public:
+    enum Outcome { eDone, eRetry };
+    using Job = std::function<Outcome()>;
+    struct Config {
+        int initialConcurrency = 2;
+        int maxConcurrency = HttpPool::DefaultMaxPerHost - HttpPool::PlaybackReserve;
+        int maxRetries = 3;
+        std::chrono::milliseconds baseBackoff{500};
+        std::chrono::milliseconds maxBackoff{10000};
+    };
+    struct HostStats {
+        int _concurrency = 0;  // current limit
+        int _running = 0;
+        size_t _waiting = 0;
+        double _latencyMs = 0;  // smoothed job duration
+        uint64_t _jobs = 0;     // finished jobs
+        uint64_t _retries = 0;
+        uint64_t _failures = 0;  // jobs given up after maxRetries
+    };
+    explicit HostLimiter(TaskScheduler& scheduler);
+    HostLimiter(TaskScheduler& scheduler, const Config& config);
+    // jobs still waiting for their host are dropped, their counters count them as done
+    ~HostLimiter();
+
+    // the counter counts the job from now until it is done or given up, after cancel()
+    // the job is dropped right away and not counted
+    void submit(const ghc::net::uri& uri, Job job, TaskScheduler::Priority priority = TaskScheduler::eNormal, std::shared_ptr<TaskScheduler::Counter> counter = std::shared_ptr<TaskScheduler::Counter>());
+    std::map<std::string, HostStats> stats() const;
+    // drops the waiting jobs and all submitted later, their counters count them as done;
+    // running jobs finish but aren't retried
+    void cancel();
+
+private:
+    struct impl;
+    // shared with the running jobs and the timer thread
+    std::shared_ptr<impl> _impl;
+};
+
+}  // namespace relive
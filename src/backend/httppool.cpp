@@ -0,0 +1,166 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "httppool.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace relive {
+
+struct HttpPool::impl
+{
+    struct Host
+    {
+        std::vector<std::shared_ptr<httplib::Client>> _idle;
+        size_t _leased = 0;
+    };
+    mutable std::mutex _mutex;
+    std::condition_variable _returned;
+    std::unordered_map<std::string, Host> _hosts;
+    size_t _maxPerHost = DefaultMaxPerHost;
+    Stats _stats;
+};
+
+HttpPool::Lease::Lease(HttpPool* pool, std::string key, std::shared_ptr<httplib::Client> client)
+    : _pool(pool)
+    , _key(std::move(key))
+    , _client(std::move(client))
+{
+}
+
+HttpPool::Lease::Lease(Lease&& other) noexcept
+    : _pool(other._pool)
+    , _key(std::move(other._key))
+    , _client(std::move(other._client))
+    , _discard(other._discard)
+{
+    other._pool = nullptr;
+}
+
+HttpPool::Lease& HttpPool::Lease::operator=(Lease&& other) noexcept
+{
+    if (this != &other) {
+        release();
+        _pool = other._pool;
+        _key = std::move(other._key);
+        _client = std::move(other._client);
+        _discard = other._discard;
+        other._pool = nullptr;
+    }
+    return *this;
+}
+
+HttpPool::Lease::~Lease()
+{
+    release();
+}
+
+void HttpPool::Lease::release()
+{
+    if (_pool) {
+        _pool->giveBack(_key, std::move(_client), _discard);
+        _pool = nullptr;
+    }
+    _client.reset();
+    _discard = false;
+}
+
+HttpPool::HttpPool()
+    : _impl(std::make_unique<impl>())
+{
+}
+
+HttpPool::~HttpPool() = default;
+
+HttpPool& HttpPool::instance()
+{
+    static HttpPool pool;
+    return pool;
+}
+
+HttpPool::Lease HttpPool::acquire(const ghc::net::uri& uri)
+{
+    auto key = uri.scheme() + "://" + uri.host() + ":" + std::to_string(uri.port());
+    std::unique_lock<std::mutex> lock{_impl->_mutex};
+    // references to map elements survive rehashing, the entry is never erased
+    auto& host = _impl->_hosts[key];
+    if (host._leased >= _impl->_maxPerHost) {
+        ++_impl->_stats._waits;
+        _impl->_returned.wait(lock, [&]() { return host._leased < _impl->_maxPerHost; });
+    }
+    ++host._leased;
+    if (!host._idle.empty()) {
+        auto client = std::move(host._idle.back());
+        host._idle.pop_back();
+        ++_impl->_stats._reused;
+        return Lease(this, key, std::move(client));
+    }
+    ++_impl->_stats._created;
+    lock.unlock();
+    // setting up a client (and an SSL context) doesn't need the lock
+    auto client = createClient(uri);
+#ifdef CPPHTTPLIB_VERSION
+    // httplib versions defining CPPHTTPLIB_VERSION keep the connection open between requests
+    client->set_keep_alive(true);
+#endif
+    return Lease(this, key, std::move(client));
+}
+
+size_t HttpPool::maxPerHost() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_maxPerHost;
+}
+
+void HttpPool::maxPerHost(size_t count)
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        _impl->_maxPerHost = (std::max)(count, size_t(1));
+    }
+    _impl->_returned.notify_all();
+}
+
+HttpPool::Stats HttpPool::stats() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    auto stats = _impl->_stats;
+    for (const auto& [key, host] : _impl->_hosts) {
+        stats._idle += host._idle.size();
+        stats._leased += host._leased;
+    }
+    return stats;
+}
+
+void HttpPool::clear()
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    for (auto& [key, host] : _impl->_hosts) {
+        host._idle.clear();
+    }
+}
+
+void HttpPool::giveBack(const std::string& key, std::shared_ptr<httplib::Client> client, bool discard)
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        auto& host = _impl->_hosts[key];
+        --host._leased;
+        if (discard || !client) {
+            ++_impl->_stats._discarded;
+        }
+        else {
+            host._idle.push_back(std::move(client));
+        }
+    }
+    _impl->_returned.notify_all();
+}
+
+}  // namespace relive
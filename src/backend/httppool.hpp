@@ -0,0 +1,78 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "netutility.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Process wide pool of HTTP clients per scheme, host and port. A client is leased
+// for a request (or a running stream) and returned afterwards, so the next request
+// to that host reuses it and its kept alive connection instead of a new TCP and TLS
+// handshake. At most maxPerHost() clients per host are leased at a time, acquire()
+// waits for one to be returned when the limit is reached.
+//---------------------------------------------------------------------------------------
+class HttpPool
+{
+public:
+    // background sync leaves PlaybackReserve of the leases per host to the player
+    enum { DefaultMaxPerHost = 6, PlaybackReserve = 2 };
+    struct Stats {
+        uint64_t _created = 0;    // clients constructed
+        uint64_t _reused = 0;     // leases served by an idle client
+        uint64_t _waits = 0;      // leases that had to wait for the per host limit
+        uint64_t _discarded = 0;  // clients dropped after failed requests
+        size_t _idle = 0;
+        size_t _leased = 0;
+    };
+    class Lease
+    {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        httplib::Client* operator->() const { return _client.get(); }
+        httplib::Client& operator*() const { return *_client; }
+        explicit operator bool() const { return _client != nullptr; }
+        // don't hand the client out again, used when a failed request left its connection in doubt
+        void discard() { _discard = true; }
+        // return the client to the pool before the lease goes out of scope
+        void release();
+
+    private:
+        friend class HttpPool;
+        Lease(HttpPool* pool, std::string key, std::shared_ptr<httplib::Client> client);
+        HttpPool* _pool = nullptr;
+        std::string _key;
+        std::shared_ptr<httplib::Client> _client;
+        bool _discard = false;
+    };
+
+    static HttpPool& instance();
+
+    Lease acquire(const ghc::net::uri& uri);
+    size_t maxPerHost() const;
+    void maxPerHost(size_t count);
+    Stats stats() const;
+    // drop all idle clients and with them their connections
+    void clear();
+
+private:
+    HttpPool();
+    ~HttpPool();
+    void giveBack(const std::string& key, std::shared_ptr<httplib::Client> client, bool discard);
+    struct impl;
+    std::unique_ptr<impl> _impl;
+};
+
+}  // namespace relive
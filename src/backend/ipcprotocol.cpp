@@ -0,0 +1,373 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "ipcprotocol.hpp"
+#include "system.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <unordered_map>
+#include <utility>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <unistd.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0  // macOS, the sockets get SO_NOSIGPIPE instead
+#endif
+#endif
+
+namespace fs = ghc::filesystem;
+
+namespace relive {
+
+void IpcWriter::varint(uint64_t val)
+{
+    while (val >= 0x80) {
+        _data.push_back(static_cast<char>((val & 0x7f) | 0x80));
+        val >>= 7;
+    }
+    _data.push_back(static_cast<char>(val));
+}
+
+void IpcWriter::string(std::string_view str)
+{
+    varint(str.size());
+    _data.append(str.data(), str.size());
+}
+
+void IpcWriter::station(const Station& station)
+{
+    svarint(station._id);
+    svarint(station._reliveId);
+    svarint(station._protocol);
+    string(station._name);
+    svarint(station._lastUpdate);
+    svarint(station._flags);
+    string(station._webSiteUrl);
+    varint(station._api.size());
+    for (const auto& api : station._api) {
+        string(api);
+    }
+    varint(station._liveStream.size());
+    for (const auto& url : station._liveStream) {
+        svarint(url._id);
+        string(url._url);
+        svarint(url._type);
+    }
+}
+
+void IpcWriter::stream(const Stream& stream)
+{
+    svarint(stream._id);
+    svarint(stream._reliveId);
+    svarint(stream._stationId);
+    string(stream._name);
+    string(stream._host);
+    string(stream._description);
+    svarint(stream._timestamp);
+    svarint(stream._duration);
+    svarint(stream._size);
+    string(stream._format);
+    svarint(stream._mediaOffset);
+    svarint(stream._streamInfoChecksum);
+    svarint(stream._chatChecksum);
+    svarint(stream._mediaChecksum);
+    svarint(stream._lastUpdate);
+    svarint(stream._flags);
+    varint(stream._media.size());
+    for (const auto& media : stream._media) {
+        string(media);
+    }
+}
+
+void IpcWriter::track(const Track& track)
+{
+    svarint(track._id);
+    svarint(track._streamId);
+    string(track._name);
+    string(track._artist);
+    svarint(track._type);
+    svarint(track._time);
+    svarint(track._flags);
+    svarint(track._duration);
+}
+
+void IpcWriter::catalog(const Catalog& catalog)
+{
+    varint(catalog.version());
+    varint(catalog.stations().size());
+    for (const auto& station : catalog.stations()) {
+        this->station(*station);
+    }
+    for (const auto& station : catalog.stations()) {
+        auto streams = catalog.streams(station->_id);
+        varint(streams->size());
+        for (const auto& stream : *streams) {
+            this->stream(*stream);
+            varint(stream->_tracks.size());
+            for (const auto& track : stream->_tracks) {
+                this->track(track);
+            }
+        }
+    }
+}
+
+void IpcWriter::chat(const ChatLog& chat)
+{
+    varint(chat.size());
+    for (size_t i = 0; i < chat.size(); ++i) {
+        auto message = chat.message(i);
+        svarint(message._time);
+        u8(static_cast<uint8_t>(message._type));
+        varint(message._strings.size());
+        for (const auto& str : message._strings) {
+            string(str);
+        }
+    }
+}
+
+uint8_t IpcReader::u8()
+{
+    if (_pos >= _data.size()) {
+        throw IpcError("Truncated message");
+    }
+    return static_cast<uint8_t>(_data[_pos++]);
+}
+
+uint64_t IpcReader::varint()
+{
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        auto byte = u8();
+        result |= uint64_t(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return result;
+        }
+    }
+    throw IpcError("Malformed varint");
+}
+
+std::string IpcReader::string()
+{
+    auto size = count();
+    std::string result(_data.substr(_pos, size));
+    _pos += size;
+    return result;
+}
+
+size_t IpcReader::count(size_t minSize)
+{
+    auto val = varint();
+    if (val > (_data.size() - _pos) / minSize) {
+        throw IpcError("Count exceeds message size");
+    }
+    return static_cast<size_t>(val);
+}
+
+Station IpcReader::station()
+{
+    Station station;
+    station._id = svarint();
+    station._reliveId = svarint();
+    station._protocol = static_cast<int>(svarint());
+    station._name = string();
+    station._lastUpdate = svarint();
+    station._flags = static_cast<int>(svarint());
+    station._webSiteUrl = string();
+    for (auto n = count(); n; --n) {
+        station._api.push_back(string());
+    }
+    for (auto n = count(3); n; --n) {
+        Url url;
+        url._id = svarint();
+        url._ownerId = station._id;
+        url._url = string();
+        url._type = static_cast<int>(svarint());
+        station._liveStream.push_back(std::move(url));
+    }
+    return station;
+}
+
+Stream IpcReader::stream()
+{
+    Stream stream;
+    stream._id = svarint();
+    stream._reliveId = svarint();
+    stream._stationId = svarint();
+    stream._name = string();
+    stream._host = string();
+    stream._description = string();
+    stream._timestamp = svarint();
+    stream._duration = svarint();
+    stream._size = svarint();
+    stream._format = string();
+    stream._mediaOffset = svarint();
+    stream._streamInfoChecksum = svarint();
+    stream._chatChecksum = svarint();
+    stream._mediaChecksum = svarint();
+    stream._lastUpdate = svarint();
+    stream._flags = static_cast<int>(svarint());
+    for (auto n = count(); n; --n) {
+        stream._media.push_back(string());
+    }
+    return stream;
+}
+
+Track IpcReader::track()
+{
+    Track track;
+    track._id = svarint();
+    track._streamId = svarint();
+    track._name = string();
+    track._artist = string();
+    track._type = static_cast<int>(svarint());
+    track._time = svarint();
+    track._flags = static_cast<int>(svarint());
+    track._duration = svarint();
+    return track;
+}
+
+std::shared_ptr<const Catalog> IpcReader::catalog()
+{
+    auto version = varint();
+    std::vector<Catalog::StationPtr> stations;
+    std::vector<std::shared_ptr<Station>> stationPtrs;
+    for (auto n = count(9); n; --n) {
+        stationPtrs.push_back(std::make_shared<Station>(station()));
+        stations.push_back(stationPtrs.back());
+    }
+    std::unordered_map<int64_t, Catalog::StreamListPtr> streamsOfStation;
+    for (const auto& station : stationPtrs) {
+        auto list = std::make_shared<Catalog::StreamList>();
+        for (auto n = count(18); n; --n) {
+            auto current = std::make_shared<Stream>(stream());
+            current->_station = station;
+            auto numTracks = count(8);
+            if (numTracks) {
+                // the tracks link to a copy without tracks, like the ones of ReLiveDB::catalog()
+                auto parent = std::make_shared<Stream>(*current);
+                current->_tracks.reserve(numTracks);
+                for (; numTracks; --numTracks) {
+                    current->_tracks.push_back(track());
+                    current->_tracks.back()._stream = parent;
+                }
+            }
+            list->push_back(std::move(current));
+        }
+        if (!list->empty()) {
+            streamsOfStation.emplace(station->_id, std::move(list));
+        }
+    }
+    return std::make_shared<Catalog>(version, std::move(stations), std::move(streamsOfStation));
+}
+
+ChatLog IpcReader::chat()
+{
+    ChatLog::Builder builder;
+    auto numMessages = count(3);
+    builder.reserve(numMessages);
+    std::vector<std::string> strings;
+    for (; numMessages; --numMessages) {
+        auto time = static_cast<int>(svarint());
+        auto type = static_cast<ChatLog::MessageType>(u8());
+        strings.clear();
+        for (auto n = count(); n; --n) {
+            strings.push_back(string());
+        }
+        builder.add(time, type, strings);
+    }
+    return builder.build();
+}
+
+#ifndef _WIN32
+
+namespace {
+
+bool sendAll(int fd, const char* data, size_t size)
+{
+    while (size) {
+        auto rc = ::send(fd, data, size, MSG_NOSIGNAL);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        data += rc;
+        size -= static_cast<size_t>(rc);
+    }
+    return true;
+}
+
+bool receiveAll(int fd, char* data, size_t size)
+{
+    while (size) {
+        auto rc = ::recv(fd, data, size, 0);
+        if (rc < 0 && errno == EINTR) {
+            continue;
+        }
+        if (rc <= 0) {
+            return false;
+        }
+        data += rc;
+        size -= static_cast<size_t>(rc);
+    }
+    return true;
+}
+
+}  // namespace
+
+void prepareSocket(int fd)
+{
+#ifdef SO_NOSIGPIPE
+    int on = 1;
+    ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &on, sizeof(on));
+#else
+    (void)fd;
+#endif
+}
+
+bool sendFrame(int fd, const std::string& payload)
+{
+    if (payload.size() > Ipc::MaxFrameSize) {
+        return false;
+    }
+    auto size = static_cast<uint32_t>(payload.size());
+    char header[4] = {char(size & 0xff), char((size >> 8) & 0xff), char((size >> 16) & 0xff), char(size >> 24)};
+    return sendAll(fd, header, sizeof(header)) && sendAll(fd, payload.data(), payload.size());
+}
+
+bool receiveFrame(int fd, std::string& payload)
+{
+    unsigned char header[4];
+    if (!receiveAll(fd, reinterpret_cast<char*>(header), sizeof(header))) {
+        return false;
+    }
+    auto size = uint32_t(header[0]) | uint32_t(header[1]) << 8 | uint32_t(header[2]) << 16 | uint32_t(header[3]) << 24;
+    if (size > Ipc::MaxFrameSize) {
+        return false;
+    }
+    payload.resize(size);
+    return receiveAll(fd, payload.data(), size);
+}
+
+#endif
+
+std::string daemonSocketPath()
+{
+#ifdef _WIN32
+    return std::string();
+#else
+    auto runtimeDir = ::getenv("XDG_RUNTIME_DIR");
+    if (runtimeDir && *runtimeDir) {
+        return (fs::path(runtimeDir) / "relived.sock").string();
+    }
+    return (fs::temp_directory_path() / ("relived-" + std::to_string(::getuid()) + ".sock")).string();
+#endif
+}
+
+}  // namespace relive
@@ -0,0 +1,115 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "catalog.hpp"
+#include "chatlog.hpp"
+#include "relivedb.hpp"
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Binary protocol between the sync daemon and its clients over a Unix domain socket.
+// Every message is a frame of a four byte little endian payload length followed by
+// the payload. A request starts with its Ipc::Request code, a reply with an
+// Ipc::Reply code, eError replies carry a message string. Integers are LEB128
+// varints, signed ones zigzag encoded, strings a varint length and the bytes.
+// The writer and reader are portable, only the socket functions are Unix only.
+//---------------------------------------------------------------------------------------
+struct Ipc
+{
+    enum { ProtocolVersion = 2, MaxFrameSize = 256 * 1024 * 1024 };
+    enum Request : uint8_t {
+        eHello = 1,      // protocol version -> protocol version
+        eStatus,         // -> catalog version, last sync, syncing, clients
+        eCatalog,        // known catalog version -> changed, catalog if changed
+        eSearchStreams,  // query, limit, offset -> streams without tracks
+        eSearchTracks,   // query, filter, limit, offset -> track infos
+        eChat,           // stream id -> chat messages
+        eSync,           // force -> nothing, the sync runs in the background
+        eSetPlayed,      // stream id -> nothing
+    };
+    enum Reply : uint8_t { eOk = 0, eError = 1 };
+};
+
+// a malformed or truncated message or a broken connection
+class IpcError : public std::runtime_error
+{
+public:
+    explicit IpcError(const std::string& what)
+        : std::runtime_error(what)
+    {
+    }
+};
+
+class IpcWriter
+{
+public:
+    void u8(uint8_t val) { _data.push_back(static_cast<char>(val)); }
+    void varint(uint64_t val);
+    void svarint(int64_t val) { varint((static_cast<uint64_t>(val) << 1) ^ static_cast<uint64_t>(val >> 63)); }
+    void string(std::string_view str);
+    // bytes of another writer
+    void raw(std::string_view data) { _data.append(data.data(), data.size()); }
+    void station(const Station& station);
+    // without tracks
+    void stream(const Stream& stream);
+    void track(const Track& track);
+    void catalog(const Catalog& catalog);
+    void chat(const ChatLog& chat);
+    const std::string& data() const { return _data; }
+
+private:
+    std::string _data;
+};
+
+class IpcReader
+{
+public:
+    explicit IpcReader(std::string_view data)
+        : _data(data)
+    {
+    }
+    uint8_t u8();
+    uint64_t varint();
+    int64_t svarint()
+    {
+        auto val = varint();
+        return static_cast<int64_t>(val >> 1) ^ -static_cast<int64_t>(val & 1);
+    }
+    std::string string();
+    // a count of elements that are at least minSize bytes each, checked against the rest
+    size_t count(size_t minSize = 1);
+    Station station();
+    Stream stream();
+    Track track();
+    // same structure and sharing as the catalog of a ReLiveDB
+    std::shared_ptr<const Catalog> catalog();
+    ChatLog chat();
+    bool atEnd() const { return _pos == _data.size(); }
+
+private:
+    std::string_view _data;
+    size_t _pos = 0;
+};
+
+#ifndef _WIN32
+// keeps writes to a closed connection from raising SIGPIPE where MSG_NOSIGNAL is missing
+void prepareSocket(int fd);
+// blocking, false if the connection was closed or failed
+bool sendFrame(int fd, const std::string& payload);
+bool receiveFrame(int fd, std::string& payload);
+#endif
+
+// $XDG_RUNTIME_DIR/relived.sock, or one per user in the temp directory, empty on Windows
+std::string daemonSocketPath();
+
+}  // namespace relive
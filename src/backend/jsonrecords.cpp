@@ -0,0 +1,139 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "jsonrecords.hpp"
+
+#include <utility>
+#include <vector>
+
+using json = nlohmann::json;
+
+namespace relive {
+
+class JsonRecordReader::Sax : public nlohmann::json_sax<json>
+{
+public:
+    explicit Sax(JsonRecordReader& reader)
+        : _reader(reader)
+    {
+    }
+    bool null() override { return value(json()); }
+    bool boolean(bool val) override { return value(json(val)); }
+    bool number_integer(number_integer_t val) override { return value(json(val)); }
+    bool number_unsigned(number_unsigned_t val) override { return value(json(val)); }
+    bool number_float(number_float_t val, const string_t&) override { return value(json(val)); }
+    bool string(string_t& val) override { return value(json(std::move(val))); }
+    bool start_object(std::size_t) override { return start(json::object()); }
+    bool start_array(std::size_t) override { return start(json::array()); }
+    bool end_object() override { return end(); }
+    bool end_array() override { return end(); }
+    bool key(string_t& val) override
+    {
+        (_stack.empty() ? _key : _valueKey) = std::move(val);
+        return true;
+    }
+    bool parse_error(std::size_t, const std::string&, const nlohmann::detail::exception& ex) override
+    {
+        _reader._error = ex.what();
+        return false;
+    }
+
+private:
+    // _depth counts the containers not materialized, the top level object and the record array
+    bool start(json&& container)
+    {
+        if (!_stack.empty()) {
+            _stack.push_back(add(std::move(container)));
+        }
+        else if (!_depth) {
+            ++_depth;
+            return container.is_object();
+        }
+        else if (_depth == 1 && container.is_array() && _key == _reader._arrayKey) {
+            ++_depth;
+        }
+        else {
+            _value = std::move(container);
+            _stack.push_back(&_value);
+        }
+        return true;
+    }
+    bool end()
+    {
+        if (!_stack.empty()) {
+            _stack.pop_back();
+            if (_stack.empty()) {
+                finish(std::move(_value));
+            }
+        }
+        else {
+            --_depth;
+        }
+        return true;
+    }
+    bool value(json&& val)
+    {
+        if (!_stack.empty()) {
+            add(std::move(val));
+        }
+        else if (_depth) {
+            finish(std::move(val));
+        }
+        return _depth > 0;
+    }
+    // add to the innermost container under construction, returns the added value
+    json* add(json&& val)
+    {
+        auto& parent = *_stack.back();
+        if (parent.is_array()) {
+            parent.push_back(std::move(val));
+            return &parent.back();
+        }
+        auto& slot = parent[_valueKey];
+        slot = std::move(val);
+        return &slot;
+    }
+    // a complete record or top level member
+    void finish(json&& val)
+    {
+        if (_depth == 2) {
+            ++_reader._numRecords;
+            _reader._handler(val);
+        }
+        else {
+            _reader._header[_key] = std::move(val);
+        }
+    }
+    JsonRecordReader& _reader;
+    int _depth = 0;
+    std::string _key;       // of the current top level member
+    std::string _valueKey;  // of the current member inside a materialized value
+    json _value;
+    std::vector<json*> _stack;
+};
+
+JsonRecordReader::JsonRecordReader(std::string arrayKey, RecordHandler handler)
+    : _arrayKey(std::move(arrayKey))
+    , _handler(std::move(handler))
+    , _header(json::object())
+{
+}
+
+bool JsonRecordReader::parse(const std::string& text)
+{
+    _header = json::object();
+    _numRecords = 0;
+    _error.clear();
+    Sax sax(*this);
+    if (!json::sax_parse(text, &sax)) {
+        if (_error.empty()) {
+            _error = "top level value is not an object";
+        }
+        return false;
+    }
+    return true;
+}
+
+}  // namespace relive
@@ -0,0 +1,44 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include <nlohmann/json.hpp>
+#include <functional>
+#include <string>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// SAX based reader for the reLive API responses, which are an object with one large
+// array of records (stations, streams, tracks or chat messages) and a few small
+// members. Only one record is materialized at a time and handed to the handler
+// while parsing, so the memory needed is the response text plus a single record
+// instead of a DOM of the whole response.
+//---------------------------------------------------------------------------------------
+class JsonRecordReader
+{
+public:
+    using RecordHandler = std::function<void(const nlohmann::json& record)>;
+    // records are the elements of the array member arrayKey of the top level object
+    JsonRecordReader(std::string arrayKey, RecordHandler handler);
+
+    // false on syntax errors, exceptions thrown by the handler are passed on
+    bool parse(const std::string& text);
+    // all other members of the top level object
+    const nlohmann::json& header() const { return _header; }
+    size_t numRecords() const { return _numRecords; }
+    const std::string& error() const { return _error; }
+
+private:
+    class Sax;
+    std::string _arrayKey;
+    RecordHandler _handler;
+    nlohmann::json _header;
+    size_t _numRecords = 0;
+    std::string _error;
+};
+
+}  // namespace relive
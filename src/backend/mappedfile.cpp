@@ -0,0 +1,99 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "mappedfile.hpp"
+#include "logging.hpp"
+#include "system.hpp"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = ghc::filesystem;
+
+namespace relive {
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+{
+    auto file = ::CreateFileW(fs::path(filename).wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        ERROR_LOG(1, "Couldn't open " << filename << " for mapping: " << ::GetLastError());
+        return;
+    }
+    _file = file;
+    LARGE_INTEGER size;
+    if (!::GetFileSizeEx(file, &size) || !size.QuadPart || uint64_t(size.QuadPart) > SIZE_MAX) {
+        return;
+    }
+    _mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!_mapping) {
+        ERROR_LOG(1, "Couldn't map " << filename << ": " << ::GetLastError());
+        return;
+    }
+    _data = static_cast<const uint8_t*>(::MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0));
+    if (_data) {
+        _size = static_cast<size_t>(size.QuadPart);
+    }
+    else {
+        ERROR_LOG(1, "Couldn't map " << filename << ": " << ::GetLastError());
+    }
+}
+
+MappedFile::~MappedFile()
+{
+    if (_data) {
+        ::UnmapViewOfFile(_data);
+    }
+    if (_mapping) {
+        ::CloseHandle(_mapping);
+    }
+    if (_file) {
+        ::CloseHandle(_file);
+    }
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& filename)
+{
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+        ERROR_LOG(1, "Couldn't open " << filename << " for mapping: " << errno);
+        return;
+    }
+    struct stat st;
+    if (::fstat(fd, &st) == 0 && st.st_size > 0 && uint64_t(st.st_size) <= SIZE_MAX) {
+        auto addr = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr != MAP_FAILED) {
+            ::madvise(addr, static_cast<size_t>(st.st_size), MADV_SEQUENTIAL);
+            _data = static_cast<const uint8_t*>(addr);
+            _size = static_cast<size_t>(st.st_size);
+        }
+        else {
+            ERROR_LOG(1, "Couldn't map " << filename << ": " << errno);
+        }
+    }
+    // the mapping stays valid without the descriptor
+    ::close(fd);
+}
+
+MappedFile::~MappedFile()
+{
+    if (_data) {
+        ::munmap(const_cast<uint8_t*>(_data), _size);
+    }
+}
+
+#endif
+
+}  // namespace relive
@@ -0,0 +1,265 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "mediacache.hpp"
+#include "logging.hpp"
+#include "system.hpp"
+
+#include <algorithm>
+#include <list>
+#include <map>
+#include <mutex>
+#include <tuple>
+#include <vector>
+
+namespace fs = ghc::filesystem;
+
+namespace relive {
+
+using BlockKey = std::tuple<int64_t, int64_t, int64_t, int64_t>;
+
+static BlockKey blockKey(const MediaCache::Key& key, int64_t offset)
+{
+    return BlockKey(key._stationId, key._reliveId, key._mediaChecksum, offset);
+}
+
+static std::string blockFilename(const BlockKey& key)
+{
+    return std::to_string(std::get<0>(key)) + "_" + std::to_string(std::get<1>(key)) + "_" + std::to_string(std::get<2>(key)) + "_" + std::to_string(std::get<3>(key)) + ".chunk";
+}
+
+static bool parseBlockFilename(const std::string& filename, BlockKey& key)
+{
+    const std::string ext = ".chunk";
+    if (filename.length() <= ext.length() || filename.compare(filename.length() - ext.length(), ext.length(), ext) != 0) {
+        return false;
+    }
+    int64_t parts[4];
+    size_t pos = 0;
+    for (int i = 0; i < 4; ++i) {
+        auto end = i < 3 ? filename.find('_', pos) : filename.length() - ext.length();
+        if (end == std::string::npos || end == pos) {
+            return false;
+        }
+        try {
+            size_t used = 0;
+            parts[i] = std::stoll(filename.substr(pos, end - pos), &used);
+            if (used != end - pos) {
+                return false;
+            }
+        }
+        catch (...) {
+            return false;
+        }
+        pos = end + 1;
+    }
+    key = BlockKey(parts[0], parts[1], parts[2], parts[3]);
+    return true;
+}
+
+struct MediaCache::impl
+{
+    struct Entry {
+        int64_t _size;
+        std::list<BlockKey>::iterator _lruPos;
+    };
+    mutable std::mutex _mutex;
+    fs::path _directory;
+    int64_t _budget;
+    int64_t _usedBytes = 0;
+    std::map<BlockKey, Entry> _entries;
+    std::list<BlockKey> _lru;  // most recently used first
+
+    impl(const std::string& directory, int64_t budget)
+        : _directory(directory)
+        , _budget(budget)
+    {
+    }
+
+    fs::path pathOf(const BlockKey& key) const
+    {
+        return _directory / blockFilename(key);
+    }
+
+    void scan()
+    {
+        std::error_code ec;
+        fs::create_directories(_directory, ec);
+        if (ec) {
+            ERROR_LOG(1, "Couldn't create media cache directory " << _directory.string() << ": " << ec.message());
+            return;
+        }
+        std::vector<std::pair<fs::file_time_type, BlockKey>> found;
+        for (const auto& de : fs::directory_iterator(_directory, ec)) {
+            BlockKey key;
+            if (de.is_regular_file(ec) && parseBlockFilename(de.path().filename().string(), key)) {
+                auto size = static_cast<int64_t>(de.file_size(ec));
+                if (!ec) {
+                    found.emplace_back(de.last_write_time(ec), key);
+                    _entries[key] = Entry{size, _lru.end()};
+                    _usedBytes += size;
+                }
+            }
+            else if (de.path().extension() == ".tmp") {
+                // leftover of an interrupted store
+                fs::remove(de.path(), ec);
+            }
+        }
+        std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) { return a.first > b.first; });
+        for (const auto& [time, key] : found) {
+            _entries[key]._lruPos = _lru.insert(_lru.end(), key);
+        }
+        DEBUG_LOG(1, "Media cache: " << _entries.size() << " blocks with " << _usedBytes << " bytes");
+        evict();
+    }
+
+    void touch(const BlockKey& key, Entry& entry)
+    {
+        _lru.splice(_lru.begin(), _lru, entry._lruPos);
+        std::error_code ec;
+        fs::last_write_time(pathOf(key), fs::file_time_type::clock::now(), ec);
+    }
+
+    void remove(const BlockKey& key)
+    {
+        auto iter = _entries.find(key);
+        if (iter != _entries.end()) {
+            std::error_code ec;
+            fs::remove(pathOf(key), ec);
+            _usedBytes -= iter->second._size;
+            _lru.erase(iter->second._lruPos);
+            _entries.erase(iter);
+        }
+    }
+
+    void evict()
+    {
+        while (_usedBytes > _budget && !_lru.empty()) {
+            DEBUG_LOG(3, "Media cache: evicting " << blockFilename(_lru.back()));
+            remove(_lru.back());
+        }
+    }
+};
+
+MediaCache::MediaCache(const std::string& directory, int64_t budget)
+    : _impl(std::make_unique<impl>(directory, budget))
+{
+    _impl->scan();
+}
+
+MediaCache::~MediaCache() = default;
+
+int64_t MediaCache::budget() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_budget;
+}
+
+void MediaCache::budget(int64_t bytes)
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    _impl->_budget = (std::max)(bytes, INT64_C(0));
+    _impl->evict();
+}
+
+int64_t MediaCache::usedBytes() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_usedBytes;
+}
+
+bool MediaCache::contains(const Key& key, int64_t offset) const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_entries.count(blockKey(key, blockStart(offset))) > 0;
+}
+
+size_t MediaCache::read(const Key& key, int64_t offset, char* dst, size_t maxBytes)
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    auto bk = blockKey(key, blockStart(offset));
+    auto iter = _impl->_entries.find(bk);
+    if (iter == _impl->_entries.end()) {
+        return 0;
+    }
+    auto start = offset - blockStart(offset);
+    if (start >= iter->second._size) {
+        return 0;
+    }
+    auto len = static_cast<size_t>((std::min)(iter->second._size - start, static_cast<int64_t>(maxBytes)));
+    fs::ifstream is(_impl->pathOf(bk), std::ios::binary);
+    if (!is.seekg(start) || !is.read(dst, len)) {
+        ERROR_LOG(1, "Media cache: couldn't read " << _impl->pathOf(bk).string() << ", dropping it");
+        _impl->remove(bk);
+        return 0;
+    }
+    _impl->touch(bk, iter->second);
+    return len;
+}
+
+void MediaCache::store(const Key& key, int64_t offset, const char* data, size_t size)
+{
+    if (!key.valid() || offset != blockStart(offset) || !size || size > BlockSize) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    if (static_cast<int64_t>(size) > _impl->_budget) {
+        return;
+    }
+    auto bk = blockKey(key, offset);
+    _impl->remove(bk);
+    // write to a temporary first so a crash never leaves a truncated block behind
+    auto path = _impl->pathOf(bk);
+    auto tmpPath = fs::path(path.string() + ".tmp");
+    {
+        fs::ofstream os(tmpPath, std::ios::binary | std::ios::trunc);
+        if (!os.write(data, size) || !os.flush()) {
+            ERROR_LOG(1, "Media cache: couldn't write " << tmpPath.string());
+            std::error_code ec;
+            fs::remove(tmpPath, ec);
+            return;
+        }
+    }
+    std::error_code ec;
+    fs::rename(tmpPath, path, ec);
+    if (ec) {
+        ERROR_LOG(1, "Media cache: couldn't store " << path.string() << ": " << ec.message());
+        fs::remove(tmpPath, ec);
+        return;
+    }
+    _impl->_entries[bk] = impl::Entry{static_cast<int64_t>(size), _impl->_lru.insert(_impl->_lru.begin(), bk)};
+    _impl->_usedBytes += size;
+    DEBUG_LOG(3, "Media cache: stored " << path.filename().string());
+    _impl->evict();
+}
+
+void MediaCache::removeStale(const Key& key)
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    auto iter = _impl->_entries.lower_bound(BlockKey(key._stationId, key._reliveId, INT64_MIN, INT64_MIN));
+    std::vector<BlockKey> stale;
+    while (iter != _impl->_entries.end() && std::get<0>(iter->first) == key._stationId && std::get<1>(iter->first) == key._reliveId) {
+        if (std::get<2>(iter->first) != key._mediaChecksum) {
+            stale.push_back(iter->first);
+        }
+        ++iter;
+    }
+    for (const auto& bk : stale) {
+        _impl->remove(bk);
+    }
+    if (!stale.empty()) {
+        DEBUG_LOG(1, "Media cache: removed " << stale.size() << " outdated blocks of stream " << key._reliveId);
+    }
+}
+
+void MediaCache::clear()
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    while (!_impl->_lru.empty()) {
+        _impl->remove(_impl->_lru.back());
+    }
+}
+
+}  // namespace relive
@@ -0,0 +1,57 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Bounded on-disk cache of reLive media data, split into blocks of BlockSize bytes
+// and keyed by (station, reliveId, mediaChecksum, offset). The least recently used
+// blocks are evicted when the size budget is exceeded, the access order survives
+// restarts via the file modification times.
+//---------------------------------------------------------------------------------------
+class MediaCache
+{
+public:
+    enum { BlockSize = 256 * 1024 };
+    struct Key {
+        int64_t _stationId = 0;
+        int64_t _reliveId = 0;
+        int64_t _mediaChecksum = 0;
+        bool valid() const { return _reliveId && _mediaChecksum; }
+        bool operator==(const Key& other) const { return _stationId == other._stationId && _reliveId == other._reliveId && _mediaChecksum == other._mediaChecksum; }
+        bool operator!=(const Key& other) const { return !(*this == other); }
+    };
+    MediaCache(const std::string& directory, int64_t budget);
+    ~MediaCache();
+
+    int64_t budget() const;
+    void budget(int64_t bytes);
+    int64_t usedBytes() const;
+
+    // block aligned start offset of the block containing the given stream offset
+    static int64_t blockStart(int64_t offset) { return offset / BlockSize * BlockSize; }
+
+    bool contains(const Key& key, int64_t offset) const;
+    // copy up to maxBytes starting at the stream offset from the cached block containing it,
+    // returns 0 if that block is not cached
+    size_t read(const Key& key, int64_t offset, char* dst, size_t maxBytes);
+    // store a block, offset must be block aligned and size BlockSize unless it is the last one
+    void store(const Key& key, int64_t offset, const char* data, size_t size);
+    // drop all blocks of the same stream that were cached with a different media checksum
+    void removeStale(const Key& key);
+    void clear();
+
+private:
+    struct impl;
+    std::unique_ptr<impl> _impl;
+};
+
+}  // namespace relive
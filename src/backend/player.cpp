@@ -5,7 +5,11 @@
 //---------------------------------------------------------------------------------------
 #include "player.hpp"
 #include "logging.hpp"
+#include "mappedfile.hpp"
+#include "mediacache.hpp"
+#include "prefetcher.hpp"
 #include "ringbuffer.hpp"
+#include "seekindex.hpp"
 #include "system.hpp"
 
 namespace fs = ghc::filesystem;
@@ -15,6 +19,7 @@ namespace fs = ghc::filesystem;
 #define MINIMP3_IMPLEMENTATION
 #include <minimp3.h>
 
+#include <backend/httppool.hpp>
 #include <backend/netutility.hpp>
 
 #ifdef __APPLE__
@@ -27,7 +32,9 @@ namespace fs = ghc::filesystem;
 #include <mackron/miniaudio.h>
 
 #include <algorithm>
+#include <array>
 #include <atomic>
+#include <cstring>
 #include <fstream>
 #include <iostream>
 #include <mutex>
@@ -53,16 +60,34 @@ namespace relive {
 
 using SampleType = short;
 
+#define MAX_DECODE_AHEAD_MS 2000
+
 struct Player::impl
 {
     std::recursive_mutex _mutex;
+    std::mutex _decodeMutex;
     std::atomic_bool _isRunning;
     std::atomic_bool _isPlaying;
     std::atomic_bool _needsRefresh;
     std::thread _worker;
+    std::thread _decoder;
     Mode _mode = eNone;
     ghc::net::uri _source;
-    std::shared_ptr<httplib::Client> _session;
+    std::shared_ptr<RangePrefetcher> _prefetcher;
+    std::unique_ptr<MappedFile> _mappedFile;  // eFile source, decoded in place, changed only with both locks held
+    std::unique_ptr<MediaCache> _mediaCache;
+    int64_t _mediaCacheSize = INT64_C(512) * 1024 * 1024;
+    MediaCache::Key _cacheKey;
+    // block currently assembled from received data, only touched by the player thread
+    MediaCache::Key _cacheBlockKey;
+    int64_t _cacheBlockOffset = -1;
+    std::string _cacheBlock;
+    // guarded by _decodeMutex
+    SeekIndex _seekIndex;
+    std::string _seekIndexFile;
+    int64_t _decodeSamplePosition = 0;  // sample frame position of the next decoded frame
+    bool _decodeSampleExact = false;    // _decodeSamplePosition is exact, so frames may be indexed
+    int64_t _skipSamples = 0;           // sample frames to drop after a seek to reach the exact position
     std::shared_ptr<Stream> _streamInfo;
     std::string _currentDeviceName;
     int64_t _offset = 0;          // fetch offset in stream (bytes)
@@ -73,6 +98,7 @@ struct Player::impl
     int _frameRate = 44100;
     int _numChannels = 2;
     int _volume = 75;
+    std::atomic<int> _decodeAheadMs;
     RingBuffer<char> _receiveBuffer;
     RingBuffer<SampleType> _sampleBuffer;
     std::vector<char> _chunk;
@@ -84,6 +110,8 @@ struct Player::impl
     enum BackendState { eUninitialized, eInitialized, eReadyForPlayback };
     std::atomic<BackendState> _backendState;
     int _progress;
+    std::array<std::atomic<uint64_t>, CallbackHistogram::NumBuckets> _callbackBuckets;
+    std::atomic<int64_t> _callbackMaxMicroseconds;
 
     impl(Player* player)
         : _isRunning(true)
@@ -97,14 +125,102 @@ struct Player::impl
         , _frameRate(44100)
         , _numChannels(2)
         , _volume(75)
+        , _decodeAheadMs(500)
         , _receiveBuffer(1024 * 1024)
-        , _sampleBuffer(16 * 1024)
+        , _sampleBuffer(MAX_DECODE_AHEAD_MS * 44100 * 2 / 1000 + MINIMP3_MAX_SAMPLES_PER_FRAME)
         , _chunk(_chunkSize)
         , _state(ePAUSED)
         , _progress(0)
         , _backendState(eUninitialized)
+        , _callbackMaxMicroseconds(0)
     {
         mp3dec_init(&_mp3d);
+        for (auto& bucket : _callbackBuckets) {
+            bucket = 0;
+        }
+    }
+
+    unsigned int decodeTargetSamples() const
+    {
+        auto target = static_cast<unsigned int>(int64_t(_decodeAheadMs) * _frameRate * _numChannels / 1000);
+        return (std::min)(target, _sampleBuffer.bufferSize() - MINIMP3_MAX_SAMPLES_PER_FRAME);
+    }
+
+    void saveSeekIndex()
+    {
+        if (!_seekIndexFile.empty() && _seekIndex.modified()) {
+            _seekIndex.save(_seekIndexFile);
+        }
+    }
+
+    // needs _mutex and _decodeMutex
+    void positionAt(double seconds)
+    {
+        auto target = static_cast<int64_t>(seconds * _frameRate);
+        SeekIndex::Entry entry;
+        if (_seekIndex.lookup(target, entry)) {
+            // start at a known frame header and drop the samples up to the target
+            _offset = entry._offset;
+            _decodeSamplePosition = entry._sample;
+            _skipSamples = target - entry._sample;
+            _playPosition = target;
+            _decodeSampleExact = true;
+        }
+        else if (_streamInfo && _streamInfo->_duration && _streamInfo->_size) {
+            auto tt = seconds > 0 ? seconds - 0.05 : seconds;
+            _offset = (int64_t)(_streamInfo->_size * (tt / _streamInfo->_duration));
+            _playPosition = static_cast<int64_t>(((double)_streamInfo->_duration * _offset / _streamInfo->_size + 0.1) * _frameRate);
+            _decodeSamplePosition = _playPosition;
+            _skipSamples = 0;
+            _decodeSampleExact = _offset == 0;
+        }
+        _decodePosition = _offset;
+        // don't let the bit reservoir of the old position leak into the first frame
+        mp3dec_init(&_mp3d);
+    }
+
+    void cacheReceived(MediaCache* mediaCache, const MediaCache::Key& key, int64_t streamSize, int64_t offset, const char* data, size_t len)
+    {
+        if (!mediaCache || !key.valid() || !len) {
+            return;
+        }
+        if (key != _cacheBlockKey || _cacheBlockOffset + int64_t(_cacheBlock.size()) != offset) {
+            // not contiguous to what we have, restart at the next block boundary
+            _cacheBlockKey = key;
+            _cacheBlock.clear();
+            _cacheBlockOffset = MediaCache::blockStart(offset + MediaCache::BlockSize - 1);
+            auto skip = _cacheBlockOffset - offset;
+            if (skip >= int64_t(len)) {
+                _cacheBlockOffset = -1;
+                return;
+            }
+            data += skip;
+            len -= static_cast<size_t>(skip);
+            offset = _cacheBlockOffset;
+        }
+        while (len) {
+            auto part = (std::min)(len, MediaCache::BlockSize - _cacheBlock.size());
+            _cacheBlock.append(data, part);
+            data += part;
+            len -= part;
+            if (_cacheBlock.size() == MediaCache::BlockSize || _cacheBlockOffset + int64_t(_cacheBlock.size()) >= streamSize) {
+                mediaCache->store(key, _cacheBlockOffset, _cacheBlock.data(), _cacheBlock.size());
+                _cacheBlockOffset += _cacheBlock.size();
+                _cacheBlock.clear();
+            }
+        }
+    }
+
+    void recordCallbackDuration(int64_t microseconds)
+    {
+        int bucket = 0;
+        while (bucket < CallbackHistogram::NumBuckets - 1 && microseconds >= (INT64_C(1) << bucket)) {
+            ++bucket;
+        }
+        _callbackBuckets[bucket].fetch_add(1, std::memory_order_relaxed);
+        auto currentMax = _callbackMaxMicroseconds.load(std::memory_order_relaxed);
+        while (microseconds > currentMax && !_callbackMaxMicroseconds.compare_exchange_weak(currentMax, microseconds, std::memory_order_relaxed)) {
+        }
     }
 };
 
@@ -119,12 +235,15 @@ Player::Player()
         _impl->_backendState = impl::eInitialized;
     }
     configureAudio(getDynamicDefaultOutputName());
+    _impl->_decoder = std::thread(&Player::decode, this);
 }
 
 Player::~Player()
 {
     _impl->_isRunning = false;
     _impl->_worker.join();
+    _impl->_decoder.join();
+    _impl->saveSeekIndex();
     disableAudio();
     ma_context_uninit(&_impl->_maContext);
 }
@@ -275,12 +394,12 @@ void Player::seekTo(int seconds, bool startPlay)
     std::scoped_lock lock{_impl->_mutex};
     abortAudio();
     if (_impl->_streamInfo) {
-        auto tt = seconds > 0 ? (double)seconds - 0.05 : (double)seconds;
-        _impl->_offset = (int64_t)(_impl->_streamInfo->_size * (tt / _impl->_streamInfo->_duration));
-        _impl->_decodePosition = _impl->_offset;
-        _impl->_playPosition = ((double)_impl->_streamInfo->_duration * _impl->_offset / _impl->_streamInfo->_size + 0.1) * _impl->_frameRate;
-        _impl->_receiveBuffer.clear();
-        _impl->_sampleBuffer.clear();
+        {
+            std::scoped_lock decodeLock{_impl->_decodeMutex};
+            _impl->positionAt(seconds);
+            _impl->_receiveBuffer.clear();
+            _impl->_sampleBuffer.clear();
+        }
         if(startPlay) {
             play();
         }
@@ -297,6 +416,50 @@ float Player::decodeBufferQuote() const
     return float(_impl->_sampleBuffer.filled()) / _impl->_sampleBuffer.bufferSize();
 }
 
+int Player::decodeAhead() const
+{
+    return _impl->_decodeAheadMs;
+}
+
+void Player::decodeAhead(int milliseconds)
+{
+    _impl->_decodeAheadMs = (std::max)(20, (std::min)(milliseconds, MAX_DECODE_AHEAD_MS));
+}
+
+Player::CallbackHistogram Player::callbackHistogram() const
+{
+    CallbackHistogram result;
+    for (int i = 0; i < CallbackHistogram::NumBuckets; ++i) {
+        result._buckets[i] = _impl->_callbackBuckets[i].load(std::memory_order_relaxed);
+        result._count += result._buckets[i];
+    }
+    result._maxMicroseconds = _impl->_callbackMaxMicroseconds.load(std::memory_order_relaxed);
+    return result;
+}
+
+void Player::resetCallbackHistogram()
+{
+    for (auto& bucket : _impl->_callbackBuckets) {
+        bucket.store(0, std::memory_order_relaxed);
+    }
+    _impl->_callbackMaxMicroseconds = 0;
+}
+
+int64_t Player::mediaCacheSize() const
+{
+    std::scoped_lock lock{_impl->_mutex};
+    return _impl->_mediaCacheSize;
+}
+
+void Player::mediaCacheSize(int64_t bytes)
+{
+    std::scoped_lock lock{_impl->_mutex};
+    _impl->_mediaCacheSize = bytes;
+    if (_impl->_mediaCache) {
+        _impl->_mediaCache->budget(bytes);
+    }
+}
+
 void Player::prev()
 {
     std::scoped_lock lock{_impl->_mutex};
@@ -378,7 +541,7 @@ void Player::run()
         if (_impl->_isPlaying) {
             if (_impl->_state != eENDOFSTREAM) {
                 if (_impl->_receiveBuffer.free() > _impl->_chunkSize) {
-                    if (!fillBuffer()) {
+                    if (!fillBuffer() && _impl->_mode != eReLiveStream) {
                         std::this_thread::sleep_for(500ms);
                     }
                 }
@@ -400,24 +563,42 @@ void Player::setSource(Mode mode, ghc::net::uri source, int64_t size)
 {
     std::scoped_lock lock{_impl->_mutex};
     abortAudio();
+    std::scoped_lock decodeLock{_impl->_decodeMutex};
     _impl->_mode = mode;
     _impl->_source = source;
     _impl->_offset = 0;
     _impl->_decodePosition = 0;
     _impl->_playPosition = 0;
+    _impl->saveSeekIndex();
+    _impl->_seekIndex.clear();
+    _impl->_seekIndexFile.clear();
+    _impl->_decodeSamplePosition = 0;
+    _impl->_decodeSampleExact = true;
+    _impl->_skipSamples = 0;
+    mp3dec_init(&_impl->_mp3d);
     _impl->_size = size;
     _impl->_state = ePAUSED;
     _impl->_streamInfo.reset();
     _impl->_receiveBuffer.clear();
     _impl->_sampleBuffer.clear();
+    _impl->_prefetcher.reset();
+    _impl->_mappedFile.reset();
+    _impl->_cacheKey = MediaCache::Key();
     switch (mode) {
-        case eFile:
-            _impl->_size = fs::file_size(_impl->_source.request_path());
+        case eFile: {
+            auto mappedFile = std::make_unique<MappedFile>(_impl->_source.request_path());
+            if (mappedFile->isOpen()) {
+                _impl->_size = static_cast<int64_t>(mappedFile->size());
+                _impl->_mappedFile = std::move(mappedFile);
+            }
+            else {
+                // fall back to reading chunks through the receive buffer
+                _impl->_size = fs::file_size(_impl->_source.request_path());
+            }
             break;
+        }
         case eReLiveStream:
-        case eMediaStream:
-        case eSCastStream:
-            _impl->_session = createClient(source);
+            _impl->_prefetcher = std::make_shared<RangePrefetcher>(source, size);
             break;
         default:
             break;
@@ -437,6 +618,16 @@ void Player::setSource(const Stream& stream)
         {
             std::scoped_lock lock{_impl->_mutex};
             _impl->_streamInfo = std::make_shared<Stream>(stream);
+            if (!_impl->_mediaCache) {
+                _impl->_mediaCache = std::make_unique<MediaCache>((fs::path(dataPath()) / "mediacache").string(), _impl->_mediaCacheSize);
+            }
+            _impl->_cacheKey = MediaCache::Key{stream._stationId, stream._reliveId, stream._mediaChecksum};
+            _impl->_mediaCache->removeStale(_impl->_cacheKey);
+            if (_impl->_cacheKey.valid()) {
+                std::scoped_lock decodeLock{_impl->_decodeMutex};
+                _impl->_seekIndexFile = (fs::path(dataPath()) / "seekindex" / (std::to_string(stream._stationId) + "_" + std::to_string(stream._reliveId) + "_" + std::to_string(stream._mediaChecksum) + ".idx")).string();
+                _impl->_seekIndex.load(_impl->_seekIndexFile);
+            }
         }
     }
 }
@@ -447,10 +638,8 @@ void Player::setSource(const Track& track)
         setSource(*track._stream);
         {
             std::scoped_lock lock{_impl->_mutex};
-            auto tt = track._time > 0 ? (double)track._time - 0.05 : (double)track._time;
-            _impl->_offset = (int64_t)(track._stream->_size * (tt / track._stream->_duration));
-            _impl->_decodePosition = _impl->_offset;
-            _impl->_playPosition = static_cast<int64_t>(((double)track._stream->_duration * _impl->_offset / track._stream->_size + 0.1) * _impl->_frameRate);
+            std::scoped_lock decodeLock{_impl->_decodeMutex};
+            _impl->positionAt(track._time);
             DEBUG_LOG(1, "New play position: " << _impl->_offset << "/" << _impl->_playPosition);
         }
     }
@@ -473,6 +662,10 @@ bool Player::fillBuffer()
             int64_t offset;
             {
                 std::scoped_lock lock{_impl->_mutex};
+                if (_impl->_mappedFile) {
+                    // the decoder reads straight from the mapping
+                    break;
+                }
                 file = _impl->_source.request_path();
                 offset = _impl->_offset;
             }
@@ -494,40 +687,53 @@ bool Player::fillBuffer()
             break;
         }
         case eReLiveStream: {
-            httplib::Headers headers = {{"User-Agent", relive::userAgent()}};
-            int64_t fetchSize;
-            int64_t offset;
-            std::string range;
+            MediaCache::Key key;
+            MediaCache* mediaCache;  // created once by setSource(), never replaced
+            int64_t offset, size;
+            unsigned int maxBytes;
+            std::shared_ptr<RangePrefetcher> prefetcher;
             {
                 std::scoped_lock lock{_impl->_mutex};
+                key = _impl->_cacheKey;
+                mediaCache = _impl->_mediaCache.get();
                 offset = _impl->_offset;
-                fetchSize = _impl->_size > offset ? (std::min)(_impl->_size - offset, static_cast<int64_t>(_impl->_chunkSize)) : 0;
-                range = "&start=" + std::to_string(offset) + "&length=" + std::to_string(fetchSize);
+                size = _impl->_size;
+                maxBytes = (std::min)(_impl->_receiveBuffer.free(), static_cast<unsigned int>(_impl->_chunk.size()));
+                prefetcher = _impl->_prefetcher;
             }
-            if (fetchSize > 0) {
-                std::string path = _impl->_source.request_path() + range;
-                DEBUG_LOG(2, "Fetching eReLiveStream: " << path);
-                auto res = _impl->_session->Get(path.c_str(), headers);
-                if (res && res->status == 200) {
-                    DEBUG_LOG(3, "reLiveStream: About to push " << res->body.size() << " bytes, (buffer has " << _impl->_receiveBuffer.free() << " bytes free)");
-                    {
-                        std::scoped_lock lock{_impl->_mutex};
-                        if (_impl->_offset == offset) {
-                            // add only if we have not changed offset due to seek/pause/change of stream
-                            _impl->_receiveBuffer.push(res->body.data(), res->body.size());
-                            _impl->_offset += res->body.size();
-                        }
+            if (mediaCache && key.valid()) {
+                // the cache is only filled by this thread, so a miss can't turn into a hit meanwhile
+                auto len = mediaCache->read(key, offset, _impl->_chunk.data(), maxBytes);
+                if (len) {
+                    std::scoped_lock lock{_impl->_mutex};
+                    if (_impl->_cacheKey == key && _impl->_offset == offset) {
+                        _impl->_receiveBuffer.push(_impl->_chunk.data(), static_cast<unsigned int>(len));
+                        _impl->_offset += len;
+                        DEBUG_LOG(3, "reLiveStream: Pushed " << len << " cached bytes into stream buffer");
                     }
-                    DEBUG_LOG(2, "reLiveStream: Pushed " << res->body.size() << " bytes into stream buffer");
+                    return true;
                 }
-                else {
-                    if (res) {
-                        ERROR_LOG(1, "reLiveStream: fetch failed (" << res->status << ") for range " << range);
-                    }
-                    else {
-                        ERROR_LOG(1, "reLiveStream: fetch failed for range " << range);
+            }
+            // the prefetcher keeps several range requests in flight, we only wait for the next in-order data
+            if (prefetcher && prefetcher->position() != offset) {
+                DEBUG_LOG(2, "reLiveStream: restarting prefetch at " << offset);
+                prefetcher->start(offset);
+            }
+            if (prefetcher && prefetcher->waitForData(std::chrono::milliseconds(100))) {
+                size_t len = 0;
+                {
+                    std::scoped_lock lock{_impl->_mutex};
+                    if (prefetcher == _impl->_prefetcher && prefetcher->position() == _impl->_offset) {
+                        // add only if we have not changed offset due to seek/pause/change of stream
+                        offset = _impl->_offset;
+                        len = prefetcher->read(_impl->_chunk.data(), (std::min)(_impl->_receiveBuffer.free(), static_cast<unsigned int>(_impl->_chunk.size())));
+                        _impl->_receiveBuffer.push(_impl->_chunk.data(), static_cast<unsigned int>(len));
+                        _impl->_offset += len;
+                        DEBUG_LOG(3, "reLiveStream: Pushed " << len << " bytes into stream buffer");
                     }
                 }
+                _impl->cacheReceived(mediaCache, key, size, offset, _impl->_chunk.data(), len);
+                return len > 0;
             }
             break;
         }
@@ -536,7 +742,11 @@ bool Player::fillBuffer()
             httplib::Headers headers = {{"User-Agent", relive::userAgent()}, {"Range", range}};
             std::string path = _impl->_source.request_path();
             DEBUG_LOG(2, "Fetching eMediaStream: " << _impl->_source.str() << " - Range: " << range);
-            auto res = _impl->_session->Get(path.c_str(), headers);
+            auto session = HttpPool::instance().acquire(_impl->_source);
+            auto res = session->Get(path.c_str(), headers);
+            if (!res) {
+                session.discard();
+            }
             if (res && res->status == 206) {
                 _impl->_receiveBuffer.push(res->body.data(), res->body.size());
                 _impl->_offset += res->body.size();
@@ -571,7 +781,10 @@ void Player::streamSCast()
     bool inMetaData = false;
     std::string metaData;
     DEBUG_LOG(2, "Starting eSCStream: " << _impl->_source.str());
-    auto res = _impl->_session->Get(
+    // the stream is only ever ended by aborting it, so the connection isn't reused
+    auto session = HttpPool::instance().acquire(_impl->_source);
+    session.discard();
+    auto res = session->Get(
         _impl->_source.request_path().c_str(), headers,
         [&](const httplib::Response& response) {
             metaint = httplib::detail::get_header_value_uint64(response.headers, "icy-metaint");
@@ -652,29 +865,83 @@ void Player::streamSCast()
 
 #define BUFFER_PEEK_SIZE 4096u
 
+void Player::decode()
+{
+#ifdef TRACY_ENABLED
+    tracy::SetThreadName("Decoder");
+#endif
+    using namespace std::chrono_literals;
+    while (_impl->_isRunning) {
+        bool progress = false;
+        if (_impl->_isPlaying && _impl->_state != eENDOFSTREAM && _impl->_state != eERROR) {
+            std::scoped_lock lock{_impl->_decodeMutex};
+            auto target = _impl->decodeTargetSamples();
+            while (_impl->_sampleBuffer.filled() < target && _impl->_isRunning) {
+                auto lastPosition = _impl->_decodePosition;
+                decodeFrame();
+                if (_impl->_decodePosition == lastPosition) {
+                    break;
+                }
+                progress = true;
+            }
+        }
+        if (!progress) {
+            std::this_thread::sleep_for(5ms);
+        }
+    }
+}
+
 void Player::decodeFrame()
 {
     ZoneScopedN("decodeFrame");
     // std::clog << "decode..." << std::endl;
-    if (_impl->_receiveBuffer.canPull(200) && _impl->_sampleBuffer.free() >= MINIMP3_MAX_SAMPLES_PER_FRAME) {
+    auto& mappedFile = _impl->_mappedFile;
+    auto mappedAvail = mappedFile && _impl->_decodePosition < int64_t(mappedFile->size()) ? mappedFile->size() - static_cast<size_t>(_impl->_decodePosition) : 0;
+    if ((mappedFile ? mappedAvail >= 200 : _impl->_receiveBuffer.canPull(200)) && _impl->_sampleBuffer.free() >= MINIMP3_MAX_SAMPLES_PER_FRAME) {
         // std::clog << "decode... (" << _impl->_receiveBuffer.filled() << " available)" << std::endl;
         short pcm[MINIMP3_MAX_SAMPLES_PER_FRAME];
-        uint8_t mp3[BUFFER_PEEK_SIZE];
-        auto avail = _impl->_receiveBuffer.filled();
-        auto peekSize = (std::min)(avail, BUFFER_PEEK_SIZE);
-        DEBUG_LOG(4, "decoding from " << avail << " buffered bytes");
-        _impl->_receiveBuffer.peek((char*)mp3, BUFFER_PEEK_SIZE);
+        uint8_t buffer[BUFFER_PEEK_SIZE];
+        const uint8_t* mp3 = buffer;
+        unsigned int peekSize;
+        if (mappedFile) {
+            mp3 = mappedFile->data() + _impl->_decodePosition;
+            peekSize = static_cast<unsigned int>((std::min)(mappedAvail, size_t(BUFFER_PEEK_SIZE)));
+        }
+        else {
+            auto avail = _impl->_receiveBuffer.filled();
+            peekSize = (std::min)(avail, BUFFER_PEEK_SIZE);
+            DEBUG_LOG(4, "decoding from " << avail << " buffered bytes");
+            _impl->_receiveBuffer.peek((char*)buffer, BUFFER_PEEK_SIZE);
+        }
+        // frames after skipped junk, like an ID3 tag at the stream start, are located from their size
+        bool atFrameHeader = peekSize >= 2 && mp3[0] == 0xff && (mp3[1] & 0xe0) == 0xe0;
+        auto frameOffset = _impl->_decodePosition;
+        _impl->_mp3info.hz = 0;
         int samples = mp3dec_decode_frame(&_impl->_mp3d, mp3, peekSize, pcm, &_impl->_mp3info);
-        DEBUG_LOG(4, "dropping " << _impl->_mp3info.frame_bytes << " decoded or skipped bytes from receive buffer");
-        _impl->_receiveBuffer.drop(_impl->_mp3info.frame_bytes);
+        if (!mappedFile) {
+            DEBUG_LOG(4, "dropping " << _impl->_mp3info.frame_bytes << " decoded or skipped bytes from receive buffer");
+            _impl->_receiveBuffer.drop(_impl->_mp3info.frame_bytes);
+        }
         _impl->_decodePosition += _impl->_mp3info.frame_bytes;
-        if (samples > 0 && _impl->_mp3info.frame_bytes > 0) {
-            _impl->_sampleBuffer.push(pcm, samples * _impl->_mp3info.channels);
+        if (_impl->_mp3info.hz > 0 && _impl->_mp3info.frame_bytes > 0) {
+            // a frame was consumed, right after a seek the bit reservoir may be missing and it decodes to nothing,
+            // play silence instead so the sample position stays exact
+            auto channels = _impl->_mp3info.channels;
+            if (samples <= 0) {
+                samples = _impl->_mp3info.hz < 32000 ? 576 : 1152;
+                std::fill(pcm, pcm + samples * channels, SampleType(0));
+            }
+            if (_impl->_decodeSampleExact) {
+                auto header = atFrameHeader ? 0 : SeekIndex::headerOffset(mp3, _impl->_mp3info.frame_bytes, _impl->_mp3info.layer, _impl->_mp3info.bitrate_kbps, _impl->_mp3info.hz);
+                if (header >= 0) {
+                    _impl->_seekIndex.record(frameOffset + header, _impl->_decodeSamplePosition);
+                }
+            }
+            _impl->_decodeSamplePosition += samples;
+            auto skip = static_cast<int>((std::min)(_impl->_skipSamples, int64_t(samples)));
+            _impl->_skipSamples -= skip;
+            _impl->_sampleBuffer.push(pcm + skip * channels, (samples - skip) * channels);
             DEBUG_LOG(4, "decoded " << _impl->_mp3info.frame_bytes << " bytes into " << samples << " samples (" << _impl->_mp3info.hz << "Hz)");
-            //--std::clog << "Decoded " << _impl->_mp3info.frame_bytes << " bytes into " << samples << " samples (" << _impl->_mp3info.hz << "Hz)" << std::endl;
-        }
-        else {
-            // std::clog << "No samples but " << _impl->_mp3info.frame_bytes << " frame bytes" << std::endl;
         }
     }
     // DEBUG_LOG(4, "decoded " << _impl->_decodePosition << "/" << _impl->_size << " bytes");
@@ -689,61 +956,29 @@ void Player::decodeFrame()
 
 void Player::playMusic(unsigned char* buffer, int frames)
 {
+    // runs on the audio thread, only copies already decoded samples, decoding happens in Player::decode()
     FrameMarkStart("playMusic");
-    auto requestedTime = frames * 1000 / _impl->_frameRate;
-    //--std::clog << "play " << frames << " (~" << requestedTime << "ms), sample buffer contains " << (_impl->_sampleBuffer.filled() / _impl->_numChannels) << std::endl;
     auto start = std::chrono::steady_clock::now();
     auto* dst = (SampleType*)buffer;
-    bool didDecode = false;
-    if (_impl->_state != eENDOFSTREAM && _impl->_state != eERROR) {
-        if (!_impl->_receiveBuffer.filled()) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(requestedTime / 2));
-            //--std::clog << "Buffer after sleep: " << _impl->_receiveBuffer.filled() << " bytes" << std::endl;
-        }
-        else {
-            //--std::clog << "Buffer filled with: " << _impl->_receiveBuffer.filled() << " bytes" << std::endl;
+    int samples = frames * _impl->_numChannels;
+    int len = 0;
+    if (_impl->_state != ePAUSED && _impl->_state != eENDOFSTREAM) {
+        len = _impl->_sampleBuffer.pull(dst, samples);
+        _impl->_playPosition += len / _impl->_numChannels;
+        int volume = _impl->_volume;
+        for (int i = 0; i < len; ++i) {
+            dst[i] = (SampleType)((((int)dst[i]) * volume) / 100);
         }
-        if (_impl->_sampleBuffer.filled() < (unsigned int)frames * _impl->_numChannels && _impl->_receiveBuffer.filled()) {
-            // unsigned int lastFill;
-            do {
-                // lastFill = _impl->_sampleBuffer.filled();
-                for(int i = 0; i < 3; ++i) decodeFrame();
-            } while (_impl->_sampleBuffer.filled() < (unsigned int)frames * _impl->_numChannels && _impl->_receiveBuffer.filled() &&
-                     std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() < requestedTime * 2 / 3);
+        if (len < samples && _impl->_state == eENDING) {
+            DEBUG_LOG(3, "Stream play ended.");
+            _impl->_state = eENDOFSTREAM;
         }
     }
-
-    int zeros = 0;
-    if (_impl->_state == ePAUSED || _impl->_state == eENDOFSTREAM) {
-        for (; frames; --frames) {
-            ++zeros;
-            *dst++ = 0;
-            if (_impl->_numChannels == 2)
-                *dst++ = 0;
-        }
-    }
-    else {
-        int len = _impl->_sampleBuffer.pull(dst, frames * _impl->_numChannels);
-        _impl->_playPosition += len / _impl->_numChannels;
-        auto* ptr = (SampleType*)buffer;
-        for (int i = 0; i < len; ++i, ++ptr) {
-            *ptr = (SampleType)((((int)*ptr) * _impl->_volume) / 100);
-        }
-        dst += len;
-        if (len < frames * _impl->_numChannels) {
-            if (_impl->_state == eENDING) {
-                DEBUG_LOG(3, "Stream play ended.");
-                _impl->_state = eENDOFSTREAM;
-            }
-            while (len++ < frames * _impl->_numChannels) {
-                ++zeros;
-                *dst++ = 0;
-            }
-        }
+    if (len < samples) {
+        std::memset(dst + len, 0, (samples - len) * sizeof(SampleType));
     }
+    _impl->recordCallbackDuration(std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count());
     FrameMarkEnd("playMusic");
-    //--auto dt = std::chrono::steady_clock::now() - start;
-    //--std::cout << "playMusic: " << std::chrono::duration_cast<std::chrono::microseconds>(dt).count() << "us, " << zeros << " frames silence" << std::endl;
 }
 
 std::string Player::getDynamicDefaultOutputName()
@@ -7,6 +7,7 @@
 
 #include "rldata.hpp"
 #include <ghc/uri.hpp>
+#include <array>
 #include <cstdint>
 #include <memory>
 
@@ -22,6 +23,13 @@ public:
         unsigned int channels;
         unsigned int sampleRate;
     };
+    struct CallbackHistogram {
+        enum { NumBuckets = 16 };
+        // bucket 0 counts callbacks below 1us, bucket i those in [2^(i-1), 2^i) us, the last one all longer ones
+        std::array<uint64_t, NumBuckets> _buckets{};
+        uint64_t _count = 0;
+        int64_t _maxMicroseconds = 0;
+    };
     using SampleType = int16_t;
     enum Mode { eNone, eFile, eReLiveStream, eMediaStream, eSCastStream };
     Player();
@@ -40,6 +48,12 @@ public:
     void volume(int vol);
     float receiveBufferQuote() const;
     float decodeBufferQuote() const;
+    int decodeAhead() const;
+    void decodeAhead(int milliseconds);
+    CallbackHistogram callbackHistogram() const;
+    void resetCallbackHistogram();
+    int64_t mediaCacheSize() const;
+    void mediaCacheSize(int64_t bytes);
     
     bool hasSource() const;
     void setSource(Mode mode, ghc::net::uri source, int64_t size = 0);
@@ -61,6 +75,7 @@ protected:
     void startAudio();
     void stopAudio();
     void abortAudio();
+    void decode();
     void decodeFrame();
     bool fillBuffer();
     void streamSCast();
@@ -0,0 +1,292 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "prefetcher.hpp"
+#include "logging.hpp"
+#include "system.hpp"
+
+#include <backend/httppool.hpp>
+#include <backend/netutility.hpp>
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace relive {
+
+using Clock = std::chrono::steady_clock;
+
+struct RangePrefetcher::impl
+{
+    ghc::net::uri _source;
+    int64_t _size;
+    Config _config;
+    mutable std::mutex _mutex;
+    std::condition_variable _workCond;
+    std::condition_variable _dataCond;
+    std::vector<std::thread> _workers;
+    bool _shutdown = false;
+    bool _started = false;
+    uint64_t _generation = 0;
+    int64_t _readOffset = 0;     // next byte handed out by read()
+    int64_t _requestOffset = 0;  // next byte not yet requested
+    std::map<int64_t, int64_t> _retries;
+    std::map<int64_t, std::string> _completed;
+    int64_t _bufferedBytes = 0;
+    int64_t _inFlightBytes = 0;
+    int _inFlight = 0;
+    int _failures = 0;
+    int _chunkSize;
+    int _concurrency;
+    double _throughput = 0;
+    // aggregate throughput of the current measurement window, used to tune concurrency
+    Clock::time_point _windowStart;
+    int64_t _windowBytes = 0;
+    int _windowRequests = 0;
+    bool _windowThrottled = false;
+    double _lastAggregate = 0;
+
+    impl(const ghc::net::uri& source, int64_t size, const Config& config)
+        : _source(source)
+        , _size(size)
+        , _config(config)
+        , _chunkSize((std::max)(config.minChunkSize, (std::min)(128 * 1024, config.maxChunkSize)))
+        , _concurrency((std::min)(2, config.maxConcurrency))
+        , _windowStart(Clock::now())
+    {
+    }
+
+    bool canIssue()
+    {
+        if (!_started || _inFlight >= _concurrency || (_retries.empty() && _requestOffset >= _size)) {
+            return false;
+        }
+        if (_bufferedBytes + _inFlightBytes >= _config.maxAhead) {
+            _windowThrottled = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool hasData() const
+    {
+        if (_completed.empty()) {
+            return false;
+        }
+        auto iter = _completed.begin();
+        return iter->first <= _readOffset && iter->first + int64_t(iter->second.size()) > _readOffset;
+    }
+
+    void restartWindow()
+    {
+        _windowStart = Clock::now();
+        _windowBytes = 0;
+        _windowRequests = 0;
+        _windowThrottled = false;
+    }
+
+    void adapt(size_t bytes, double seconds)
+    {
+        auto rate = bytes / (std::max)(seconds, 0.001);
+        _throughput = _throughput > 0 ? _throughput * 0.7 + rate * 0.3 : rate;
+        // aim for requests of roughly a quarter second so seeks stay snappy
+        auto chunk = static_cast<int>(_throughput / 4) / _config.minChunkSize * _config.minChunkSize;
+        _chunkSize = (std::max)(_config.minChunkSize, (std::min)(chunk, _config.maxChunkSize));
+        _windowBytes += bytes;
+        if (++_windowRequests >= _concurrency * 2) {
+            auto elapsed = std::chrono::duration<double>(Clock::now() - _windowStart).count();
+            auto aggregate = _windowBytes / (std::max)(elapsed, 0.001);
+            if (!_windowThrottled) {
+                if (aggregate > _lastAggregate * 1.1 && _concurrency < _config.maxConcurrency) {
+                    ++_concurrency;
+                }
+                else if (aggregate < _lastAggregate * 0.9 && _concurrency > 1) {
+                    --_concurrency;
+                }
+                _lastAggregate = aggregate;
+            }
+            DEBUG_LOG(3, "throughput " << int64_t(_throughput) << "B/s, aggregate " << int64_t(aggregate) << "B/s, chunk size " << _chunkSize << ", concurrency " << _concurrency);
+            restartWindow();
+        }
+    }
+};
+
+RangePrefetcher::RangePrefetcher(const ghc::net::uri& source, int64_t size)
+    : RangePrefetcher(source, size, Config())
+{
+}
+
+RangePrefetcher::RangePrefetcher(const ghc::net::uri& source, int64_t size, const Config& config)
+    : _impl(std::make_unique<impl>(source, size, config))
+{
+    for (int i = 0; i < config.maxConcurrency; ++i) {
+        _impl->_workers.emplace_back(&RangePrefetcher::worker, this);
+    }
+}
+
+RangePrefetcher::~RangePrefetcher()
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        _impl->_shutdown = true;
+    }
+    _impl->_workCond.notify_all();
+    _impl->_dataCond.notify_all();
+    for (auto& worker : _impl->_workers) {
+        worker.join();
+    }
+}
+
+void RangePrefetcher::start(int64_t offset)
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        ++_impl->_generation;
+        _impl->_started = true;
+        _impl->_readOffset = _impl->_requestOffset = offset;
+        _impl->_completed.clear();
+        _impl->_retries.clear();
+        _impl->_bufferedBytes = 0;
+        _impl->_failures = 0;
+        _impl->restartWindow();
+    }
+    _impl->_workCond.notify_all();
+}
+
+int64_t RangePrefetcher::position() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_readOffset;
+}
+
+bool RangePrefetcher::finished() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_started && _impl->_readOffset >= _impl->_size;
+}
+
+bool RangePrefetcher::waitForData(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock{_impl->_mutex};
+    return _impl->_dataCond.wait_for(lock, timeout, [this]() { return _impl->_shutdown || _impl->hasData(); }) && _impl->hasData();
+}
+
+size_t RangePrefetcher::read(char* dst, size_t maxBytes)
+{
+    size_t total = 0;
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        while (total < maxBytes && _impl->hasData()) {
+            auto iter = _impl->_completed.begin();
+            auto start = static_cast<size_t>(_impl->_readOffset - iter->first);
+            auto len = (std::min)(iter->second.size() - start, maxBytes - total);
+            std::memcpy(dst + total, iter->second.data() + start, len);
+            total += len;
+            _impl->_readOffset += len;
+            _impl->_bufferedBytes -= len;
+            if (start + len == iter->second.size()) {
+                _impl->_completed.erase(iter);
+            }
+        }
+    }
+    if (total) {
+        _impl->_workCond.notify_all();
+    }
+    return total;
+}
+
+int RangePrefetcher::chunkSize() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_chunkSize;
+}
+
+int RangePrefetcher::concurrency() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_concurrency;
+}
+
+double RangePrefetcher::throughput() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_throughput;
+}
+
+void RangePrefetcher::worker()
+{
+    httplib::Headers headers = {{"User-Agent", relive::userAgent()}};
+    std::unique_lock<std::mutex> lock{_impl->_mutex};
+    while (!_impl->_shutdown) {
+        _impl->_workCond.wait(lock, [this]() { return _impl->_shutdown || _impl->canIssue(); });
+        if (_impl->_shutdown) {
+            break;
+        }
+        int64_t offset, length;
+        if (!_impl->_retries.empty()) {
+            offset = _impl->_retries.begin()->first;
+            length = _impl->_retries.begin()->second;
+            _impl->_retries.erase(_impl->_retries.begin());
+        }
+        else {
+            offset = _impl->_requestOffset;
+            length = (std::min)(int64_t(_impl->_chunkSize), _impl->_size - offset);
+            _impl->_requestOffset += length;
+        }
+        auto generation = _impl->_generation;
+        ++_impl->_inFlight;
+        _impl->_inFlightBytes += length;
+        std::string path = _impl->_source.request_path() + "&start=" + std::to_string(offset) + "&length=" + std::to_string(length);
+        lock.unlock();
+        DEBUG_LOG(2, "Prefetching: " << path);
+        // leased per request, so idle workers don't hold connections the sync could use
+        auto client = HttpPool::instance().acquire(_impl->_source);
+        auto startTime = Clock::now();
+        auto res = client->Get(path.c_str(), headers);
+        if (!res) {
+            client.discard();
+        }
+        client.release();
+        auto seconds = std::chrono::duration<double>(Clock::now() - startTime).count();
+        lock.lock();
+        --_impl->_inFlight;
+        _impl->_inFlightBytes -= length;
+        if (generation != _impl->_generation) {
+            // a seek happened while this request was running
+            _impl->_workCond.notify_all();
+            continue;
+        }
+        if (res && res->status == 200 && !res->body.empty()) {
+            auto received = (std::min)(int64_t(res->body.size()), length);
+            res->body.resize(static_cast<size_t>(received));
+            if (received < length) {
+                _impl->_retries.emplace(offset + received, length - received);
+            }
+            _impl->_failures = 0;
+            _impl->_bufferedBytes += received;
+            _impl->_completed.emplace(offset, std::move(res->body));
+            _impl->adapt(static_cast<size_t>(received), seconds);
+            _impl->_dataCond.notify_all();
+        }
+        else {
+            if (res) {
+                ERROR_LOG(1, "Prefetch failed (" << res->status << ") for range " << offset << "+" << length);
+            }
+            else {
+                ERROR_LOG(1, "Prefetch failed for range " << offset << "+" << length);
+            }
+            _impl->_retries.emplace(offset, length);
+            auto backoff = std::chrono::milliseconds(100 << (std::min)(_impl->_failures++, 5));
+            _impl->_workCond.wait_for(lock, backoff, [this, generation]() { return _impl->_shutdown || generation != _impl->_generation; });
+        }
+        _impl->_workCond.notify_all();
+    }
+}
+
+}  // namespace relive
@@ -0,0 +1,55 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include <ghc/uri.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Keeps several reLive range requests (&start=&length=) in flight and hands out the
+// results strictly in stream order. Chunk size and the number of parallel requests
+// adapt to the measured throughput.
+//---------------------------------------------------------------------------------------
+class RangePrefetcher
+{
+public:
+    struct Config {
+        int minChunkSize = 32 * 1024;
+        int maxChunkSize = 1024 * 1024;
+        int maxConcurrency = 4;
+        int64_t maxAhead = 4 * 1024 * 1024;  // upper limit for fetched but not yet consumed bytes
+    };
+    RangePrefetcher(const ghc::net::uri& source, int64_t size);
+    RangePrefetcher(const ghc::net::uri& source, int64_t size, const Config& config);
+    ~RangePrefetcher();
+
+    // (re)start fetching at the given byte offset, results of older requests are dropped
+    void start(int64_t offset);
+    // offset of the next byte read() will return
+    int64_t position() const;
+    bool finished() const;
+
+    // wait until the next in-order data is available, returns false on timeout
+    bool waitForData(std::chrono::milliseconds timeout);
+    // copy up to maxBytes of in-order data into dst without blocking
+    size_t read(char* dst, size_t maxBytes);
+
+    int chunkSize() const;
+    int concurrency() const;
+    double throughput() const;  // bytes per second, moving average per request
+
+private:
+    void worker();
+    struct impl;
+    std::unique_ptr<impl> _impl;
+};
+
+}  // namespace relive
@@ -5,23 +5,28 @@
 //---------------------------------------------------------------------------------------
 #include "relivedb.hpp"
 #include <version/version.hpp>
+#include "hash.hpp"
+#include "httppool.hpp"
+#include "jsonrecords.hpp"
 #include "logging.hpp"
 #include "rldata.hpp"
 #include "system.hpp"
 #include "netutility.hpp"
 
 #include <sqlite_orm/sqlite_orm.h>
+#include <algorithm>
 #include <atomic>
 #include <chrono>
 #include <cstdlib>
 #include <ghc/uri.hpp>
 #include <iostream>
-#include <list>
+#include <map>
 #include <mutex>
 #include <nlohmann/json.hpp>
-#include <pearce/threadpool.hpp>
 #include <regex>
 #include <string>
+#include <tuple>
+#include <unordered_map>
 #include <utility>
 
 namespace http = httplib;
@@ -43,42 +48,435 @@ inline auto initStorage(const std::string& dbfile)
     return make_storage(dbfile, make_table("config_values", make_column("key", &KeyValue::key, primary_key()), make_column("value", &KeyValue::value)),
                         make_table("stations", make_column("id", &Station::_id, autoincrement(), primary_key()), make_column("relive_id", &Station::_reliveId), make_column("protocol", &Station::_protocol), make_column("name", &Station::_name),
                                    make_column("last_update", &Station::_lastUpdate), make_column("flags", &Station::_flags), make_column("meta_info", &Station::_metaInfo)),
-                        make_index("idx_stream_name", &Stream::_name), make_index("idx_stream_host", &Stream::_host),
+                        make_index("idx_stream_name", &Stream::_name), make_index("idx_stream_host", &Stream::_host), make_index("idx_stream_station", &Stream::_stationId, &Stream::_timestamp),
                         make_table("streams", make_column("id", &Stream::_id, autoincrement(), primary_key()), make_column("relive_id", &Stream::_reliveId), make_column("station_id", &Stream::_stationId), make_column("name", &Stream::_name),
                                    make_column("host", &Stream::_host), make_column("description", &Stream::_description), make_column("timestamp", &Stream::_timestamp), make_column("duration", &Stream::_duration), make_column("size", &Stream::_size),
                                    make_column("format", &Stream::_format), make_column("media_offset", &Stream::_mediaOffset), make_column("info_chk", &Stream::_streamInfoChecksum), make_column("chat_chk", &Stream::_chatChecksum),
                                    make_column("media_chk", &Stream::_mediaChecksum), make_column("last_update", &Stream::_lastUpdate), make_column("flags", &Stream::_flags), make_column("meta_info", &Stream::_metaInfo),
                                    foreign_key(&Stream::_stationId).references(&Station::_id).on_delete.cascade()),
+                        make_index("idx_url_owner", &Url::_ownerId, &Url::_type),
                         make_table("urls", make_column("id", &Url::_id, autoincrement(), primary_key()), make_column("owner_id", &Url::_ownerId), make_column("url", &Url::_url), make_column("last_update", &Url::_lastUpdate),
                                    make_column("type", &Url::_type), make_column("meta_info", &Url::_metaInfo)),
                         make_index("idx_track_name", &Track::_name), make_index("idx_tack_artist", &Track::_artist),
+                        make_index("idx_track_type", &Track::_type, &Track::_name, &Track::_artist, &Track::_streamId), make_index("idx_track_stream", &Track::_streamId, &Track::_time),
                         make_table("tracks", make_column("id", &Track::_id, autoincrement(), primary_key()), make_column("stream_id", &Track::_streamId), make_column("name", &Track::_name), make_column("artist", &Track::_artist),
                                    make_column("type", &Track::_type), make_column("time", &Track::_time), make_column("last_update", &Track::_lastUpdate), make_column("flags", &Track::_flags), make_column("meta_info", &Track::_metaInfo),
-                                   foreign_key(&Track::_streamId).references(&Stream::_id).on_delete.cascade()));
+                                   foreign_key(&Track::_streamId).references(&Stream::_id).on_delete.cascade()),
+                        make_table("sync_journal", make_column("id", &SyncJob::_id, autoincrement(), primary_key()), make_column("type", &SyncJob::_type), make_column("owner_id", &SyncJob::_ownerId),
+                                   make_column("relive_id", &SyncJob::_reliveId), make_column("url", &SyncJob::_url), make_column("status", &SyncJob::_status), make_column("attempts", &SyncJob::_attempts),
+                                   make_column("last_update", &SyncJob::_lastUpdate)));
 }
 
 using Storage = decltype(initStorage(""));
 
+static std::string databaseFile()
+{
+    return (fs::path(dataPath()) / "relive.sqlite").string();
+}
+
+static bool openConnection(Storage& storage, bool readOnly, sqlite3*& handle)
+{
+    storage.on_open = [readOnly, &handle](sqlite3* db) {
+        handle = db;
+        sqlite3_busy_timeout(db, 5000);
+        // 16MiB page cache and up to 256MiB memory mapped reads per connection
+        sqlite3_exec(db, "PRAGMA cache_size = -16384; PRAGMA mmap_size = 268435456; PRAGMA temp_store = MEMORY", nullptr, nullptr, nullptr);
+        if (readOnly) {
+            sqlite3_exec(db, "PRAGMA query_only = ON", nullptr, nullptr, nullptr);
+        }
+        else {
+            // WAL lets readers work without waiting for the writer, NORMAL is safe in WAL mode
+            sqlite3_exec(db, "PRAGMA journal_mode = WAL; PRAGMA synchronous = NORMAL", nullptr, nullptr, nullptr);
+        }
+    };
+    storage.open_forever();
+    return true;
+}
+
+// The only connection that writes, guarded by ReLiveDB::_mutex. Sync results are
+// applied by the single writer thread, the UI only does small config/flag updates.
+static sqlite3* g_writeHandle = nullptr;
 static Storage& storage()
 {
-    static Storage _storage = initStorage((fs::path(dataPath()) / "relive.sqlite").string());
+    static Storage _storage = initStorage(databaseFile());
+    static bool _isOpen = openConnection(_storage, false, g_writeHandle);
+    return _storage;
+}
+
+// Every reading thread gets its own query-only connection, with the database in WAL
+// mode readers work on the last committed state and never wait for the writer.
+thread_local static sqlite3* t_readHandle = nullptr;
+static Storage& readStorage()
+{
+    thread_local Storage _storage = initStorage(databaseFile());
+    thread_local bool _isOpen = openConnection(_storage, true, t_readHandle);
     return _storage;
 }
 
+static sqlite3* readHandle()
+{
+    readStorage();
+    return t_readHandle;
+}
+
+// Raw prepared statements of a connection by their SQL, kept until the connection closes
+class StatementCache
+{
+public:
+    explicit StatementCache(sqlite3* db)
+        : _db(db)
+    {
+    }
+    ~StatementCache()
+    {
+        for (auto& [sql, stmt] : _statements) {
+            sqlite3_finalize(stmt);
+        }
+    }
+    StatementCache(const StatementCache&) = delete;
+    StatementCache& operator=(const StatementCache&) = delete;
+
+    // take a statement out of the cache or prepare it, a nested use of the same SQL gets its own
+    sqlite3_stmt* acquire(const std::string& sql)
+    {
+        auto iter = _statements.find(sql);
+        if (iter != _statements.end()) {
+            auto stmt = iter->second;
+            _statements.erase(iter);
+            return stmt;
+        }
+        sqlite3_stmt* stmt = nullptr;
+        if (sqlite3_prepare_v3(_db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT, &stmt, nullptr) != SQLITE_OK) {
+            throw std::system_error(std::error_code(sqlite3_errcode(_db), get_sqlite_error_category()), sqlite3_errmsg(_db));
+        }
+        return stmt;
+    }
+    void release(const std::string& sql, sqlite3_stmt* stmt)
+    {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        if (!_statements.emplace(sql, stmt).second) {
+            sqlite3_finalize(stmt);
+        }
+    }
+
+private:
+    sqlite3* _db;
+    std::unordered_map<std::string, sqlite3_stmt*> _statements;
+};
+
+// Minimal wrapper for the raw queries sqlite_orm can't express (FTS5 MATCH and ranking)
+class Statement
+{
+public:
+    Statement(sqlite3* db, const char* sql)
+    {
+        if (sqlite3_prepare_v2(db, sql, -1, &_stmt, nullptr) != SQLITE_OK) {
+            throw std::system_error(std::error_code(sqlite3_errcode(db), get_sqlite_error_category()), sqlite3_errmsg(db));
+        }
+    }
+    Statement(StatementCache& cache, std::string sql)
+        : _cache(&cache)
+        , _sql(std::move(sql))
+        , _stmt(cache.acquire(_sql))
+    {
+    }
+    ~Statement()
+    {
+        if (_cache) {
+            _cache->release(_sql, _stmt);
+        }
+        else {
+            sqlite3_finalize(_stmt);
+        }
+    }
+    Statement(const Statement&) = delete;
+    Statement& operator=(const Statement&) = delete;
+    void bind(int index, int64_t value) { sqlite3_bind_int64(_stmt, index, value); }
+    void bind(int index, const std::string& value) { sqlite3_bind_text(_stmt, index, value.c_str(), static_cast<int>(value.size()), SQLITE_TRANSIENT); }
+    bool step() { return sqlite3_step(_stmt) == SQLITE_ROW; }
+    int64_t int64Column(int index) const { return sqlite3_column_int64(_stmt, index); }
+    std::string textColumn(int index) const
+    {
+        auto text = reinterpret_cast<const char*>(sqlite3_column_text(_stmt, index));
+        return text ? std::string(text, static_cast<size_t>(sqlite3_column_bytes(_stmt, index))) : std::string();
+    }
+
+private:
+    StatementCache* _cache = nullptr;
+    std::string _sql;
+    sqlite3_stmt* _stmt = nullptr;
+};
+
+// The frequent reads of the UI as statements prepared once per read connection
+static auto prepareConfigValue(Storage& storage) { return storage.prepare(get_pointer<KeyValue>(std::string())); }
+static auto prepareStation(Storage& storage) { return storage.prepare(get_pointer<Station>(int64_t(0))); }
+static auto prepareStream(Storage& storage) { return storage.prepare(get_pointer<Stream>(int64_t(0))); }
+static auto prepareTrack(Storage& storage) { return storage.prepare(get_pointer<Track>(int64_t(0))); }
+static auto prepareStreamsOfStation(Storage& storage) { return storage.prepare(get_all<Stream>(where(c(&Stream::_stationId) == int64_t(0)), order_by(&Stream::_timestamp).desc())); }
+static auto prepareTracksOfStream(Storage& storage) { return storage.prepare(get_all<Track>(where(c(&Track::_streamId) == int64_t(0)), order_by(&Track::_time))); }
+static auto prepareUrlsOfOwner(Storage& storage) { return storage.prepare(get_all<Url>(where(c(&Url::_ownerId) == int64_t(0)), order_by(&Url::_id))); }
+
+struct ReadStatements
+{
+    explicit ReadStatements(Storage& storage)
+        : _configValue(prepareConfigValue(storage))
+        , _station(prepareStation(storage))
+        , _stream(prepareStream(storage))
+        , _track(prepareTrack(storage))
+        , _streamsOfStation(prepareStreamsOfStation(storage))
+        , _tracksOfStream(prepareTracksOfStream(storage))
+        , _urlsOfOwner(prepareUrlsOfOwner(storage))
+        , _raw(t_readHandle)
+    {
+    }
+    decltype(prepareConfigValue(std::declval<Storage&>())) _configValue;
+    decltype(prepareStation(std::declval<Storage&>())) _station;
+    decltype(prepareStream(std::declval<Storage&>())) _stream;
+    decltype(prepareTrack(std::declval<Storage&>())) _track;
+    decltype(prepareStreamsOfStation(std::declval<Storage&>())) _streamsOfStation;
+    decltype(prepareTracksOfStream(std::declval<Storage&>())) _tracksOfStream;
+    decltype(prepareUrlsOfOwner(std::declval<Storage&>())) _urlsOfOwner;
+    StatementCache _raw;  // search queries
+};
+
+// created after the read connection of the thread, so destroyed before it gets closed
+static ReadStatements& readStatements()
+{
+    thread_local ReadStatements _statements(readStorage());
+    return _statements;
+}
+
+// run a prepared read statement and reset it, a statement left on a row would keep
+// its read transaction open and pin the connection to an outdated WAL snapshot
+template <typename PreparedStatement>
+static auto executeRead(PreparedStatement& statement)
+{
+    struct Reset
+    {
+        sqlite3_stmt* _stmt;
+        ~Reset() { sqlite3_reset(_stmt); }
+    } reset{statement.stmt};
+    return readStorage().execute(statement);
+}
+
+// FTS5 indices over track and stream names, as external content tables kept in sync
+// with their source tables by triggers, so every write path updates them.
+static const char* g_fullTextSchema[] = {
+    "CREATE VIRTUAL TABLE IF NOT EXISTS tracks_fts USING fts5(name, artist, content='tracks', content_rowid='id', tokenize='unicode61 remove_diacritics 2', prefix='2 3')",
+    "CREATE TRIGGER IF NOT EXISTS tracks_fts_ai AFTER INSERT ON tracks BEGIN INSERT INTO tracks_fts(rowid, name, artist) VALUES (new.id, new.name, new.artist); END",
+    "CREATE TRIGGER IF NOT EXISTS tracks_fts_ad AFTER DELETE ON tracks BEGIN INSERT INTO tracks_fts(tracks_fts, rowid, name, artist) VALUES ('delete', old.id, old.name, old.artist); END",
+    "CREATE TRIGGER IF NOT EXISTS tracks_fts_au AFTER UPDATE OF name, artist ON tracks WHEN old.name IS NOT new.name OR old.artist IS NOT new.artist BEGIN "
+    "INSERT INTO tracks_fts(tracks_fts, rowid, name, artist) VALUES ('delete', old.id, old.name, old.artist); INSERT INTO tracks_fts(rowid, name, artist) VALUES (new.id, new.name, new.artist); END",
+    "CREATE VIRTUAL TABLE IF NOT EXISTS streams_fts USING fts5(name, host, content='streams', content_rowid='id', tokenize='unicode61 remove_diacritics 2', prefix='2 3')",
+    "CREATE TRIGGER IF NOT EXISTS streams_fts_ai AFTER INSERT ON streams BEGIN INSERT INTO streams_fts(rowid, name, host) VALUES (new.id, new.name, new.host); END",
+    "CREATE TRIGGER IF NOT EXISTS streams_fts_ad AFTER DELETE ON streams BEGIN INSERT INTO streams_fts(streams_fts, rowid, name, host) VALUES ('delete', old.id, old.name, old.host); END",
+    "CREATE TRIGGER IF NOT EXISTS streams_fts_au AFTER UPDATE OF name, host ON streams WHEN old.name IS NOT new.name OR old.host IS NOT new.host BEGIN "
+    "INSERT INTO streams_fts(streams_fts, rowid, name, host) VALUES ('delete', old.id, old.name, old.host); INSERT INTO streams_fts(rowid, name, host) VALUES (new.id, new.name, new.host); END",
+};
+
+static std::atomic<bool> g_hasFullTextSearch{false};
+
+// bm25 ranking is costly for huge result sets of short prefixes, so only the newest
+// matches are ranked, at least this many or as many as the requested page needs
+static const int g_maxRankedMatches = 10000;
+
+// Create the search indices if missing, e.g. on first start or after sync_schema
+// recreated a table and dropped its triggers. Filling them is left to the writer, as
+// a rebuild takes long on big databases, so a pending one is marked in the config in
+// the same transaction and survives a shutdown before it ran. Returns true if the
+// indices still need a rebuild, until then searches use LIKE queries.
+static bool setupFullTextSearch(sqlite3* db)
+{
+    int existing = 0;
+    bool rebuildPending = false;
+    {
+        Statement query(db, "SELECT count(*) FROM sqlite_master WHERE name IN ('tracks_fts', 'tracks_fts_ai', 'tracks_fts_ad', 'tracks_fts_au', 'streams_fts', 'streams_fts_ai', 'streams_fts_ad', 'streams_fts_au')");
+        if (query.step()) {
+            existing = static_cast<int>(query.int64Column(0));
+        }
+    }
+    {
+        Statement query(db, "SELECT count(*) FROM config_values WHERE key = ?1");
+        query.bind(1, Keys::fts_rebuild);
+        rebuildPending = query.step() && query.int64Column(0) > 0;
+    }
+    const auto numSchemaObjects = static_cast<int>(sizeof(g_fullTextSchema) / sizeof(g_fullTextSchema[0]));
+    if (existing != numSchemaObjects) {
+        char* error = nullptr;
+        std::string sql = "BEGIN;";
+        for (auto statement : g_fullTextSchema) {
+            sql += std::string(statement) + ";";
+        }
+        sql += "REPLACE INTO config_values(key, value) VALUES ('" + Keys::fts_rebuild + "', '1'); COMMIT;";
+        if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error) != SQLITE_OK) {
+            ERROR_LOG3(ReLiveDB, 1, "Full-text search not available, falling back to LIKE queries: " << (error ? error : "unknown error"));
+            sqlite3_free(error);
+            sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+            return false;
+        }
+        rebuildPending = true;
+    }
+    g_hasFullTextSearch = !rebuildPending;
+    return rebuildPending;
+}
+
+// Fill the search indices from their tables, the triggers keep them in sync after that
+static void rebuildFullTextSearch(sqlite3* db)
+{
+    char* error = nullptr;
+    auto sql = "BEGIN; INSERT INTO tracks_fts(tracks_fts) VALUES ('rebuild'); INSERT INTO streams_fts(streams_fts) VALUES ('rebuild'); DELETE FROM config_values WHERE key = '" + Keys::fts_rebuild + "'; COMMIT;";
+    if (sqlite3_exec(db, sql.c_str(), nullptr, nullptr, &error) != SQLITE_OK) {
+        ERROR_LOG3(ReLiveDB, 1, "Couldn't build full-text search index, falling back to LIKE queries: " << (error ? error : "unknown error"));
+        sqlite3_free(error);
+        sqlite3_exec(db, "ROLLBACK", nullptr, nullptr, nullptr);
+        return;
+    }
+    DEBUG_LOG3(ReLiveDB, 1, "Built full-text search index");
+    g_hasFullTextSearch = true;
+}
+
+// Turn user input into an FTS5 query, every word is a quoted token prefix and all have to match
+static std::string fullTextQuery(const std::string& input)
+{
+    std::string result, word;
+    auto flush = [&]() {
+        if (!word.empty()) {
+            result += (result.empty() ? "\"" : " \"") + word + "\"*";
+            word.clear();
+        }
+    };
+    for (auto c : input) {
+        if (c == ' ' || c == '\t') {
+            flush();
+        }
+        else {
+            if (c == '"') {
+                word += '"';
+            }
+            word += c;
+        }
+    }
+    flush();
+    return result;
+}
+
+// Validators of the last applied response of an API url, kept as json in urls.meta_info
+struct HttpValidators
+{
+    std::string _etag;
+    std::string _lastModified;
+    std::string _bodyHash;
+};
+
+static HttpValidators validatorsFromMetaInfo(const std::string& metaInfo)
+{
+    HttpValidators validators;
+    if (!metaInfo.empty()) {
+        try {
+            auto meta = json::parse(metaInfo);
+            validators._etag = meta.value("etag", "");
+            validators._lastModified = meta.value("last_modified", "");
+            validators._bodyHash = meta.value("body_hash", "");
+        }
+        catch (const json::exception&) {
+            // ignore foreign or broken meta info
+        }
+    }
+    return validators;
+}
+
+static std::string bodyHash(const std::string& body)
+{
+    return std::to_string(relive::hash(body)) + "-" + std::to_string(relive::hash(body, 4711)) + "-" + std::to_string(body.size());
+}
+
+// GET on a pooled client, a client whose request failed isn't handed out again
+static std::shared_ptr<http::Response> pooledGet(const ghc::net::uri& server, const std::string& path, const http::Headers& headers)
+{
+    auto client = HttpPool::instance().acquire(server);
+    auto res = client->Get(path.c_str(), headers);
+    if (!res) {
+        client.discard();
+    }
+    return res;
+}
+
+// no response, rate limited or a server error, worth another try later
+static bool isTransientFailure(const std::shared_ptr<http::Response>& res)
+{
+    return !res || res->status == 429 || res->status >= 500;
+}
+
+// Journal helpers, only called by the writer. A job is journaled in the transaction
+// that creates the work and marked done in the one applying its result, so resuming
+// the pending jobs of an interrupted sync neither loses nor repeats any work.
+static const int g_maxSyncJobAttempts = 3;
+
+static int64_t journalSyncJob(SyncJob::Type type, int64_t ownerId, int64_t reliveId, const std::string& url)
+{
+    SyncJob job{-1, type, ownerId, reliveId, url, SyncJob::ePending, 1, getTime()};
+    return storage().insert(job);
+}
+
+static void finishSyncJob(int64_t journalId)
+{
+    storage().update_all(set(c(&SyncJob::_status) = int(SyncJob::eDone), c(&SyncJob::_lastUpdate) = getTime()), where(c(&SyncJob::_id) == journalId));
+}
+
+// GET with If-None-Match/If-Modified-Since from the stored validators. unchanged is set
+// if the server answered 304 or the body hash is the stored one, newMetaInfo gets the
+// validators to store once the response has been applied.
+static std::shared_ptr<http::Response> conditionalGet(const ghc::net::uri& server, const std::string& path, const std::string& metaInfo, bool incremental, bool& unchanged, std::string& newMetaInfo)
+{
+    auto validators = validatorsFromMetaInfo(metaInfo);
+    http::Headers headers = {{"User-Agent", relive::userAgent()}};
+    if (incremental) {
+        if (!validators._etag.empty()) {
+            headers.emplace("If-None-Match", validators._etag);
+        }
+        if (!validators._lastModified.empty()) {
+            headers.emplace("If-Modified-Since", validators._lastModified);
+        }
+    }
+    unchanged = false;
+    auto res = pooledGet(server, path, headers);
+    if (res && res->status == 304) {
+        unchanged = true;
+    }
+    else if (res && res->status == 200) {
+        HttpValidators newValidators{res->get_header_value("ETag"), res->get_header_value("Last-Modified"), bodyHash(res->body)};
+        unchanged = incremental && newValidators._bodyHash == validators._bodyHash;
+        newMetaInfo = json{{"etag", newValidators._etag}, {"last_modified", newValidators._lastModified}, {"body_hash", newValidators._bodyHash}}.dump();
+    }
+    return res;
+}
+
 ReLiveDB::ReLiveDB(std::function<void(int)> progressHandler, const ghc::net::uri& master)
-    : _worker(8)
-    , _progressHandler(progressHandler)
+    : _progressHandler(progressHandler)
     , _master(master)
     , _busy(false)
+    , _writer(1)
+    , _worker(8)
+    , _hostLimiter(_worker)
 {
     DEBUG_LOG(1, "Database location: " << (fs::path(dataPath()) / "relive.sqlite"));
     auto dbVersion = getConfigValue(Keys::version, 0);
     if (g_databaseVersion < dbVersion) {
         throw std::runtime_error("Database version is newer (" + std::to_string(dbVersion) + ") than this applications version (" + std::to_string(g_databaseVersion) + ")!");
     }
-    storage().sync_schema(true);
+    bool rebuildSearch = false;
+    {
+        std::lock_guard<Mutex> lock{_mutex};
+        storage().sync_schema(true);
+        rebuildSearch = setupFullTextSearch(g_writeHandle);
+    }
     setConfigValue(Keys::version, g_databaseVersion);
     _master = ghc::net::uri(getConfigValue(Keys::relive_root_server, _master.str()));
+    // last, as the rebuild holds the write lock until it is done
+    if (rebuildSearch) {
+        submitWrite([]() { rebuildFullTextSearch(g_writeHandle); });
+    }
 }
 
 ReLiveDB::~ReLiveDB() {}
@@ -95,9 +493,10 @@ void ReLiveDB::setConfigValueString(const std::string& key, const std::string& v
 std::string ReLiveDB::getConfigValueString(const std::string& key, const std::string& defaultValue)
 {
     using namespace sqlite_orm;
-    std::lock_guard<Mutex> lock{_mutex};
     try {
-        if (auto kv = storage().get_pointer<KeyValue>(key)) {
+        auto& statements = readStatements();
+        get<0>(statements._configValue) = key;
+        if (auto kv = executeRead(statements._configValue)) {
             return kv->value;
         }
         else {
@@ -109,45 +508,214 @@ std::string ReLiveDB::getConfigValueString(const std::string& key, const std::st
     }
 }
 
-void ReLiveDB::setPlayed(Stream& stream)
+void ReLiveDB::setPlayed(const Stream& stream)
 {
     if (!(stream._flags & Stream::ePlayed)) {
-        std::lock_guard<Mutex> lock{_mutex};
-        stream._flags |= Stream::ePlayed;
-        storage().update(stream);
+        {
+            std::lock_guard<Mutex> lock{_mutex};
+            storage().update_all(set(c(&Stream::_flags) = stream._flags | Stream::ePlayed), where(c(&Stream::_id) == stream._id));
+        }
+        std::shared_ptr<const Catalog> catalog;
+        {
+            // derived and swapped under one lock so a concurrently published sync result isn't lost
+            std::lock_guard<std::mutex> lock{_catalogMutex};
+            if (_catalog) {
+                if (auto cached = _catalog->stream(stream._id)) {
+                    auto played = std::make_shared<Stream>(*cached);
+                    played->_flags |= Stream::ePlayed;
+                    if ((catalog = _catalog->withStream(played, ++_catalogVersion))) {
+                        _catalog = catalog;
+                    }
+                }
+            }
+        }
+        if (catalog) {
+            notifyCatalogListeners(catalog);
+        }
+    }
+}
+
+std::shared_ptr<const Catalog> ReLiveDB::catalog()
+{
+    std::shared_ptr<const Catalog> loaded;
+    {
+        std::lock_guard<std::mutex> lock{_catalogMutex};
+        if (_catalog) {
+            return _catalog;
+        }
+        loaded = _catalog = loadCatalog();
+    }
+    // the first snapshot is new to the listeners as well, a frontend may have loaded it in the background
+    notifyCatalogListeners(loaded);
+    return loaded;
+}
+
+int ReLiveDB::subscribeCatalog(CatalogListener listener)
+{
+    std::lock_guard<std::mutex> lock{_catalogMutex};
+    _catalogListeners.emplace(_nextCatalogListener, std::move(listener));
+    return _nextCatalogListener++;
+}
+
+void ReLiveDB::unsubscribeCatalog(int subscription)
+{
+    std::lock_guard<std::mutex> lock{_catalogMutex};
+    _catalogListeners.erase(subscription);
+}
+
+std::shared_ptr<const Catalog> ReLiveDB::loadCatalog()
+{
+    // four table scans instead of a query per station and stream
+    auto start = std::chrono::steady_clock::now();
+    std::vector<Catalog::StationPtr> stations;
+    std::unordered_map<int64_t, std::shared_ptr<Station>> stationById;
+    for (auto& station : readStorage().get_all<Station>()) {
+        auto ptr = std::make_shared<Station>(std::move(station));
+        stationById.emplace(ptr->_id, ptr);
+        stations.push_back(ptr);
+    }
+    for (auto& url : readStorage().get_all<Url>(where(c(&Url::_ownerId) != 0), order_by(&Url::_id))) {
+        auto iter = stationById.find(url._ownerId);
+        if (iter == stationById.end()) {
+            continue;
+        }
+        auto& station = *iter->second;
+        switch (url._type) {
+            case Url::eWeb:
+                if (station._webSiteUrl.empty()) {
+                    station._webSiteUrl = url._url;
+                }
+                break;
+            case Url::eStationAPI:
+                station._api.push_back(url._url);
+                break;
+            case Url::eLiveStream:
+                station._liveStream.push_back(std::move(url));
+                break;
+            default:
+                break;
+        }
+    }
+    std::unordered_map<int64_t, std::shared_ptr<Stream>> streamById;
+    std::unordered_map<int64_t, std::shared_ptr<Catalog::StreamList>> streamsOfStation;
+    for (auto& stream : readStorage().get_all<Stream>(order_by(&Stream::_timestamp).desc())) {
+        auto iter = stationById.find(stream._stationId);
+        if (iter == stationById.end()) {
+            continue;
+        }
+        auto ptr = std::make_shared<Stream>(std::move(stream));
+        ptr->_station = iter->second;
+        streamById.emplace(ptr->_id, ptr);
+        auto& list = streamsOfStation[ptr->_stationId];
+        if (!list) {
+            list = std::make_shared<Catalog::StreamList>();
+        }
+        list->push_back(ptr);
+    }
+    size_t numTracks = 0;
+    std::shared_ptr<Stream> current, parent;
+    auto finishStream = [&]() {
+        if (current && !current->_tracks.empty()) {
+            auto& tracks = current->_tracks;
+            for (size_t i = 0; i + 1 < tracks.size(); ++i) {
+                tracks[i]._duration = tracks[i + 1]._time - tracks[i]._time;
+            }
+            tracks.back()._duration = current->_duration - tracks.back()._time;
+        }
+    };
+    for (auto& track : readStorage().get_all<Track>(multi_order_by(order_by(&Track::_streamId), order_by(&Track::_time)))) {
+        if (!current || current->_id != track._streamId) {
+            finishStream();
+            auto iter = streamById.find(track._streamId);
+            current = iter != streamById.end() ? iter->second : nullptr;
+            // the tracks link to a copy without tracks, a link to current would be a cycle
+            parent = current ? std::make_shared<Stream>(*current) : nullptr;
+        }
+        if (current) {
+            track._stream = parent;
+            current->_tracks.push_back(std::move(track));
+            ++numTracks;
+        }
+    }
+    finishStream();
+    std::unordered_map<int64_t, Catalog::StreamListPtr> lists;
+    for (auto& [stationId, list] : streamsOfStation) {
+        lists.emplace(stationId, std::move(list));
+    }
+    auto catalog = std::make_shared<Catalog>(++_catalogVersion, std::move(stations), std::move(lists));
+    DEBUG_LOG(1, "Loaded catalog with " << catalog->stations().size() << " stations, " << streamById.size() << " streams and " << numTracks << " tracks in " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - start).count() << "ms");
+    return catalog;
+}
+
+void ReLiveDB::publishCatalog(std::shared_ptr<const Catalog> catalog)
+{
+    {
+        std::lock_guard<std::mutex> lock{_catalogMutex};
+        _catalog = catalog;
+    }
+    notifyCatalogListeners(catalog);
+}
+
+void ReLiveDB::notifyCatalogListeners(std::shared_ptr<const Catalog> catalog)
+{
+    // called without holding the lock, a listener may well ask for the catalog
+    std::vector<CatalogListener> listeners;
+    {
+        std::lock_guard<std::mutex> lock{_catalogMutex};
+        for (const auto& [id, listener] : _catalogListeners) {
+            listeners.push_back(listener);
+        }
+    }
+    for (const auto& listener : listeners) {
+        listener(catalog);
     }
 }
 
 std::vector<Station> ReLiveDB::fetchStations()
 {
-    std::lock_guard<Mutex> lock{_mutex};
-    return storage().get_all<Station>();
+    return readStorage().get_all<Station>();
 }
 
 void ReLiveDB::deepFetch(Station& station, bool withoutStreams)
 {
-    std::lock_guard<Mutex> lock{_mutex};
+    auto& statements = readStatements();
     if (!withoutStreams) {
-        station._streams = storage().get_all<Stream>(where(c(&Stream::_stationId) == station._id), order_by(&Stream::_timestamp).desc());
-    }
-    auto webSites = storage().get_all<Url>(where(c(&Url::_ownerId) == station._id and c(&Url::_type) == int(Url::eWeb)));
-    if (!webSites.empty()) {
-        station._webSiteUrl = webSites.front()._url;
+        get<0>(statements._streamsOfStation) = station._id;
+        station._streams = executeRead(statements._streamsOfStation);
     }
+    // one query for all urls of the station, split by type
+    get<0>(statements._urlsOfOwner) = station._id;
+    auto urls = executeRead(statements._urlsOfOwner);
+    bool hasWebSite = false;
     station._api.clear();
-    auto apis = storage().get_all<Url>(where(c(&Url::_ownerId) == station._id and c(&Url::_type) == int(Url::eStationAPI)));
-    for (const auto& api : apis) {
-        station._api.push_back(api._url);
+    station._liveStream.clear();
+    for (auto& url : urls) {
+        switch (url._type) {
+            case Url::eWeb:
+                if (!hasWebSite) {
+                    station._webSiteUrl = url._url;
+                    hasWebSite = true;
+                }
+                break;
+            case Url::eStationAPI:
+                station._api.push_back(url._url);
+                break;
+            case Url::eLiveStream:
+                station._liveStream.push_back(std::move(url));
+                break;
+            default:
+                break;
+        }
     }
-    station._liveStream = storage().get_all<Url>(where(c(&Url::_ownerId) == station._id and c(&Url::_type) == int(Url::eLiveStream)));
 }
 
 void ReLiveDB::deepFetch(Stream& stream, bool parentsOnly)
 {
     if(!stream._isLiveStream) {
-        std::lock_guard<Mutex> lock{_mutex};
         if (!parentsOnly) {
-            stream._tracks = storage().get_all<Track>(where(c(&Track::_streamId) == stream._id), order_by(&Track::_time));
+            auto& statements = readStatements();
+            get<0>(statements._tracksOfStream) = stream._id;
+            stream._tracks = executeRead(statements._tracksOfStream);
             if (!stream._tracks.empty()) {
                 for (int i = 0; i < stream._tracks.size() - 1; ++i) {
                     stream._tracks[i]._duration = stream._tracks[i + 1]._time - stream._tracks[i]._time;
@@ -155,7 +723,9 @@ void ReLiveDB::deepFetch(Stream& stream, bool parentsOnly)
                 stream._tracks[stream._tracks.size() - 1]._duration = stream._duration - stream._tracks[stream._tracks.size() - 1]._time;
             }
         }
-        auto station = storage().get_pointer<Station>(stream._stationId);
+        auto& statements = readStatements();
+        get<0>(statements._station) = stream._stationId;
+        auto station = executeRead(statements._station);
         if (station) {
             stream._station = std::make_shared<Station>(*station);
         }
@@ -171,13 +741,12 @@ void ReLiveDB::deepFetch(Stream& stream, bool parentsOnly)
 void ReLiveDB::deepFetch(Track& track)
 {
     if(!track._isLiveStream) {
-        {
-            std::lock_guard<Mutex> lock{_mutex};
-            track._stream.reset();
-            auto stream = storage().get_pointer<Stream>(track._streamId);
-            if (stream) {
-                track._stream = std::make_shared<Stream>(*stream);
-            }
+        track._stream.reset();
+        auto& statements = readStatements();
+        get<0>(statements._stream) = track._streamId;
+        auto stream = executeRead(statements._stream);
+        if (stream) {
+            track._stream = std::make_shared<Stream>(*stream);
         }
         if (track._stream) {
             deepFetch(*track._stream, true);
@@ -187,47 +756,202 @@ void ReLiveDB::deepFetch(Track& track)
 
 std::vector<Station> ReLiveDB::findStations(const std::string& pattern)
 {
-    std::lock_guard<Mutex> lock{_mutex};
-    return storage().get_all<Station>(where(like(&Station::_name, pattern)));
+    return readStorage().get_all<Station>(where(like(&Station::_name, pattern)));
 }
 
 std::vector<Stream> ReLiveDB::findStreams(const std::string& pattern)
 {
-    std::lock_guard<Mutex> lock{_mutex};
-    return storage().get_all<Stream>(where(like(&Stream::_name, pattern) or like(&Stream::_host, pattern)), order_by(&Stream::_timestamp).desc());
+    return readStorage().get_all<Stream>(where(like(&Stream::_name, pattern) or like(&Stream::_host, pattern)), order_by(&Stream::_timestamp).desc());
 }
 
 std::vector<Track> ReLiveDB::findTracks(const std::string& pattern)
 {
-    std::lock_guard<Mutex> lock{_mutex};
-    return storage().get_all<Track>(inner_join<Stream>(on(c(&Stream::_id) == &Track::_streamId)), where(like(&Track::_name, pattern) or like(&Track::_artist, pattern)), order_by(&Stream::_timestamp).desc());
+    return readStorage().get_all<Track>(inner_join<Stream>(on(c(&Stream::_id) == &Track::_streamId)), where(like(&Track::_name, pattern) or like(&Track::_artist, pattern)), order_by(&Stream::_timestamp).desc());
 }
 
 std::vector<ReLiveDB::FindTracksInfo> ReLiveDB::findTracksInfo(const std::string& pattern, FindTracksFilter filter)
 {
-    std::lock_guard<Mutex> lock{_mutex};
+    FindTracksCursor cursor(pattern, filter);
+    return findTracksInfo(cursor, SIZE_MAX);
+}
+
+// the track types a filter selects, -1 for all
+static std::pair<int64_t, int64_t> filterTypes(ReLiveDB::FindTracksFilter filter)
+{
+    switch (filter) {
+        case ReLiveDB::eTracks: return {Track::eMusic, Track::eMusic};
+        case ReLiveDB::eJingle: return {Track::eJingle, Track::eJingle};
+        case ReLiveDB::eNarration: return {Track::eConversation, Track::eNarration};
+        default: return {-1, -1};
+    }
+}
+
+std::vector<ReLiveDB::FindTracksInfo> ReLiveDB::findTracksInfo(FindTracksCursor& cursor, size_t maxResults)
+{
     std::vector<FindTracksInfo> result;
-    auto select = storage().select(columns(&Track::_id, &Stream::_name, &Track::_artist, &Track::_name, &Stream::_timestamp, &Track::_type), inner_join<Stream>(on(c(&Stream::_id) == &Track::_streamId)),
-                                   where(like(&Track::_name, pattern) or like(&Track::_artist, pattern)), order_by(&Stream::_timestamp).desc());
-    result.reserve(select.size());
-    for (auto& t : select) {
-        auto type = static_cast<Track::Type>(std::get<5>(t));
-        if (filter == eNone || (filter == eTracks && type == Track::eMusic) || (filter == eJingle && type == Track::eJingle) || (filter == eNarration && (type == Track::eConversation || type == Track::eNarration))) {
-            result.push_back({std::get<0>(t), std::get<1>(t), std::get<2>(t), std::get<3>(t), std::get<4>(t)});
+    if (!cursor._more || !maxResults) {
+        return result;
+    }
+    // the type filter is only added if needed so it can use the covering idx_track_type,
+    // one row more than requested tells if there are further results
+    auto types = filterTypes(cursor._filter);
+    bool limited = maxResults < size_t(INT64_MAX);
+    std::string sql = "SELECT tracks.id, streams.name, tracks.artist, tracks.name, streams.timestamp FROM tracks JOIN streams ON streams.id = tracks.stream_id WHERE ";
+    if (types.first >= 0) {
+        sql += "tracks.type IN (?2, ?3) AND ";
+    }
+    sql += "(tracks.name LIKE ?1 OR tracks.artist LIKE ?1) AND (streams.timestamp < ?4 OR (streams.timestamp = ?4 AND tracks.id < ?5)) ORDER BY streams.timestamp DESC, tracks.id DESC";
+    if (limited) {
+        // not LIMIT -1 for unlimited queries, sqlite then sorts several times slower
+        sql += " LIMIT ?6";
+    }
+    Statement select(readStatements()._raw, sql);
+    select.bind(1, cursor._pattern);
+    if (types.first >= 0) {
+        select.bind(2, types.first);
+        select.bind(3, types.second);
+    }
+    select.bind(4, cursor._timestamp);
+    select.bind(5, cursor._trackId);
+    if (limited) {
+        select.bind(6, int64_t(maxResults) + 1);
+    }
+    cursor._more = false;
+    while (select.step()) {
+        if (result.size() == maxResults) {
+            cursor._more = true;
+            break;
         }
+        result.push_back({select.int64Column(0), select.textColumn(1), select.textColumn(2), select.textColumn(3), select.int64Column(4)});
+    }
+    if (!result.empty()) {
+        cursor._timestamp = result.back()._timestamp;
+        cursor._trackId = result.back()._trackId;
     }
     return result;
 }
 
+bool ReLiveDB::hasFullTextSearch() const
+{
+    return g_hasFullTextSearch;
+}
+
+std::vector<Stream> ReLiveDB::searchStreams(const std::string& query, int limit, int offset)
+{
+    auto match = fullTextQuery(query);
+    if (match.empty()) {
+        return {};
+    }
+    if (!g_hasFullTextSearch) {
+        auto result = findStreams("%" + query + "%");
+        result.erase(result.begin(), result.begin() + (std::min)(result.size(), size_t(offset)));
+        result.resize((std::min)(result.size(), size_t(limit)));
+        return result;
+    }
+    auto& statements = readStatements();
+    Statement select(statements._raw,
+                     "SELECT f.rowid FROM (SELECT rowid, rank FROM streams_fts WHERE streams_fts MATCH ?1 ORDER BY rowid DESC LIMIT ?4) AS f JOIN streams ON streams.id = f.rowid "
+                     "ORDER BY f.rank, streams.timestamp DESC LIMIT ?2 OFFSET ?3");
+    select.bind(1, match);
+    select.bind(2, limit);
+    select.bind(3, offset);
+    select.bind(4, (std::max)(g_maxRankedMatches, offset + limit));
+    std::vector<Stream> result;
+    while (select.step()) {
+        get<0>(statements._stream) = select.int64Column(0);
+        if (auto stream = executeRead(statements._stream)) {
+            result.push_back(std::move(*stream));
+        }
+    }
+    return result;
+}
+
+std::vector<ReLiveDB::FindTracksInfo> ReLiveDB::searchTracks(const std::string& query, FindTracksFilter filter, int limit, int offset)
+{
+    auto match = fullTextQuery(query);
+    if (match.empty()) {
+        return {};
+    }
+    if (!g_hasFullTextSearch) {
+        FindTracksCursor cursor("%" + query + "%", filter);
+        auto result = findTracksInfo(cursor, size_t(offset + limit));
+        result.erase(result.begin(), result.begin() + (std::min)(result.size(), size_t(offset)));
+        return result;
+    }
+    auto types = filterTypes(filter);
+    Statement select(readStatements()._raw,
+                     "SELECT tracks.id, streams.name, tracks.artist, tracks.name, streams.timestamp FROM (SELECT rowid, rank FROM tracks_fts WHERE tracks_fts MATCH ?1 ORDER BY rowid DESC LIMIT ?6) AS f "
+                     "JOIN tracks ON tracks.id = f.rowid JOIN streams ON streams.id = tracks.stream_id WHERE ?2 < 0 OR tracks.type IN (?2, ?3) ORDER BY f.rank, streams.timestamp DESC LIMIT ?4 OFFSET ?5");
+    select.bind(1, match);
+    select.bind(2, types.first);
+    select.bind(3, types.second);
+    select.bind(4, limit);
+    select.bind(5, offset);
+    select.bind(6, (std::max)(g_maxRankedMatches, offset + limit));
+    std::vector<FindTracksInfo> result;
+    while (select.step()) {
+        result.push_back({select.int64Column(0), select.textColumn(1), select.textColumn(2), select.textColumn(3), select.int64Column(4)});
+    }
+    return result;
+}
+
+thread_local static std::function<bool()> t_abortCheck;
+
+static int abortCheckHandler(void*)
+{
+    return t_abortCheck() ? 1 : 0;
+}
+
+void ReLiveDB::abortQueriesWhen(std::function<bool()> check)
+{
+    t_abortCheck = std::move(check);
+    // the handler runs every 1000 virtual machine instructions of the read connection
+    sqlite3_progress_handler(readHandle(), t_abortCheck ? 1000 : 0, t_abortCheck ? abortCheckHandler : nullptr, nullptr);
+}
+
 std::unique_ptr<Track> ReLiveDB::fetchTrack(int64_t trackId)
 {
-    std::lock_guard<Mutex> lock{_mutex};
-    return storage().get_pointer<Track>(trackId);
+    auto& statements = readStatements();
+    get<0>(statements._track) = trackId;
+    return executeRead(statements._track);
+}
+
+static ChatMessage::MessageType chatMessageType(const std::string& type)
+{
+    static const std::unordered_map<std::string, ChatMessage::MessageType> types = {
+        {"Message", ChatMessage::eMessage}, {"Me", ChatMessage::eMe},       {"Join", ChatMessage::eJoin},   {"Leave", ChatMessage::eLeave}, {"Quit", ChatMessage::eQuit},
+        {"Nick", ChatMessage::eNick},       {"Topic", ChatMessage::eTopic}, {"Mode", ChatMessage::eMode},   {"Kick", ChatMessage::eKick}};
+    auto iter = types.find(type);
+    return iter != types.end() ? iter->second : ChatMessage::eUnknown;
+}
+
+static fs::path chatCacheFile(const Stream& stream)
+{
+    return fs::path(dataPath()) / "chatcache" / (std::to_string(stream._stationId) + "_" + std::to_string(stream._reliveId) + "_" + std::to_string(stream._chatChecksum) + ".chat");
 }
 
-std::vector<ChatMessage> ReLiveDB::fetchChat(const Stream& stream)
+// drop cached chats of the stream that were stored for a different chat checksum
+static void removeStaleChats(const fs::path& cacheFile, const Stream& stream)
 {
-    std::vector<ChatMessage> chat;
+    auto prefix = std::to_string(stream._stationId) + "_" + std::to_string(stream._reliveId) + "_";
+    std::error_code ec;
+    for (const auto& entry : fs::directory_iterator(cacheFile.parent_path(), ec)) {
+        auto filename = entry.path().filename().string();
+        if (filename.compare(0, prefix.size(), prefix) == 0 && entry.path() != cacheFile) {
+            DEBUG_LOG3(ReLiveDB, 2, "Removing outdated chat cache " << filename);
+            fs::remove(entry.path(), ec);
+        }
+    }
+}
+
+ChatLog ReLiveDB::fetchChat(const Stream& stream)
+{
+    ChatLog chat;
+    // a chat changes only together with its checksum, so a cached one is used as is
+    auto cacheFile = chatCacheFile(stream);
+    if (stream._chatChecksum && chat.load(cacheFile.string())) {
+        return chat;
+    }
     Stream tstream = stream;
     deepFetch(tstream, true);
     auto station = tstream._station;
@@ -235,50 +959,23 @@ std::vector<ChatMessage> ReLiveDB::fetchChat(const Stream& stream)
         auto uri = ghc::net::uri(station->_api[0]);
         DEBUG_LOG(2, uri.request_path() << "/getstreamchat?v=11&streamid=" << stream._reliveId);
         http::Headers headers = {{"User-Agent", relive::userAgent()}};
-        auto res = createClient(uri)->Get((uri.request_path() + "/getstreamchat?v=11&streamid=" + std::to_string(stream._reliveId)).c_str());
+        auto res = pooledGet(uri, uri.request_path() + "/getstreamchat?v=11&streamid=" + std::to_string(stream._reliveId), headers);
         if (res && res->status == 200) {
             try {
-                auto result = json::parse(res->body);
-                chat.reserve(result.at("messages").size());
-                for (const auto& message : result.at("messages")) {
-                    ChatMessage msg;
-                    msg._time = message.at("time").get<int64_t>();
-                    auto type = message.at("messageType").get<std::string>();
-                    if (type == "Message") {
-                        msg._type = ChatMessage::eMessage;
-                    }
-                    else if (type == "Me") {
-                        msg._type = ChatMessage::eMe;
-                    }
-                    else if (type == "Join") {
-                        msg._type = ChatMessage::eJoin;
-                    }
-                    else if (type == "Leave") {
-                        msg._type = ChatMessage::eLeave;
-                    }
-                    else if (type == "Quit") {
-                        msg._type = ChatMessage::eQuit;
-                    }
-                    else if (type == "Nick") {
-                        msg._type = ChatMessage::eNick;
-                    }
-                    else if (type == "Topic") {
-                        msg._type = ChatMessage::eTopic;
-                    }
-                    else if (type == "Mode") {
-                        msg._type = ChatMessage::eMode;
-                    }
-                    else if (type == "Kick") {
-                        msg._type = ChatMessage::eKick;
-                    }
-                    else {
-                        msg._type = ChatMessage::eUnknown;
-                    }
-                    msg._strings.reserve(message.at("strings").size());
+                ChatLog::Builder builder;
+                std::vector<std::string> strings;
+                JsonRecordReader reader("messages", [&](const json& message) {
+                    strings.clear();
                     for (const auto& str : message.at("strings")) {
-                        msg._strings.push_back(str);
+                        strings.push_back(str);
                     }
-                    chat.push_back(msg);
+                    builder.add(message.at("time").get<int>(), chatMessageType(message.at("messageType").get<std::string>()), strings);
+                });
+                if (reader.parse(res->body)) {
+                    chat = builder.build();
+                }
+                else {
+                    ERROR_LOG(0, "JSON error: " << reader.error());
                 }
             }
             catch (const json::exception& ex) {
@@ -286,249 +983,449 @@ std::vector<ChatMessage> ReLiveDB::fetchChat(const Stream& stream)
             }
         }
     }
+    if (stream._chatChecksum && !chat.empty()) {
+        std::error_code ec;
+        fs::create_directories(cacheFile.parent_path(), ec);
+        removeStaleChats(cacheFile, stream);
+        chat.save(cacheFile.string());
+    }
     return chat;
 }
 
-void ReLiveDB::refreshStations(std::function<void()> yield, bool force)
+void ReLiveDB::refreshStations(std::function<void()> yield, bool force, SyncMode mode)
 {
     using namespace std::chrono_literals;
-    if (_busy) {
+    if (_busy || _syncCancelled) {
         return;
     }
     _busy = true;
     std::shared_ptr<void> doneGuard(nullptr, [&](void*) { _busy = false; });
     auto lastFetch = getConfigValue(Keys::last_relive_sync, INT64_C(0));
     auto now = currentTime();
-    if (!force && now - lastFetch < 7200) {
+    auto pendingJobs = readStorage().count<SyncJob>(where(c(&SyncJob::_status) == int(SyncJob::ePending)));
+    if (!pendingJobs && !force && now - lastFetch < 7200) {
         DEBUG_LOG(2, "skipped refreshStations because last fetch was " << formattedDuration(now - lastFetch) << " ago");
         return;
     }
     DEBUG_LOG(1, "refreshStations start...");
-    {
-        std::lock_guard<Mutex> lock{_mutex};
-        _jobs.emplace_back(_worker.submit([this]() { doRefreshStations(); }));
-    }
-    int maxJobs = 0;
-    while (true) {
+    auto syncStart = std::chrono::steady_clock::now();
+    int64_t tracksBefore = _numOfTracks;
+    auto httpBefore = HttpPool::instance().stats();
+    _syncMode = mode;
+    _numOfUnchanged = 0;
+    _numOfTrackInserts = 0;
+    _numOfTrackUpdates = 0;
+    // progress is reported as jobs complete, jobs only ever add new ones before they complete
+    _syncJobs = std::make_shared<TaskScheduler::Counter>([this, lastPercent = -1](size_t completed, size_t submitted) mutable {
+        auto percent = static_cast<int>(completed * 100 / submitted);
+        if (percent != lastPercent && _progressHandler) {
+            _progressHandler(percent);
+        }
+        lastPercent = percent;
+    });
+    auto waitForJobs = [&]() {
         if (yield) {
-            yield();
+            while (!_syncJobs->waitFor(10ms)) {
+                yield();
+            }
         }
         else {
-            std::this_thread::sleep_for(500ms);
+            _syncJobs->wait();
         }
-        {
-            std::lock_guard<Mutex> lock{_mutex};
-            if (_jobs.size() > maxJobs) {
-                maxJobs = _jobs.size();
-            }
-            if (maxJobs && _progressHandler) {
-                _progressHandler((maxJobs - _jobs.size()) * 100 / maxJobs);
-            }
-            for (auto iter = _jobs.begin(); iter != _jobs.end();) {
-                if (iter->isReady()) {
-                    iter = _jobs.erase(iter);
-                }
-                else {
-                    ++iter;
-                }
-            }
-            DEBUG_LOG(3, "jobs: " << _jobs.size() << ", tracks: " << _numOfTracks);
-            if (_jobs.empty() && !_worker.workLeft()) {
-                break;
-            }
+    };
+    bool crawl = true;
+    if (pendingJobs) {
+        // an interrupted sync is finished by its pending jobs, a new crawl is only due if it is old
+        auto started = getConfigValue(Keys::sync_started, INT64_C(0));
+        auto resumed = resumeSyncJournal();
+        DEBUG_LOG(1, "Resuming " << resumed << " pending jobs of the sync started " << formattedDuration(now - started) << " ago");
+        waitForJobs();
+        crawl = !_syncCancelled && (force || now - started >= 7200);
+        if (!crawl) {
+            now = started;
         }
     }
+    if (crawl) {
+        setConfigValue(Keys::sync_started, now);
+        _hostLimiter.submit(_master, [this]() { return doRefreshStations(); }, TaskScheduler::eHigh, _syncJobs);
+        waitForJobs();
+    }
+    auto numJobs = _syncJobs->completed();
+    _syncJobs.reset();
+    if (_syncCancelled) {
+        // neither done nor new data to load, the journal has the rest
+        DEBUG_LOG(1, "refreshStations cancelled after " << numJobs << " jobs");
+        return;
+    }
     setConfigValue(Keys::last_relive_sync, now);
+    {
+        // jobs given up on stay pending and are resumed by the next sync
+        std::lock_guard<Mutex> lock{_mutex};
+        storage().remove_all<SyncJob>(where(c(&SyncJob::_status) == int(SyncJob::eDone)));
+    }
+    // loaded outside the catalog lock, readers keep using the old snapshot meanwhile
+    publishCatalog(loadCatalog());
     if (_progressHandler) {
         _progressHandler(0);
     }
     DEBUG_LOG(1, "Found " << _numOfTracks << " tracks");
+    auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - syncStart).count();
+    auto rows = _numOfTracks - tracksBefore;
+    DEBUG_LOG(1, "Synced " << rows << " track rows (" << _numOfTrackInserts << " inserted, " << _numOfTrackUpdates << " updated) in " << seconds << "s, " << int64_t(rows / (std::max)(seconds, 0.001)) << " rows/s, " << _numOfUnchanged << " unchanged api responses, " << numJobs << " jobs");
+    auto httpStats = HttpPool::instance().stats();
+    DEBUG_LOG(1, "HTTP clients: " << (httpStats._created - httpBefore._created) << " created, " << (httpStats._reused - httpBefore._reused) << " reused, " << (httpStats._waits - httpBefore._waits) << " waits for the host limit");
+    for (const auto& [host, stats] : _hostLimiter.stats()) {
+        DEBUG_LOG(2, host << ": " << stats._jobs << " jobs, " << stats._retries << " retries, " << stats._failures << " failures, " << stats._latencyMs << "ms latency, concurrency " << stats._concurrency);
+    }
     DEBUG_LOG(1, "refreshStations done");
 }
 
-void ReLiveDB::doRefreshStations()
+void ReLiveDB::cancelSync()
 {
-    http::Headers headers = {{"User-Agent", relive::userAgent()}};
-    auto res = createClient(_master)->Get("/getstations/?v=11");
+    _syncCancelled = true;
+    _hostLimiter.cancel();
+}
+
+size_t ReLiveDB::resumeSyncJournal()
+{
+    std::vector<SyncJob> jobs;
+    {
+        std::lock_guard<Mutex> lock{_mutex};
+        storage().begin_transaction();
+        for (auto& job : storage().get_all<SyncJob>(where(c(&SyncJob::_status) == int(SyncJob::ePending)))) {
+            if (job._attempts >= g_maxSyncJobAttempts) {
+                ERROR_LOG(0, "Dropping sync job " << job._id << " for " << job._url << " after " << job._attempts << " attempts");
+                storage().remove<SyncJob>(job._id);
+                continue;
+            }
+            ++job._attempts;
+            job._lastUpdate = getTime();
+            storage().update(job);
+            jobs.push_back(job);
+        }
+        storage().commit();
+    }
+    for (const auto& job : jobs) {
+        if (job._type == SyncJob::eStationInfo) {
+            refreshStationInfo(ghc::net::uri(job._url), job._ownerId, job._id);
+        }
+        else {
+            refreshStreamInfo(ghc::net::uri(job._url), job._reliveId, job._ownerId, job._id);
+        }
+    }
+    return jobs.size();
+}
+
+void ReLiveDB::submitWrite(std::function<void()> job)
+{
+    _writer.submit([this, writeJob = std::move(job)]() {
+        std::lock_guard<Mutex> writeLock{_mutex};
+        try {
+            writeJob();
+        }
+        catch (const std::system_error& ex) {
+            ERROR_LOG(0, "SQLite exception: " << ex.what());
+            try {
+                storage().rollback();
+            }
+            catch (const std::system_error&) {
+                // no transaction was open
+            }
+        }
+    }, TaskScheduler::eNormal, _syncJobs);
+}
+
+HostLimiter::Outcome ReLiveDB::doRefreshStations()
+{
+    struct StationData
+    {
+        Station _station;
+        std::vector<std::string> _servers;
+    };
+    std::vector<StationData> stations;
+    std::string metaInfo, newMetaInfo;
+    auto masterUrls = readStorage().get_all<Url>(where(c(&Url::_ownerId) == 0 and c(&Url::_type) == int(Url::eReLiveAPI) and c(&Url::_url) == _master.str()));
+    if (!masterUrls.empty()) {
+        metaInfo = masterUrls.front()._metaInfo;
+    }
+    bool unchanged = false;
+    auto res = conditionalGet(_master, "/getstations/?v=11", metaInfo, _syncMode == eIncrementalSync, unchanged, newMetaInfo);
+    if (unchanged) {
+        // station list is unchanged, only look for changes of the individual stations
+        DEBUG_LOG(2, "getstations unchanged");
+        ++_numOfUnchanged;
+        submitWrite([this]() {
+            std::vector<std::tuple<std::string, int64_t, int64_t>> refreshes;
+            storage().begin_transaction();
+            for (const auto& station : storage().get_all<Station>()) {
+                auto apis = storage().get_all<Url>(where(c(&Url::_ownerId) == station._id and c(&Url::_type) == int(Url::eStationAPI)));
+                if (!apis.empty()) {
+                    refreshes.emplace_back(apis.front()._url, station._id, journalSyncJob(SyncJob::eStationInfo, station._id, 0, apis.front()._url));
+                }
+            }
+            storage().commit();
+            for (const auto& [url, stationId, journalId] : refreshes) {
+                refreshStationInfo(ghc::net::uri(url), stationId, journalId);
+            }
+        });
+        return HostLimiter::eDone;
+    }
     if (res && res->status == 200) {
         try {
-            auto result = json::parse(res->body);
             auto now = getTime();
-            for (const auto& station : result.at("stations")) {
-                int64_t stationId;
+            JsonRecordReader reader("stations", [&](const json& station) {
                 DEBUG_LOG(3, station.at("name").get<std::string>());
-                std::string apiServer;
-                {
-                    std::lock_guard<Mutex> lock{_mutex};
-                    Station st{-1, station.at("id").get<int64_t>(), 11, station.at("name").get<std::string>(), now, 0, ""};
-                    auto oldStations = storage().get_all<Station>(where(c(&Station::_name) == st._name));
-                    if (oldStations.empty()) {
-                        storage().begin_transaction();
-                        stationId = storage().insert(st);
-                        for (const auto& server : station.at("servers")) {
-                            if (apiServer.empty()) {
-                                apiServer = server.get<std::string>();
-                            }
-                            Url serverUrl{-1, stationId, server.get<std::string>(), now, Url::eStationAPI, ""};
-                            storage().insert(serverUrl);
-                        }
-                        storage().commit();
-                    }
-                    else {
-                        stationId = oldStations.front()._id;
-                        if (oldStations.front().needsUpdate(st)) {
-                            st._id = stationId;
-                            storage().update(st);
-                        }
-                        auto apis = storage().get_all<Url>(where(c(&Url::_ownerId) == stationId and c(&Url::_type) == int(Url::eStationAPI)));
-                        if (!apis.empty()) {
-                            apiServer = apis.front()._url;
-                        }
-                    }
-                }
-                if (!apiServer.empty()) {
-                    refreshStationInfo(ghc::net::uri(apiServer), stationId);
+                StationData data{Station{-1, station.at("id").get<int64_t>(), 11, station.at("name").get<std::string>(), now, 0, ""}, {}};
+                for (const auto& server : station.at("servers")) {
+                    data._servers.push_back(server.get<std::string>());
                 }
+                stations.push_back(std::move(data));
+            });
+            if (!reader.parse(res->body)) {
+                ERROR_LOG(0, "JSON error: " << reader.error());
+                return HostLimiter::eDone;
             }
         }
         catch (const json::exception& ex) {
             ERROR_LOG(0, "JSON exception: " << ex.what());
-        }
-        catch (const std::system_error& ex) {
-            ERROR_LOG(0, "SQLite exception: " << ex.what());
+            return HostLimiter::eDone;
         }
     }
+    else if (isTransientFailure(res)) {
+        return HostLimiter::eRetry;
+    }
     else {
-        ERROR_LOG(0, "Couldn't reach " << _master.host() << ":" << _master.port() << "/getstations/?v=11");
+        ERROR_LOG(0, "Couldn't fetch " << _master.host() << ":" << _master.port() << "/getstations/?v=11 (" << res->status << ")");
+        return HostLimiter::eDone;
     }
+    submitWrite([this, stations = std::move(stations), newMetaInfo]() {
+        // the new validators and the journaled station jobs are committed together
+        std::vector<std::tuple<std::string, int64_t, int64_t>> refreshes;
+        auto now = getTime();
+        storage().begin_transaction();
+        auto masterUrls = storage().get_all<Url>(where(c(&Url::_ownerId) == 0 and c(&Url::_type) == int(Url::eReLiveAPI) and c(&Url::_url) == _master.str()));
+        Url masterUrl{-1, 0, _master.str(), now, Url::eReLiveAPI, newMetaInfo};
+        if (masterUrls.empty()) {
+            storage().insert(masterUrl);
+        }
+        else {
+            masterUrl._id = masterUrls.front()._id;
+            storage().update(masterUrl);
+        }
+        for (auto station : stations) {
+            int64_t stationId;
+            std::string apiServer;
+            auto& st = station._station;
+            auto oldStations = storage().get_all<Station>(where(c(&Station::_name) == st._name));
+            if (oldStations.empty()) {
+                stationId = storage().insert(st);
+                for (const auto& server : station._servers) {
+                    if (apiServer.empty()) {
+                        apiServer = server;
+                    }
+                    Url serverUrl{-1, stationId, server, now, Url::eStationAPI, ""};
+                    storage().insert(serverUrl);
+                }
+            }
+            else {
+                stationId = oldStations.front()._id;
+                if (oldStations.front().needsUpdate(st)) {
+                    st._id = stationId;
+                    storage().update(st);
+                }
+                auto apis = storage().get_all<Url>(where(c(&Url::_ownerId) == stationId and c(&Url::_type) == int(Url::eStationAPI)));
+                if (!apis.empty()) {
+                    apiServer = apis.front()._url;
+                }
+            }
+            if (!apiServer.empty()) {
+                refreshes.emplace_back(apiServer, stationId, journalSyncJob(SyncJob::eStationInfo, stationId, 0, apiServer));
+            }
+        }
+        storage().commit();
+        for (const auto& [url, stationId, journalId] : refreshes) {
+            refreshStationInfo(ghc::net::uri(url), stationId, journalId);
+        }
+    });
+    return HostLimiter::eDone;
 }
 
-void ReLiveDB::refreshStationInfo(const ghc::net::uri& station, int64_t stationId)
+void ReLiveDB::refreshStationInfo(const ghc::net::uri& station, int64_t stationId, int64_t journalId)
 {
-    std::lock_guard<Mutex> lock{_mutex};
-    _jobs.push_back(_worker.submit([this](const ghc::net::uri url, int64_t station_id) { doRefreshStationInfo(url, station_id); }, station, stationId));
+    // the station infos fan out into the stream jobs, so they go first to find all work early
+    _hostLimiter.submit(station, [this, station, stationId, journalId]() { return doRefreshStationInfo(station, stationId, journalId); }, TaskScheduler::eHigh, _syncJobs);
 }
 
-void ReLiveDB::doRefreshStationInfo(const ghc::net::uri& station, int64_t stationId)
+HostLimiter::Outcome ReLiveDB::doRefreshStationInfo(const ghc::net::uri& station, int64_t stationId, int64_t journalId)
 {
+    struct StreamData
+    {
+        Stream _stream;
+        std::vector<std::string> _mediaUrls;
+    };
+    int protocol;
+    std::string webSiteUrl, liveStreamUrl;
+    std::vector<StreamData> streams;
     DEBUG_LOG(2, station.request_path() << "getstationinfo?v=11");
-    http::Headers headers = {{"User-Agent", relive::userAgent()}};
-    auto res = createClient(station)->Get((station.request_path() + "getstationinfo?v=11").c_str());
+    int64_t apiUrlId = -1;
+    std::string metaInfo, newMetaInfo;
+    for (const auto& api : readStorage().get_all<Url>(where(c(&Url::_ownerId) == stationId and c(&Url::_type) == int(Url::eStationAPI)))) {
+        if (ghc::net::uri(api._url).str() == station.str()) {
+            apiUrlId = api._id;
+            metaInfo = api._metaInfo;
+            break;
+        }
+    }
+    bool unchanged = false;
+    auto res = conditionalGet(station, station.request_path() + "getstationinfo?v=11", metaInfo, _syncMode == eIncrementalSync, unchanged, newMetaInfo);
+    if (unchanged) {
+        // no stream of this station changed, so no stream info needs to be fetched either
+        DEBUG_LOG(2, station.str() << " getstationinfo unchanged");
+        ++_numOfUnchanged;
+        submitWrite([journalId]() { finishSyncJob(journalId); });
+        return HostLimiter::eDone;
+    }
     if (res && res->status == 200) {
         try {
-            auto result = json::parse(res->body);
-            auto stationName = result["stationName"].get<std::string>();
-            DEBUG_LOG(2, stationName << ": " << result["streams"].size() << " streams");
-            {
-                auto now = getTime();
-                {
-                    std::lock_guard<Mutex> lock{_mutex};
-                    auto st = storage().get<Station>(stationId);
-                    st._protocol = result.at("version").get<int>();
-                    st._lastUpdate = now;
-                    storage().update(st);
-                    auto oldWeb = storage().get_all<Url>(where(c(&Url::_ownerId) == stationId and c(&Url::_type) == int(Url::eWeb)));
-                    Url stationWeb{-1, stationId, result.at("webSiteUrl").get<std::string>(), now, Url::eWeb, ""};
-                    if (oldWeb.empty()) {
-                        storage().insert(stationWeb);
-                    }
-                    else if (oldWeb.front().needsUpdate(stationWeb)) {
-                        stationWeb._id = oldWeb.front()._id;
-                        storage().update(stationWeb);
-                    }
-                    auto oldLiveStream = storage().get_all<Url>(where(c(&Url::_ownerId) == stationId and c(&Url::_type) == int(Url::eLiveStream)));
-                    Url stationLiveStream{-1, stationId, result.at("liveStreamUrl").get<std::string>(), now, Url::eLiveStream, ""};
-                    if (oldLiveStream.empty()) {
-                        storage().insert(stationLiveStream);
-                    }
-                    else if (oldLiveStream.front().needsUpdate(stationLiveStream)) {
-                        stationLiveStream._id = oldLiveStream.front()._id;
-                        storage().update(stationLiveStream);
-                    }
-                }
-                for (const auto& stream : result.at("streams")) {
-                    Stream s;
-                    int64_t streamId;
-                    int64_t reliveId;
-                    {
-                        std::lock_guard<Mutex> lock{_mutex};
-                        reliveId = stream.at("id").get<int64_t>();
-                        s = Stream{-1,
-                                   reliveId,
-                                   stationId,
-                                   stream.at("streamName").get<std::string>(),
-                                   stream.at("hostName").get<std::string>(),
-                                   stream.at("description").get<std::string>(),
-                                   stream.at("timestamp").get<int64_t>(),
-                                   stream.at("duration").get<int64_t>(),
-                                   stream.at("size").get<int64_t>(),
-                                   stream.at("mediaDataFormat").get<std::string>(),
-                                   stream.at("mediaDataOffset").get<int64_t>(),
-                                   stream.at("checksumStreamInfoData").get<int64_t>(),
-                                   stream.at("checksumChatData").get<int64_t>(),
-                                   stream.at("checksumMediaData").get<int64_t>(),
-                                   getTime(),
-                                   stream.value("anonymize", false) ? Stream::eHideNewTracks : 0,
-                                   ""};
-                        auto oldStream = storage().get_all<Stream>(where(c(&Stream::_reliveId) == reliveId and c(&Stream::_stationId) == stationId));
-                        if (oldStream.empty()) {
-                            streamId = storage().insert(s);
-                            for (const auto& mediaDirect : stream.at("mediaDirectUrls")) {
-                                Url mediaUrl{-1, streamId, mediaDirect.get<std::string>(), now, Url::eMedia, ""};
-                                storage().insert(mediaUrl);
-                            }
-                            refreshStreamInfo(station, reliveId, streamId);
-                        }
-                        else {
-                            streamId = oldStream.front()._id;
-                            if (oldStream.front().needsUpdate(s)) {
-                                s._id = streamId;
-                                if (oldStream.front()._flags & Stream::ePlayed) {
-                                    s._flags |= Stream::ePlayed;
-                                }
-                                storage().update(s);
-                                if (oldStream.front()._streamInfoChecksum != s._streamInfoChecksum) {
-                                    storage().remove_all<Track>(where(c(&Track::_streamId) == streamId));
-                                    refreshStreamInfo(station, reliveId, streamId);
-                                }
-                            }
-                        }
-                    }
+            // fetching and parsing runs in parallel without any lock, only the results go to the writer
+            auto now = getTime();
+            JsonRecordReader reader("streams", [&](const json& stream) {
+                StreamData data{Stream{-1,
+                                       stream.at("id").get<int64_t>(),
+                                       stationId,
+                                       stream.at("streamName").get<std::string>(),
+                                       stream.at("hostName").get<std::string>(),
+                                       stream.at("description").get<std::string>(),
+                                       stream.at("timestamp").get<int64_t>(),
+                                       stream.at("duration").get<int64_t>(),
+                                       stream.at("size").get<int64_t>(),
+                                       stream.at("mediaDataFormat").get<std::string>(),
+                                       stream.at("mediaDataOffset").get<int64_t>(),
+                                       stream.at("checksumStreamInfoData").get<int64_t>(),
+                                       stream.at("checksumChatData").get<int64_t>(),
+                                       stream.at("checksumMediaData").get<int64_t>(),
+                                       now,
+                                       stream.value("anonymize", false) ? Stream::eHideNewTracks : 0,
+                                       ""},
+                                {}};
+                for (const auto& mediaDirect : stream.at("mediaDirectUrls")) {
+                    data._mediaUrls.push_back(mediaDirect.get<std::string>());
                 }
+                streams.push_back(std::move(data));
+            });
+            if (!reader.parse(res->body)) {
+                ERROR_LOG(0, "JSON error: " << reader.error());
+                return HostLimiter::eDone;
             }
+            const auto& result = reader.header();
+            DEBUG_LOG(2, result.value("stationName", std::string()) << ": " << streams.size() << " streams");
+            protocol = result.at("version").get<int>();
+            webSiteUrl = result.at("webSiteUrl").get<std::string>();
+            liveStreamUrl = result.at("liveStreamUrl").get<std::string>();
         }
         catch (const json::exception& ex) {
             ERROR_LOG(0, "JSON exception: " << ex.what());
+            return HostLimiter::eDone;
         }
-        catch (const std::system_error& ex) {
-            ERROR_LOG(0, "SQLite exception: " << ex.what());
-        }
+    }
+    else if (isTransientFailure(res)) {
+        return HostLimiter::eRetry;
     }
     else {
-        ERROR_LOG(0, "Error while fetching " << station.str());
+        ERROR_LOG(0, "Error while fetching " << station.str() << " (" << res->status << ")");
+        submitWrite([journalId]() { finishSyncJob(journalId); });
+        return HostLimiter::eDone;
     }
+    submitWrite([=, streams = std::move(streams)]() mutable {
+        auto now = getTime();
+        storage().begin_transaction();
+        if (apiUrlId >= 0) {
+            storage().update_all(set(c(&Url::_metaInfo) = newMetaInfo), where(c(&Url::_id) == apiUrlId));
+        }
+        auto st = storage().get<Station>(stationId);
+        st._protocol = protocol;
+        st._lastUpdate = now;
+        storage().update(st);
+        auto oldWeb = storage().get_all<Url>(where(c(&Url::_ownerId) == stationId and c(&Url::_type) == int(Url::eWeb)));
+        Url stationWeb{-1, stationId, webSiteUrl, now, Url::eWeb, ""};
+        if (oldWeb.empty()) {
+            storage().insert(stationWeb);
+        }
+        else if (oldWeb.front().needsUpdate(stationWeb)) {
+            stationWeb._id = oldWeb.front()._id;
+            storage().update(stationWeb);
+        }
+        auto oldLiveStream = storage().get_all<Url>(where(c(&Url::_ownerId) == stationId and c(&Url::_type) == int(Url::eLiveStream)));
+        Url stationLiveStream{-1, stationId, liveStreamUrl, now, Url::eLiveStream, ""};
+        if (oldLiveStream.empty()) {
+            storage().insert(stationLiveStream);
+        }
+        else if (oldLiveStream.front().needsUpdate(stationLiveStream)) {
+            stationLiveStream._id = oldLiveStream.front()._id;
+            storage().update(stationLiveStream);
+        }
+        std::map<int64_t, Stream> oldStreams;
+        for (auto& stream : storage().get_all<Stream>(where(c(&Stream::_stationId) == stationId))) {
+            oldStreams.emplace(stream._reliveId, std::move(stream));
+        }
+        std::vector<std::tuple<int64_t, int64_t, int64_t>> infoRefreshes;
+        for (auto& data : streams) {
+            auto& s = data._stream;
+            auto oldStream = oldStreams.find(s._reliveId);
+            if (oldStream == oldStreams.end()) {
+                auto streamId = storage().insert(s);
+                for (const auto& mediaDirect : data._mediaUrls) {
+                    Url mediaUrl{-1, streamId, mediaDirect, now, Url::eMedia, ""};
+                    storage().insert(mediaUrl);
+                }
+                s._id = streamId;
+                oldStreams.emplace(s._reliveId, s);
+                infoRefreshes.emplace_back(s._reliveId, streamId, journalSyncJob(SyncJob::eStreamInfo, streamId, s._reliveId, station.str()));
+            }
+            else if (oldStream->second.needsUpdate(s)) {
+                auto streamId = oldStream->second._id;
+                s._id = streamId;
+                if (oldStream->second._flags & Stream::ePlayed) {
+                    s._flags |= Stream::ePlayed;
+                }
+                storage().update(s);
+                if (oldStream->second._streamInfoChecksum != s._streamInfoChecksum) {
+                    storage().remove_all<Track>(where(c(&Track::_streamId) == streamId));
+                    infoRefreshes.emplace_back(s._reliveId, streamId, journalSyncJob(SyncJob::eStreamInfo, streamId, s._reliveId, station.str()));
+                }
+                oldStream->second = s;
+            }
+            else if (_syncMode == eFullSync) {
+                // a full sync doesn't trust the checksums and verifies the tracks too
+                infoRefreshes.emplace_back(s._reliveId, oldStream->second._id, journalSyncJob(SyncJob::eStreamInfo, oldStream->second._id, s._reliveId, station.str()));
+            }
+        }
+        finishSyncJob(journalId);
+        storage().commit();
+        for (const auto& [reliveId, streamId, streamJournalId] : infoRefreshes) {
+            refreshStreamInfo(station, reliveId, streamId, streamJournalId);
+        }
+    });
+    return HostLimiter::eDone;
 }
 
-void ReLiveDB::refreshStreamInfo(const ghc::net::uri& station, int64_t reliveId, int64_t streamId)
+void ReLiveDB::refreshStreamInfo(const ghc::net::uri& station, int64_t reliveId, int64_t streamId, int64_t journalId)
 {
-    std::lock_guard<Mutex> lock{_mutex};
-    _jobs.push_back(_worker.submit([this](const ghc::net::uri s, int64_t relive_id, int64_t stream_id) { doRefreshStreamInfo(s, relive_id, stream_id); }, station, reliveId, streamId));
+    _hostLimiter.submit(station, [this, station, reliveId, streamId, journalId]() { return doRefreshStreamInfo(station, reliveId, streamId, journalId); }, TaskScheduler::eNormal, _syncJobs);
 }
 
-void ReLiveDB::doRefreshStreamInfo(const ghc::net::uri& station, int64_t reliveId, int64_t streamId)
+HostLimiter::Outcome ReLiveDB::doRefreshStreamInfo(const ghc::net::uri& station, int64_t reliveId, int64_t streamId, int64_t journalId)
 {
+    std::vector<Track> tracks;
     DEBUG_LOG(2, station.request_path() << "getstationinfo?v=11");
     http::Headers headers = {{"User-Agent", relive::userAgent()}};
-    auto res = createClient(station)->Get((station.request_path() + "getstreaminfo?v=11&streamid=" + std::to_string(reliveId)).c_str());
+    auto res = pooledGet(station, station.request_path() + "getstreaminfo?v=11&streamid=" + std::to_string(reliveId), headers);
     if (res && res->status == 200) {
         try {
-            auto result = json::parse(res->body);
-            auto info = res->body;
-            std::lock_guard<Mutex> lock{_mutex};
-            storage().begin_transaction();
-            for (const auto& track : result.at("tracks")) {
+            auto now = getTime();
+            JsonRecordReader reader("tracks", [&](const json& track) {
                 int type = 0;
-                auto typeStr = track["trackType"].get<std::string>();
+                auto typeStr = track.at("trackType").get<std::string>();
                 if (typeStr == "Music") {
                     type = 1;
                 }
@@ -541,30 +1438,58 @@ void ReLiveDB::doRefreshStreamInfo(const ghc::net::uri& station, int64_t reliveI
                 else if (typeStr == "Narration") {
                     type = 4;
                 }
-                Track t{-1, streamId, track["trackName"].get<std::string>(), track["artistName"].get<std::string>(), type, track["time"].get<int64_t>(), getTime(), 0};
-                auto oldTrack = storage().get_all<Track>(where(c(&Track::_streamId) == streamId and c(&Track::_time) == t._time));
-                if (oldTrack.empty()) {
-                    storage().insert(t);
-                }
-                else {
-                    if (oldTrack.front().needsUpdate(t)) {
-                        t._id = oldTrack.front()._id;
-                        storage().update(t);
-                    }
-                }
+                tracks.push_back(Track{-1, streamId, track.at("trackName").get<std::string>(), track.at("artistName").get<std::string>(), type, track.at("time").get<int64_t>(), now, 0});
+            });
+            if (!reader.parse(res->body)) {
+                ERROR_LOG(0, "JSON error: " << reader.error());
+                return HostLimiter::eDone;
             }
-            storage().commit();
-            DEBUG_LOG(3, "    " << result["tracks"].size());
-            _numOfTracks += result["tracks"].size();
         }
         catch (const json::exception& ex) {
             ERROR_LOG(0, "JSON exception: " << ex.what());
+            return HostLimiter::eDone;
         }
-        catch (const std::system_error& ex) {
-            ERROR_LOG(0, "SQLite exception: " << ex.what());
-        }
+    }
+    else if (isTransientFailure(res)) {
+        return HostLimiter::eRetry;
     }
     else {
-        ERROR_LOG(0, "Error while fetching " << station.str() << " - Stream: " << streamId);
+        ERROR_LOG(0, "Error while fetching " << station.str() << " - Stream: " << streamId << " (" << res->status << ")");
+        submitWrite([journalId]() { finishSyncJob(journalId); });
+        return HostLimiter::eDone;
     }
+    submitWrite([this, streamId, journalId, tracks = std::move(tracks)]() mutable {
+        // one query for the existing tracks instead of one per track, diff in memory and
+        // write the changes with two prepared statements in a single transaction
+        std::map<int64_t, Track> oldTracks;
+        for (auto& track : storage().get_all<Track>(where(c(&Track::_streamId) == streamId))) {
+            oldTracks.emplace(track._time, std::move(track));
+        }
+        Track row;
+        auto insertTrack = storage().prepare(insert(std::ref(row)));
+        auto updateTrack = storage().prepare(update(std::ref(row)));
+        storage().begin_transaction();
+        for (auto& t : tracks) {
+            auto iter = oldTracks.find(t._time);
+            if (iter == oldTracks.end()) {
+                row = t;
+                row._id = storage().execute(insertTrack);
+                oldTracks.emplace(row._time, row);
+                ++_numOfTrackInserts;
+            }
+            else if (iter->second.needsUpdate(t)) {
+                t._id = iter->second._id;
+                row = t;
+                storage().execute(updateTrack);
+                iter->second = row;
+                ++_numOfTrackUpdates;
+            }
+        }
+        // replaying the job after an interruption finds the tracks already there
+        finishSyncJob(journalId);
+        storage().commit();
+        DEBUG_LOG(3, "    " << tracks.size());
+        _numOfTracks += tracks.size();
+    });
+    return HostLimiter::eDone;
 }
@@ -5,11 +5,16 @@
 //---------------------------------------------------------------------------------------
 #pragma once
 
+#include "catalog.hpp"
+#include "chatlog.hpp"
+#include "hostlimiter.hpp"
 #include "rldata.hpp"
+#include "scheduler.hpp"
 #include <ghc/uri.hpp>
-#include <pearce/threadpool.hpp>
 #include <atomic>
-#include <list>
+#include <cstdint>
+#include <map>
+#include <mutex>
 #include <sstream>
 
 namespace relive
@@ -20,6 +25,7 @@ struct Keys
     inline static std::string version = "version";                          // backend version that wrote to the db last
     inline static std::string relive_root_server = "relive_root_server";    // url of the relive api root server
     inline static std::string last_relive_sync = "last_relive_sync";        // unix timestamp of the last sync with relive
+    inline static std::string sync_started = "sync_started";                // unix timestamp of the start of the last sync, finished or not
     inline static std::string default_station = "default_station";          // default station to switch to, start with stations view if unset or empty
     inline static std::string play_position = "play_position";              // play position save point
     inline static std::string output_device = "output_device";              // device name of output device
@@ -28,6 +34,8 @@ struct Keys
     inline static std::string start_at_last_position = "start_at_last_pos"; // select last play position on startup
     inline static std::string name_color_seed = "name_color_seed";          // seed used for hashing up chat user name coloring
     inline static std::string player_volume = "player_volume";              // Replay Volume position of the player
+    inline static std::string media_cache_size = "media_cache_size";        // size budget of the on-disk media chunk cache in bytes
+    inline static std::string fts_rebuild = "fts_rebuild";                  // set while the full-text search index still needs a rebuild
 };
 
 class ReLiveDB
@@ -55,10 +63,27 @@ public:
         return val;
     }
 
-    void setPlayed(Stream& stream);
+    void setPlayed(const Stream& stream);
     
-    void refreshStations(std::function<void()> yield = std::function<void()>(), bool force = false);
+    enum SyncMode {
+        eIncrementalSync,  // conditional requests, unchanged responses are not parsed again
+        eFullSync,         // fetch and apply everything
+    };
+    void refreshStations(std::function<void()> yield = std::function<void()>(), bool force = false, SyncMode mode = eIncrementalSync);
+    // For shutting down: a running sync returns as soon as its running requests are done
+    // and later ones return right away. Unfinished jobs stay in the sync journal and are
+    // resumed by the next sync of a new ReLiveDB.
+    void cancelSync();
     
+    // The in-memory catalog, loaded on first use and replaced after every sync that
+    // finished. Navigating a snapshot never touches the database.
+    std::shared_ptr<const Catalog> catalog();
+    // The listener is called with every new snapshot, including the first one loaded,
+    // on the thread that replaced or loaded it.
+    using CatalogListener = std::function<void(std::shared_ptr<const Catalog>)>;
+    int subscribeCatalog(CatalogListener listener);
+    void unsubscribeCatalog(int subscription);
+
     std::vector<Station> fetchStations();
     void deepFetch(Station& station, bool withoutStreams = false);
     void deepFetch(Stream& stream, bool parentsOnly = false);
@@ -82,26 +107,80 @@ public:
         eNarration, // Conversation / Narration
     };
     std::vector<FindTracksInfo> findTracksInfo(const std::string& pattern, FindTracksFilter filter = eNone);
+
+    // Position in the results of a LIKE track search, newest streams first. Passed to
+    // findTracksInfo() repeatedly it yields the results in chunks of bounded size.
+    class FindTracksCursor
+    {
+    public:
+        explicit FindTracksCursor(const std::string& pattern, FindTracksFilter filter = eNone)
+            : _pattern(pattern)
+            , _filter(filter)
+        {
+        }
+        bool more() const { return _more; }
+
+    private:
+        friend class ReLiveDB;
+        std::string _pattern;
+        FindTracksFilter _filter;
+        int64_t _timestamp = INT64_MAX;  // sort key of the last result returned
+        int64_t _trackId = INT64_MAX;
+        bool _more = true;
+    };
+    // at most maxResults further results of the cursor, cursor.more() tells if there are others
+    std::vector<FindTracksInfo> findTracksInfo(FindTracksCursor& cursor, size_t maxResults);
+
+    // Ranked full-text search via the FTS5 index, every word of the query matches
+    // as a token prefix. Falls back to LIKE if sqlite was built without FTS5 and
+    // while the index is still being built in the background after the start.
+    std::vector<Stream> searchStreams(const std::string& query, int limit = 100, int offset = 0);
+    std::vector<FindTracksInfo> searchTracks(const std::string& query, FindTracksFilter filter = eNone, int limit = 100, int offset = 0);
+    // true once searches use the full-text index
+    bool hasFullTextSearch() const;
+    // Let queries of the calling thread fail early once check() returns true, pass an
+    // empty function to remove it. Used to cancel superseded searches.
+    void abortQueriesWhen(std::function<bool()> check);
     std::unique_ptr<Track> fetchTrack(int64_t trackId);
 
-    std::vector<ChatMessage> fetchChat(const Stream& stream);
+    // chat of the stream, cached on disk per chat checksum and mapped when cached
+    ChatLog fetchChat(const Stream& stream);
     
 private:
     void setConfigValueString(const std::string& key, const std::string& value);
     std::string getConfigValueString(const std::string& key, const std::string& defaultValue);
-    void refreshStationInfo(const ghc::net::uri& station, int64_t stationId);
-    void refreshStreamInfo(const ghc::net::uri& station, int64_t reliveId, int64_t streamId);
-    void doRefreshStations();
-    void doRefreshStationInfo(const ghc::net::uri& station, int64_t stid);
-    void doRefreshStreamInfo(const ghc::net::uri& station, int64_t reliveId, int64_t streamId);
-    pearce::ThreadPool _worker;
+    void refreshStationInfo(const ghc::net::uri& station, int64_t stationId, int64_t journalId);
+    void refreshStreamInfo(const ghc::net::uri& station, int64_t reliveId, int64_t streamId, int64_t journalId);
+    HostLimiter::Outcome doRefreshStations();
+    size_t resumeSyncJournal();
+    HostLimiter::Outcome doRefreshStationInfo(const ghc::net::uri& station, int64_t stid, int64_t journalId);
+    HostLimiter::Outcome doRefreshStreamInfo(const ghc::net::uri& station, int64_t reliveId, int64_t streamId, int64_t journalId);
+    void submitWrite(std::function<void()> job);
+    std::shared_ptr<const Catalog> loadCatalog();
+    void publishCatalog(std::shared_ptr<const Catalog> catalog);
+    void notifyCatalogListeners(std::shared_ptr<const Catalog> catalog);
     std::function<void(int)> _progressHandler;
-    std::list<pearce::ThreadPool::TaskFuture<void>> _jobs;
+    std::shared_ptr<TaskScheduler::Counter> _syncJobs;  // all jobs of the running sync, set before the first one
     ghc::net::uri _master;
     using Mutex = std::recursive_mutex;
-    Mutex _mutex;
-    int64_t _numOfTracks = 0;
+    Mutex _mutex;  // guards the write connection, readers use their own connections
+    std::atomic<int64_t> _numOfTracks{0};
+    std::atomic<int64_t> _numOfTrackInserts{0};
+    std::atomic<int64_t> _numOfTrackUpdates{0};
     std::atomic_bool _busy;
+    std::atomic_bool _syncCancelled{false};
+    std::atomic<SyncMode> _syncMode{eIncrementalSync};
+    std::atomic<int64_t> _numOfUnchanged{0};
+    std::mutex _catalogMutex;
+    std::shared_ptr<const Catalog> _catalog;
+    std::atomic<uint64_t> _catalogVersion{0};
+    std::map<int, CatalogListener> _catalogListeners;
+    int _nextCatalogListener = 1;
+    // declared last, so they are shut down first, while everything their tasks use is alive:
+    // the limiter starts no more jobs, the workers finish theirs, then the writer
+    TaskScheduler _writer;  // the single thread applying sync results to the db
+    TaskScheduler _worker;  // network fetches and JSON parsing, never touch the db
+    HostLimiter _hostLimiter;  // sync requests per host go through it onto _worker
 };
 
 template<>
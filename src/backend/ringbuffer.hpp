@@ -6,16 +6,28 @@
 #pragma once
 
 #include <algorithm>
-#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <type_traits>
 
+//---------------------------------------------------------------------------------------
+// Lock-free single-producer/single-consumer ring buffer
+//
+// push() may only be called from one producer thread, pull(), peek() and drop()
+// only from one consumer thread. filled(), free(), canPush() and canPull() are
+// safe from any thread but only give a snapshot. clear() discards all content
+// from the consumer side, resize() must not run concurrently with anything else.
+//---------------------------------------------------------------------------------------
 template <class T>
 class RingBuffer
 {
 public:
     RingBuffer(unsigned int size = 16384)
+        : _size(size)
+        , _buffer(new T[size])
+        , _readIndex(0)
+        , _writeIndex(0)
     {
-        _buffer = (T*)(_writePtr = _readPtr = new T[size]);
-        _size = size;
     }
 
     virtual ~RingBuffer()
@@ -27,63 +39,58 @@ public:
 
     void resize(unsigned int size)
     {
-        std::lock_guard<std::mutex> lock{_mutex};
         delete[] _buffer;
-        _buffer = (T*)(_writePtr = _readPtr = new T[size]);
+        _buffer = new T[size];
         _size = size;
+        _readIndex.store(0, std::memory_order_relaxed);
+        _writeIndex.store(0, std::memory_order_release);
     }
 
     int push(const T* data, unsigned int size)
     {
-        size = (std::min)(size, free());
-        std::lock_guard<std::mutex> lock{_mutex};
-        int len = size;
-        while(size--) {
-            if( _writePtr >= _buffer + _size )
-                _writePtr = _buffer;
-            *_writePtr++ = *data++;
+        auto writeIndex = _writeIndex.load(std::memory_order_relaxed);
+        auto readIndex = _readIndex.load(std::memory_order_acquire);
+        size = (std::min)(size, freeSpace(readIndex, writeIndex));
+        if (size) {
+            auto first = (std::min)(size, _size - writeIndex);
+            copy(_buffer + writeIndex, data, first);
+            copy(_buffer, data + first, size - first);
+            _writeIndex.store(wrap(writeIndex + size), std::memory_order_release);
         }
-        return len;
+        return size;
     }
 
-    int peek(T* data, unsigned int size)
+    int peek(T* data, unsigned int size) const
     {
-        size = (std::min)(size, filled());
-        std::lock_guard<std::mutex> lock{_mutex};
-        int len = size;
-        auto readPtr = _readPtr;
-        while(size--) {
-            if( readPtr >= _buffer + _size )
-                readPtr = _buffer;
-            *data++ = *readPtr++;
+        auto readIndex = _readIndex.load(std::memory_order_relaxed);
+        auto writeIndex = _writeIndex.load(std::memory_order_acquire);
+        size = (std::min)(size, usedSpace(readIndex, writeIndex));
+        if (size) {
+            auto first = (std::min)(size, _size - readIndex);
+            copy(data, _buffer + readIndex, first);
+            copy(data + first, _buffer, size - first);
         }
-        return len;
+        return size;
     }
 
     int pull(T* data, unsigned int size)
     {
-        size = (std::min)(size, filled());
-        std::lock_guard<std::mutex> lock{_mutex};
-        int len = size;
-        while(size--) {
-            if( _readPtr >= _buffer + _size )
-                _readPtr = _buffer;
-            *data++ = *_readPtr++;
+        size = peek(data, size);
+        if (size) {
+            _readIndex.store(wrap(_readIndex.load(std::memory_order_relaxed) + size), std::memory_order_release);
         }
-        return len;
+        return size;
     }
 
     int drop(unsigned int size)
     {
-        size = (std::min)(size, filled());
-        std::lock_guard<std::mutex> lock{_mutex};
-        int len = size;
-        while(size--) {
-            if( _readPtr >= _buffer + _size )
-                _readPtr = _buffer;
-            _readPtr++;
+        auto readIndex = _readIndex.load(std::memory_order_relaxed);
+        auto writeIndex = _writeIndex.load(std::memory_order_acquire);
+        size = (std::min)(size, usedSpace(readIndex, writeIndex));
+        if (size) {
+            _readIndex.store(wrap(readIndex + size), std::memory_order_release);
         }
-        return len;
+        return size;
     }
 
     bool canPush(unsigned int size) const
@@ -98,28 +105,49 @@ public:
 
     unsigned int filled() const
     {
-        std::lock_guard<std::mutex> lock{_mutex};
-        if( _readPtr <= _writePtr )
-            return _writePtr - _readPtr;
-        else
-            return _writePtr + _size - _readPtr;
+        return usedSpace(_readIndex.load(std::memory_order_acquire), _writeIndex.load(std::memory_order_acquire));
     }
 
     unsigned int free() const
     {
-        return _size - filled() - 1;
+        return freeSpace(_readIndex.load(std::memory_order_acquire), _writeIndex.load(std::memory_order_acquire));
     }
 
     virtual void clear()
     {
-        std::lock_guard<std::mutex> lock{_mutex};
-        _writePtr = _readPtr = _buffer;
+        _readIndex.store(_writeIndex.load(std::memory_order_acquire), std::memory_order_release);
     }
 
 private:
-    mutable std::mutex _mutex;
+    unsigned int wrap(unsigned int index) const
+    {
+        return index >= _size ? index - _size : index;
+    }
+
+    unsigned int usedSpace(unsigned int readIndex, unsigned int writeIndex) const
+    {
+        return readIndex <= writeIndex ? writeIndex - readIndex : writeIndex + _size - readIndex;
+    }
+
+    unsigned int freeSpace(unsigned int readIndex, unsigned int writeIndex) const
+    {
+        return _size - usedSpace(readIndex, writeIndex) - 1;
+    }
+
+    static void copy(T* dst, const T* src, unsigned int count)
+    {
+        if (count) {
+            if constexpr (std::is_trivially_copyable<T>::value) {
+                std::memcpy(dst, src, count * sizeof(T));
+            }
+            else {
+                std::copy(src, src + count, dst);
+            }
+        }
+    }
+
     unsigned int _size;
     T* _buffer;
-    volatile T* _writePtr;
-    volatile T* _readPtr;
+    alignas(64) std::atomic<unsigned int> _readIndex;
+    alignas(64) std::atomic<unsigned int> _writeIndex;
 };
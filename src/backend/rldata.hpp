@@ -7,6 +7,7 @@
 
 #include <backend/utility.hpp>
 
+#include <algorithm>
 #include <cstdint>
 #include <memory>
 #include <regex>
@@ -114,17 +115,11 @@ struct Stream
                 _flags != ns._flags || _metaInfo != ns._metaInfo);
     }
     
-    int trackIndexForTime(int64_t t)
+    int trackIndexForTime(int64_t t) const
     {
-        int lastIndex = 0;
-        int index = 0;
-        for(const auto& track : _tracks) {
-            if(track._time > t) {
-                return lastIndex;
-            }
-            lastIndex = index++;
-        }
-        return _tracks.empty() ? 0 : _tracks.size() - 1;
+        // tracks are sorted by time, find the last one starting at or before t
+        auto iter = std::upper_bound(_tracks.begin(), _tracks.end(), t, [](int64_t time, const Track& track) { return time < track._time; });
+        return iter == _tracks.begin() ? 0 : static_cast<int>(iter - _tracks.begin()) - 1;
     }
 
     std::string reLiveURL() const;
@@ -132,7 +127,7 @@ struct Stream
 
 struct Url
 {
-    enum Type { eStationAPI, eWeb, eMedia, eLiveStream, eLogo };
+    enum Type { eStationAPI, eWeb, eMedia, eLiveStream, eLogo, eReLiveAPI };
     int64_t _id = -1;
     int64_t _ownerId = 0;
     std::string _url;
@@ -147,6 +142,21 @@ struct Url
     }
 };
 
+// Refresh work of a sync, journaled so an interrupted sync resumes where it stopped
+struct SyncJob
+{
+    enum Type { eStationInfo, eStreamInfo };
+    enum Status { ePending, eDone };
+    int64_t _id = -1;
+    int _type = eStationInfo;
+    int64_t _ownerId = 0;   // the station for eStationInfo, the stream for eStreamInfo
+    int64_t _reliveId = 0;  // the relive id of the stream
+    std::string _url;       // station api
+    int _status = ePending;
+    int _attempts = 0;  // syncs that started the job
+    int64_t _lastUpdate = 0;
+};
+
 struct Station
 {
     int64_t _id = -1;
@@ -0,0 +1,231 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "scheduler.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace relive {
+
+namespace {
+struct QueuedTask
+{
+    TaskScheduler::Task _task;
+    std::shared_ptr<TaskScheduler::Counter> _counter;
+};
+// the scheduler and worker index of the current thread, if it is a worker
+thread_local const void* t_scheduler = nullptr;
+thread_local size_t t_workerIndex = 0;
+}  // namespace
+
+struct TaskScheduler::impl
+{
+    struct Worker
+    {
+        std::mutex _mutex;
+        std::deque<QueuedTask> _tasks;  // owner takes from the back, thieves from the front
+        std::thread _thread;
+    };
+    bool takeShared(std::deque<QueuedTask>& queue, QueuedTask& task)
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (queue.empty()) {
+            return false;
+        }
+        task = std::move(queue.front());
+        queue.pop_front();
+        return true;
+    }
+    bool take(size_t index, QueuedTask& task)
+    {
+        if (takeShared(_high, task)) {
+            return true;
+        }
+        auto& own = *_workers[index];
+        {
+            std::lock_guard<std::mutex> lock{own._mutex};
+            if (!own._tasks.empty()) {
+                task = std::move(own._tasks.back());
+                own._tasks.pop_back();
+                return true;
+            }
+        }
+        if (takeShared(_normal, task)) {
+            return true;
+        }
+        for (size_t i = 1; i < _workers.size(); ++i) {
+            auto& victim = *_workers[(index + i) % _workers.size()];
+            std::lock_guard<std::mutex> lock{victim._mutex};
+            if (!victim._tasks.empty()) {
+                task = std::move(victim._tasks.front());
+                victim._tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+    std::vector<std::unique_ptr<Worker>> _workers;
+    mutable std::mutex _mutex;  // guards the shared queues and the sleep of idle workers
+    std::condition_variable _wake;
+    std::deque<QueuedTask> _high;
+    std::deque<QueuedTask> _normal;
+    // counted before a task is queued and after it is taken, so it never underflows
+    std::atomic<size_t> _queued{0};
+    std::atomic_bool _shutdown{false};
+};
+
+TaskScheduler::Counter::Counter(Handler handler)
+    : _handler(std::move(handler))
+{
+}
+
+size_t TaskScheduler::Counter::submitted() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return _submitted;
+}
+
+size_t TaskScheduler::Counter::completed() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return _completed;
+}
+
+bool TaskScheduler::Counter::done() const
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    return _completed == _submitted;
+}
+
+void TaskScheduler::Counter::wait()
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+    _done.wait(lock, [this]() { return _completed == _submitted; });
+}
+
+bool TaskScheduler::Counter::waitFor(std::chrono::milliseconds timeout)
+{
+    std::unique_lock<std::mutex> lock{_mutex};
+    return _done.wait_for(lock, timeout, [this]() { return _completed == _submitted; });
+}
+
+void TaskScheduler::Counter::add()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    ++_submitted;
+}
+
+void TaskScheduler::Counter::complete()
+{
+    std::lock_guard<std::mutex> lock{_mutex};
+    ++_completed;
+    if (_handler) {
+        _handler(_completed, _submitted);
+    }
+    if (_completed == _submitted) {
+        _done.notify_all();
+    }
+}
+
+TaskScheduler::TaskScheduler(unsigned numThreads)
+    : _impl(std::make_unique<impl>())
+{
+    numThreads = (std::max)(numThreads, 1u);
+    for (unsigned i = 0; i < numThreads; ++i) {
+        _impl->_workers.push_back(std::make_unique<impl::Worker>());
+    }
+    for (size_t i = 0; i < _impl->_workers.size(); ++i) {
+        _impl->_workers[i]->_thread = std::thread(&TaskScheduler::worker, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        _impl->_shutdown = true;
+    }
+    _impl->_wake.notify_all();
+    for (auto& worker : _impl->_workers) {
+        worker->_thread.join();
+    }
+    // nobody waiting on a counter may hang on a task that will never run
+    QueuedTask task;
+    for (size_t i = 0; i < _impl->_workers.size(); ++i) {
+        while (_impl->take(i, task)) {
+            if (task._counter) {
+                task._counter->complete();
+            }
+        }
+    }
+}
+
+void TaskScheduler::submit(Task task, Priority priority, std::shared_ptr<Counter> counter)
+{
+    if (counter) {
+        counter->add();
+    }
+    ++_impl->_queued;
+    if (priority == eNormal && t_scheduler == _impl.get()) {
+        auto& own = *_impl->_workers[t_workerIndex];
+        {
+            std::lock_guard<std::mutex> lock{own._mutex};
+            own._tasks.push_back({std::move(task), std::move(counter)});
+        }
+        // a worker that found no work is waiting by now and gets notified
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+    }
+    else {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        (priority == eHigh ? _impl->_high : _impl->_normal).push_back({std::move(task), std::move(counter)});
+    }
+    _impl->_wake.notify_one();
+}
+
+unsigned TaskScheduler::numThreads() const
+{
+    return static_cast<unsigned>(_impl->_workers.size());
+}
+
+size_t TaskScheduler::queued() const
+{
+    return _impl->_queued;
+}
+
+void TaskScheduler::worker(size_t index)
+{
+    t_scheduler = _impl.get();
+    t_workerIndex = index;
+    while (!_impl->_shutdown) {
+        QueuedTask task;
+        if (!_impl->take(index, task)) {
+            std::unique_lock<std::mutex> lock{_impl->_mutex};
+            _impl->_wake.wait(lock, [this]() { return _impl->_shutdown || _impl->_queued > 0; });
+            continue;
+        }
+        --_impl->_queued;
+        try {
+            task._task();
+        }
+        catch (const std::exception& ex) {
+            ERROR_LOG(0, "Task failed: " << ex.what());
+        }
+        catch (...) {
+            ERROR_LOG(0, "Task failed with an unknown exception");
+        }
+        if (task._counter) {
+            task._counter->complete();
+        }
+    }
+}
+
+}  // namespace relive
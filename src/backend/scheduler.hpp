@@ -0,0 +1,74 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <memory>
+#include <mutex>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Work-stealing task scheduler. Every worker has its own deque, tasks submitted by a
+// task go to the deque of its worker and are taken newest first, idle workers steal
+// the oldest tasks of the others. Tasks submitted from other threads and high
+// priority tasks go to shared queues, a high priority task starts before any queued
+// normal one. Completion is tracked by counters instead of futures.
+//---------------------------------------------------------------------------------------
+class TaskScheduler
+{
+public:
+    enum Priority { eNormal, eHigh };
+
+    // Counts the tasks submitted with it and the completed ones. The handler is called
+    // on the worker thread after every completion, one call at a time.
+    class Counter
+    {
+    public:
+        using Handler = std::function<void(size_t completed, size_t submitted)>;
+        explicit Counter(Handler handler = Handler());
+
+        size_t submitted() const;
+        size_t completed() const;
+        // all submitted tasks are completed, including the ones they submitted
+        bool done() const;
+        void wait();
+        // false if not done after timeout
+        bool waitFor(std::chrono::milliseconds timeout);
+        // count work that is not (yet) a submitted task, like jobs held back for later
+        void add();
+        void complete();
+
+    private:
+        mutable std::mutex _mutex;
+        std::condition_variable _done;
+        size_t _submitted = 0;
+        size_t _completed = 0;
+        Handler _handler;
+    };
+    using Task = std::function<void()>;
+
+    explicit TaskScheduler(unsigned numThreads);
+    // tasks not yet started are dropped, their counters count them as completed
+    ~TaskScheduler();
+    TaskScheduler(const TaskScheduler&) = delete;
+    TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    void submit(Task task, Priority priority = eNormal, std::shared_ptr<Counter> counter = std::shared_ptr<Counter>());
+    unsigned numThreads() const;
+    // tasks submitted but not started yet
+    size_t queued() const;
+
+private:
+    struct impl;
+    void worker(size_t index);
+    std::unique_ptr<impl> _impl;
+};
+
+}  // namespace relive
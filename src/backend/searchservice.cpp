@@ -0,0 +1,262 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "searchservice.hpp"
+#include "daemonclient.hpp"
+#include "logging.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <system_error>
+#include <thread>
+
+namespace relive {
+
+using Clock = std::chrono::steady_clock;
+
+struct SearchService::impl
+{
+    ReLiveDB& _rdb;
+    DaemonClient _daemon;  // used by the worker only
+    std::string _daemonSocket;
+    Config _config;
+    mutable std::mutex _mutex;
+    std::condition_variable _workCond;
+    std::thread _worker;
+    bool _shutdown = false;
+    std::atomic<uint64_t> _generation{0};  // of the latest request
+    std::atomic<uint64_t> _running{0};     // of the request the worker is executing, 0 if idle
+    uint64_t _processed = 0;               // generation the worker has taken up last
+    Clock::time_point _lastRequest;
+    std::string _query;
+    int _scope = eStreamsAndTracks;
+    ReLiveDB::FindTracksFilter _filter = ReLiveDB::eNone;
+    Results _results;
+    uint64_t _resultsVersion = 0;
+    uint64_t _polledVersion = 0;
+
+    impl(ReLiveDB& rdb, const Config& config)
+        : _rdb(rdb)
+        , _config(config)
+    {
+    }
+
+    bool pending() const { return _processed != _generation; }
+
+    // the daemon for the next query of the worker and its socket, nullptr to use the database
+    DaemonClient* daemon(std::string& socketPath)
+    {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            socketPath = _daemonSocket;
+        }
+        if (socketPath.empty()) {
+            return nullptr;
+        }
+        if (!_daemon.connectedTo(socketPath) && !_daemon.connect(socketPath)) {
+            ERROR_LOG3(SearchService, 0, "Searching the database, no daemon serves " << socketPath);
+            dropDaemon(socketPath);
+            return nullptr;
+        }
+        return &_daemon;
+    }
+    void dropDaemon(const std::string& socketPath)
+    {
+        _daemon.disconnect();
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (_daemonSocket == socketPath) {
+            _daemonSocket.clear();
+        }
+    }
+    std::vector<Stream> searchStreams(const std::string& query, int limit, int offset)
+    {
+        std::string socketPath;
+        if (auto daemon = this->daemon(socketPath)) {
+            try {
+                return daemon->searchStreams(query, limit, offset);
+            }
+            catch (const IpcError& ex) {
+                ERROR_LOG3(SearchService, 0, "Searching the database, the daemon failed: " << ex.what());
+                // an error reply leaves the connection open, the daemon stays in use
+                if (!daemon->connected()) {
+                    dropDaemon(socketPath);
+                }
+            }
+        }
+        return _rdb.searchStreams(query, limit, offset);
+    }
+    std::vector<ReLiveDB::FindTracksInfo> searchTracks(const std::string& query, ReLiveDB::FindTracksFilter filter, int limit, int offset)
+    {
+        std::string socketPath;
+        if (auto daemon = this->daemon(socketPath)) {
+            try {
+                return daemon->searchTracks(query, filter, limit, offset);
+            }
+            catch (const IpcError& ex) {
+                ERROR_LOG3(SearchService, 0, "Searching the database, the daemon failed: " << ex.what());
+                // an error reply leaves the connection open, the daemon stays in use
+                if (!daemon->connected()) {
+                    dropDaemon(socketPath);
+                }
+            }
+        }
+        return _rdb.searchTracks(query, filter, limit, offset);
+    }
+
+    // append a page to the results of the given generation, false if it got superseded
+    template <typename T>
+    bool publish(uint64_t generation, std::vector<T> Results::*list, std::vector<T>&& page, bool complete)
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (generation != _generation) {
+            return false;
+        }
+        if (_results._generation != generation) {
+            _results = Results();
+            _results._generation = generation;
+        }
+        auto& target = _results.*list;
+        target.insert(target.end(), std::make_move_iterator(page.begin()), std::make_move_iterator(page.end()));
+        _results._complete = complete;
+        ++_resultsVersion;
+        return true;
+    }
+};
+
+SearchService::SearchService(ReLiveDB& rdb)
+    : SearchService(rdb, Config())
+{
+}
+
+SearchService::SearchService(ReLiveDB& rdb, const Config& config)
+    : _impl(std::make_unique<impl>(rdb, config))
+{
+    _impl->_worker = std::thread(&SearchService::worker, this);
+}
+
+SearchService::~SearchService()
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        _impl->_shutdown = true;
+    }
+    _impl->_workCond.notify_all();
+    _impl->_worker.join();
+}
+
+uint64_t SearchService::search(const std::string& query, int scope, ReLiveDB::FindTracksFilter filter)
+{
+    uint64_t generation;
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        generation = ++_impl->_generation;
+        _impl->_query = query;
+        _impl->_scope = scope;
+        _impl->_filter = filter;
+        _impl->_lastRequest = Clock::now();
+    }
+    _impl->_workCond.notify_all();
+    return generation;
+}
+
+void SearchService::cancel()
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_mutex};
+        _impl->_processed = ++_impl->_generation;
+        _impl->_results = Results();
+        _impl->_results._generation = _impl->_generation;
+        _impl->_results._complete = true;
+        ++_impl->_resultsVersion;
+    }
+    _impl->_workCond.notify_all();
+}
+
+bool SearchService::poll(Results& results)
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    if (_impl->_polledVersion == _impl->_resultsVersion) {
+        return false;
+    }
+    _impl->_polledVersion = _impl->_resultsVersion;
+    results = _impl->_results;
+    return true;
+}
+
+bool SearchService::busy() const
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    return _impl->_running || _impl->pending();
+}
+
+void SearchService::useDaemon(const std::string& socketPath)
+{
+    std::lock_guard<std::mutex> lock{_impl->_mutex};
+    _impl->_daemonSocket = socketPath;
+}
+
+void SearchService::worker()
+{
+    _impl->_rdb.abortQueriesWhen([this]() { return _impl->_running != _impl->_generation; });
+    std::unique_lock<std::mutex> lock{_impl->_mutex};
+    while (!_impl->_shutdown) {
+        _impl->_running = 0;
+        _impl->_workCond.wait(lock, [this]() { return _impl->_shutdown || _impl->pending(); });
+        // wait until the input settles, every new request restarts the debounce time
+        while (!_impl->_shutdown && Clock::now() < _impl->_lastRequest + _impl->_config.debounce) {
+            _impl->_workCond.wait_until(lock, _impl->_lastRequest + _impl->_config.debounce);
+        }
+        if (_impl->_shutdown || !_impl->pending()) {
+            continue;
+        }
+        auto generation = _impl->_processed = _impl->_generation;
+        auto query = _impl->_query;
+        auto scope = _impl->_scope;
+        auto filter = _impl->_filter;
+        _impl->_running = generation;
+        lock.unlock();
+        auto start = Clock::now();
+        try {
+            bool current = true;
+            if (scope & eStreams) {
+                for (int offset = 0; current && offset < _impl->_config.maxResults; offset += _impl->_config.pageSize) {
+                    auto limit = (std::min)(_impl->_config.pageSize, _impl->_config.maxResults - offset);
+                    auto page = _impl->searchStreams(query, limit, offset);
+                    bool last = int(page.size()) < limit || offset + limit >= _impl->_config.maxResults;
+                    current = _impl->publish(generation, &Results::_streams, std::move(page), last && !(scope & eTracks));
+                    if (last) {
+                        break;
+                    }
+                }
+            }
+            if (scope & eTracks) {
+                for (int offset = 0; current && offset < _impl->_config.maxResults; offset += _impl->_config.pageSize) {
+                    auto limit = (std::min)(_impl->_config.pageSize, _impl->_config.maxResults - offset);
+                    auto page = _impl->searchTracks(query, filter, limit, offset);
+                    bool last = int(page.size()) < limit || offset + limit >= _impl->_config.maxResults;
+                    current = _impl->publish(generation, &Results::_tracks, std::move(page), last);
+                    if (last) {
+                        break;
+                    }
+                }
+            }
+            DEBUG_LOG(2, "search for '" << query << "' " << (current ? "finished" : "superseded") << " after " << std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count() << "ms");
+        }
+        catch (const std::system_error& ex) {
+            // an aborted query throws SQLITE_INTERRUPT, anything else is a real error
+            if (generation == _impl->_generation) {
+                ERROR_LOG(1, "search for '" << query << "' failed: " << ex.what());
+                _impl->publish(generation, &Results::_tracks, std::vector<ReLiveDB::FindTracksInfo>(), true);
+            }
+        }
+        lock.lock();
+    }
+    lock.unlock();
+    _impl->_rdb.abortQueriesWhen(std::function<bool()>());
+}
+
+}  // namespace relive
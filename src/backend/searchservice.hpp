@@ -0,0 +1,60 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "relivedb.hpp"
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Runs searches on a worker thread so the UI never waits for the database. Requests
+// are debounced, a newer request aborts the running query of an older one, and the
+// results are published page by page for the UI to poll once per frame. With a sync
+// daemon the searches run in its process on the shared database.
+//---------------------------------------------------------------------------------------
+class SearchService
+{
+public:
+    enum Scope { eStreams = 1, eTracks = 2, eStreamsAndTracks = eStreams | eTracks };
+    struct Config {
+        std::chrono::milliseconds debounce{150};  // quiet time after the last request before searching
+        int pageSize = 50;
+        int maxResults = 500;  // per scope
+    };
+    struct Results {
+        uint64_t _generation = 0;  // the request these results belong to
+        std::vector<Stream> _streams;
+        std::vector<ReLiveDB::FindTracksInfo> _tracks;
+        bool _complete = false;  // all pages have been delivered
+    };
+    explicit SearchService(ReLiveDB& rdb);
+    SearchService(ReLiveDB& rdb, const Config& config);
+    ~SearchService();
+
+    // request a search, supersedes all earlier ones, returns its generation
+    uint64_t search(const std::string& query, int scope = eStreamsAndTracks, ReLiveDB::FindTracksFilter filter = ReLiveDB::eNone);
+    // drop the current request and its results
+    void cancel();
+    // non-blocking, copies the current results and returns true if they changed since the last call
+    bool poll(Results& results);
+    // true while a request is pending or running
+    bool busy() const;
+    // search via the sync daemon at the socket, the database is only used if it fails,
+    // an empty path goes back to the database
+    void useDaemon(const std::string& socketPath);
+
+private:
+    void worker();
+    struct impl;
+    std::unique_ptr<impl> _impl;
+};
+
+}  // namespace relive
@@ -0,0 +1,117 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "seekindex.hpp"
+#include "logging.hpp"
+#include "system.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+namespace fs = ghc::filesystem;
+
+namespace relive {
+
+static const char g_seekIndexMagic[8] = {'R', 'L', 'S', 'E', 'E', 'K', '0', '1'};
+
+void SeekIndex::record(int64_t offset, int64_t sample)
+{
+    if (!_entries.empty() && (offset <= _entries.back()._offset || sample - _entries.back()._sample < EntryInterval)) {
+        return;
+    }
+    _entries.push_back({offset, sample});
+    _modified = true;
+}
+
+bool SeekIndex::lookup(int64_t sample, Entry& entry) const
+{
+    if (_entries.empty() || sample < _entries.front()._sample || sample > coveredSamples()) {
+        return false;
+    }
+    auto iter = std::upper_bound(_entries.begin(), _entries.end(), sample, [](int64_t s, const Entry& e) { return s < e._sample; });
+    entry = *(iter - 1);
+    return true;
+}
+
+int64_t SeekIndex::coveredSamples() const
+{
+    // beyond the last entry the sample position is still exact, but we don't know where the stream ends
+    return _entries.empty() ? 0 : _entries.back()._sample + EntryInterval;
+}
+
+int64_t SeekIndex::headerOffset(const uint8_t* data, int64_t consumed, int layer, int bitrateKbps, int hz)
+{
+    if (layer != 3 || bitrateKbps <= 0 || hz <= 0) {
+        return -1;
+    }
+    // MPEG-1 frames have 1152 samples, MPEG-2 and 2.5 ones 576
+    int64_t frameSize = (hz >= 32000 ? 144000 : 72000) * int64_t(bitrateKbps) / hz;
+    for (int padding = 0; padding <= 1; ++padding) {
+        auto offset = consumed - frameSize - padding;
+        if (offset >= 0 && data[offset] == 0xff && (data[offset + 1] & 0xe0) == 0xe0 && ((data[offset + 2] >> 1) & 1) == padding) {
+            return offset;
+        }
+    }
+    return -1;
+}
+
+void SeekIndex::clear()
+{
+    _entries.clear();
+    _modified = false;
+}
+
+bool SeekIndex::load(const std::string& filename)
+{
+    clear();
+    fs::ifstream is(fs::path(filename), std::ios::binary);
+    if (!is) {
+        return false;
+    }
+    char magic[sizeof(g_seekIndexMagic)];
+    uint64_t count = 0;
+    std::error_code ec;
+    auto fileSize = fs::file_size(fs::path(filename), ec);
+    if (!is.read(magic, sizeof(magic)) || std::memcmp(magic, g_seekIndexMagic, sizeof(magic)) != 0 || !is.read(reinterpret_cast<char*>(&count), sizeof(count)) || ec || count > fileSize / sizeof(Entry)) {
+        ERROR_LOG(1, "Ignoring invalid seek index " << filename);
+        return false;
+    }
+    _entries.resize(static_cast<size_t>(count));
+    if (!is.read(reinterpret_cast<char*>(_entries.data()), count * sizeof(Entry))) {
+        ERROR_LOG(1, "Ignoring truncated seek index " << filename);
+        _entries.clear();
+        return false;
+    }
+    DEBUG_LOG(2, "Loaded seek index with " << _entries.size() << " entries from " << filename);
+    return true;
+}
+
+bool SeekIndex::save(const std::string& filename)
+{
+    std::error_code ec;
+    fs::create_directories(fs::path(filename).parent_path(), ec);
+    auto tmpFile = fs::path(filename + ".tmp");
+    {
+        fs::ofstream os(tmpFile, std::ios::binary | std::ios::trunc);
+        uint64_t count = _entries.size();
+        os.write(g_seekIndexMagic, sizeof(g_seekIndexMagic));
+        os.write(reinterpret_cast<const char*>(&count), sizeof(count));
+        os.write(reinterpret_cast<const char*>(_entries.data()), _entries.size() * sizeof(Entry));
+        if (!os.flush()) {
+            ERROR_LOG(1, "Couldn't write seek index " << tmpFile.string());
+            fs::remove(tmpFile, ec);
+            return false;
+        }
+    }
+    fs::rename(tmpFile, fs::path(filename), ec);
+    if (ec) {
+        ERROR_LOG(1, "Couldn't store seek index " << filename << ": " << ec.message());
+        return false;
+    }
+    _modified = false;
+    return true;
+}
+
+}  // namespace relive
@@ -0,0 +1,53 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Maps sample positions to byte offsets of MP3 frame headers. Entries are recorded
+// while decoding sequentially from the stream start (or from an earlier entry), so
+// the index always covers a contiguous range starting at the first frame header,
+// which follows an ID3 tag or junk the stream may start with.
+//---------------------------------------------------------------------------------------
+class SeekIndex
+{
+public:
+    enum { EntryInterval = 32 * 1152 };  // sample frames between entries, about every 32 MP3 frames
+    struct Entry {
+        int64_t _offset;  // byte offset of the frame header
+        int64_t _sample;  // sample position of the first sample of that frame
+    };
+    SeekIndex() = default;
+
+    // record a decoded frame, the first one starts the index, later ones are ignored
+    // unless they extend the covered range
+    void record(int64_t offset, int64_t sample);
+    // find the entry to start decoding at for the given sample position, false if not covered
+    bool lookup(int64_t sample, Entry& entry) const;
+    int64_t coveredSamples() const;
+    const std::vector<Entry>& entries() const { return _entries; }
+    bool modified() const { return _modified; }
+    void clear();
+
+    // Offset of the Layer III frame header within the bytes a decoder consumed for one
+    // frame, they include any junk it skipped before. -1 if it can't be told, like for
+    // free format frames without a bitrate.
+    static int64_t headerOffset(const uint8_t* data, int64_t consumed, int layer, int bitrateKbps, int hz);
+
+    bool load(const std::string& filename);
+    bool save(const std::string& filename);
+
+private:
+    std::vector<Entry> _entries;
+    bool _modified = false;
+};
+
+}  // namespace relive
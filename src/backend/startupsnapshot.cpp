@@ -0,0 +1,128 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "startupsnapshot.hpp"
+#include "ipcprotocol.hpp"
+#include "logging.hpp"
+#include "mappedfile.hpp"
+#include "system.hpp"
+
+#include <utility>
+
+namespace fs = ghc::filesystem;
+
+namespace relive {
+
+namespace {
+
+const char g_magic[4] = {'R', 'L', 'S', 'S'};
+
+}  // namespace
+
+StartupSnapshot::StartupSnapshot(std::shared_ptr<const Catalog> catalog, int64_t activeStation, int64_t activeStream, const std::string& playPosition, int page)
+    : _catalog(std::move(catalog))
+    , _activeStation(activeStation)
+    , _activeStream(activeStream)
+    , _playPosition(playPosition)
+    , _page(page)
+{
+}
+
+bool StartupSnapshot::load(const std::string& filename)
+{
+    *this = StartupSnapshot();
+    std::error_code ec;
+    if (!fs::exists(fs::path(filename), ec)) {
+        return false;
+    }
+    MappedFile file(filename);
+    if (!file.isOpen() || file.size() < sizeof(g_magic) || std::string_view(reinterpret_cast<const char*>(file.data()), sizeof(g_magic)) != std::string_view(g_magic, sizeof(g_magic))) {
+        return false;
+    }
+    try {
+        IpcReader reader(std::string_view(reinterpret_cast<const char*>(file.data()) + sizeof(g_magic), file.size() - sizeof(g_magic)));
+        if (reader.varint() != FormatVersion) {
+            DEBUG_LOG(1, "Ignoring startup snapshot of another format version");
+            return false;
+        }
+        _activeStation = reader.svarint();
+        _activeStream = reader.svarint();
+        _playPosition = reader.string();
+        _page = static_cast<int>(reader.svarint());
+        _catalog = reader.catalog();
+    }
+    catch (const IpcError& ex) {
+        ERROR_LOG(1, "Ignoring invalid startup snapshot " << filename << ": " << ex.what());
+        *this = StartupSnapshot();
+        return false;
+    }
+    return true;
+}
+
+bool StartupSnapshot::save(const std::string& filename) const
+{
+    if (!_catalog) {
+        return false;
+    }
+    IpcWriter writer;
+    writer.raw(std::string_view(g_magic, sizeof(g_magic)));
+    writer.varint(FormatVersion);
+    writer.svarint(_activeStation);
+    writer.svarint(_activeStream);
+    writer.string(_playPosition);
+    writer.svarint(_page);
+    // the layout of IpcWriter::catalog(), with the streams of the active station only
+    writer.varint(0);
+    writer.varint(_catalog->stations().size());
+    for (const auto& station : _catalog->stations()) {
+        writer.station(*station);
+    }
+    for (const auto& station : _catalog->stations()) {
+        if (station->_id != _activeStation) {
+            writer.varint(0);
+            continue;
+        }
+        auto streams = _catalog->streams(station->_id);
+        writer.varint(streams->size());
+        for (const auto& stream : *streams) {
+            writer.stream(*stream);
+            if (stream->_id != _activeStream) {
+                writer.varint(0);
+                continue;
+            }
+            writer.varint(stream->_tracks.size());
+            for (const auto& track : stream->_tracks) {
+                writer.track(track);
+            }
+        }
+    }
+    std::error_code ec;
+    fs::create_directories(fs::path(filename).parent_path(), ec);
+    auto tmpFile = fs::path(filename + ".tmp");
+    {
+        fs::ofstream os(tmpFile, std::ios::binary | std::ios::trunc);
+        os.write(writer.data().data(), static_cast<std::streamsize>(writer.data().size()));
+        if (!os.flush()) {
+            ERROR_LOG(1, "Couldn't write startup snapshot " << tmpFile.string());
+            os.close();
+            fs::remove(tmpFile, ec);
+            return false;
+        }
+    }
+    fs::rename(tmpFile, fs::path(filename), ec);
+    if (ec) {
+        ERROR_LOG(1, "Couldn't store startup snapshot " << filename << ": " << ec.message());
+        return false;
+    }
+    DEBUG_LOG(2, "Wrote startup snapshot of " << writer.data().size() << " bytes to " << filename);
+    return true;
+}
+
+std::string StartupSnapshot::defaultFile()
+{
+    return (fs::path(dataPath()) / "startup.snapshot").string();
+}
+
+}  // namespace relive
@@ -0,0 +1,52 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "catalog.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// What a frontend showed when it quit, written on exit so the next start can render
+// its first frame without waiting for the database or the network. The catalog is a
+// small one: all stations, the streams of the active station and only the tracks of
+// the active stream. Its version is 0, so any catalog of a ReLiveDB replaces it.
+// The file is the Ipc encoding behind a magic and version, read from a mapping.
+//---------------------------------------------------------------------------------------
+class StartupSnapshot
+{
+public:
+    enum { FormatVersion = 1 };
+    StartupSnapshot() = default;
+    StartupSnapshot(std::shared_ptr<const Catalog> catalog, int64_t activeStation, int64_t activeStream, const std::string& playPosition, int page);
+
+    // after load() the small catalog, otherwise the one given, save() writes only its part
+    std::shared_ptr<const Catalog> catalog() const { return _catalog; }
+    int64_t activeStation() const { return _activeStation; }
+    int64_t activeStream() const { return _activeStream; }
+    // Keys::play_position at exit
+    const std::string& playPosition() const { return _playPosition; }
+    // the page of the frontend, opaque to the backend
+    int page() const { return _page; }
+
+    // false if there is no snapshot or it is damaged or from another format version
+    bool load(const std::string& filename);
+    bool save(const std::string& filename) const;
+    // in the data path of the app
+    static std::string defaultFile();
+
+private:
+    std::shared_ptr<const Catalog> _catalog;
+    int64_t _activeStation = 0;
+    int64_t _activeStream = 0;
+    std::string _playPosition;
+    int _page = 0;
+};
+
+}  // namespace relive
@@ -0,0 +1,392 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "syncdaemon.hpp"
+#include "logging.hpp"
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <list>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace relive {
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+sockaddr_un socketAddress(const std::string& path)
+{
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    if (path.size() >= sizeof(addr.sun_path)) {
+        throw std::runtime_error("Socket path too long: " + path);
+    }
+    std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+    return addr;
+}
+
+bool isServed(const std::string& path)
+{
+    auto addr = socketAddress(path);
+    auto fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return false;
+    }
+    auto rc = ::connect(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr));
+    ::close(fd);
+    return rc == 0;
+}
+
+}  // namespace
+
+struct SyncDaemon::impl
+{
+    struct Client
+    {
+        int _fd;
+        std::thread _thread;
+        std::atomic_bool _done{false};
+    };
+    impl(ReLiveDB& rdb, const Config& config)
+        : _rdb(rdb)
+        , _config(config)
+    {
+    }
+    void acceptLoop()
+    {
+        pollfd fds[2] = {{_listenFd, POLLIN, 0}, {_wakePipe[0], POLLIN, 0}};
+        while (!_shutdown) {
+            if (::poll(fds, 2, -1) < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ERROR_LOG3(SyncDaemon, 0, "poll() failed: " << std::strerror(errno));
+                break;
+            }
+            if (_shutdown || !(fds[0].revents & POLLIN)) {
+                continue;
+            }
+            auto fd = ::accept(_listenFd, nullptr, nullptr);
+            if (fd < 0) {
+                continue;
+            }
+            prepareSocket(fd);
+            std::lock_guard<std::mutex> lock{_clientsMutex};
+            reapClients();
+            if (_clients.size() >= size_t(_config.maxClients)) {
+                ERROR_LOG3(SyncDaemon, 0, "Rejecting a client, " << _clients.size() << " are connected");
+                ::close(fd);
+                continue;
+            }
+            _clients.emplace_back();
+            auto& client = _clients.back();
+            client._fd = fd;
+            client._thread = std::thread(&impl::serve, this, std::ref(client));
+            DEBUG_LOG3(SyncDaemon, 1, "Client connected, " << _clients.size() << " connected");
+        }
+    }
+    // joins the threads of disconnected clients, called with _clientsMutex held
+    void reapClients()
+    {
+        for (auto iter = _clients.begin(); iter != _clients.end();) {
+            if (iter->_done) {
+                iter->_thread.join();
+                ::close(iter->_fd);
+                iter = _clients.erase(iter);
+            }
+            else {
+                ++iter;
+            }
+        }
+    }
+    void serve(Client& client)
+    {
+        std::string request;
+        while (receiveFrame(client._fd, request)) {
+            IpcWriter reply;
+            try {
+                IpcReader reader(request);
+                handle(reader, reply);
+            }
+            catch (const IpcError& ex) {
+                ERROR_LOG3(SyncDaemon, 0, "Dropping client: " << ex.what());
+                break;
+            }
+            catch (const std::exception& ex) {
+                reply = IpcWriter();
+                reply.u8(Ipc::eError);
+                reply.string(ex.what());
+            }
+            if (!sendFrame(client._fd, reply.data())) {
+                break;
+            }
+        }
+        DEBUG_LOG3(SyncDaemon, 1, "Client disconnected");
+        client._done = true;
+    }
+    void handle(IpcReader& request, IpcWriter& reply)
+    {
+        switch (request.u8()) {
+            case Ipc::eHello: {
+                auto version = request.varint();
+                if (version != Ipc::ProtocolVersion) {
+                    throw std::runtime_error("Unsupported protocol version " + std::to_string(version));
+                }
+                reply.u8(Ipc::eOk);
+                reply.varint(Ipc::ProtocolVersion);
+                break;
+            }
+            case Ipc::eStatus: {
+                reply.u8(Ipc::eOk);
+                reply.varint(_rdb.catalog()->version());
+                reply.svarint(_rdb.getConfigValue(Keys::last_relive_sync, INT64_C(0)));
+                reply.u8(_syncing ? 1 : 0);
+                reply.varint(numClients());
+                break;
+            }
+            case Ipc::eCatalog: {
+                auto knownVersion = request.varint();
+                auto catalog = _rdb.catalog();
+                reply.u8(Ipc::eOk);
+                if (catalog->version() == knownVersion) {
+                    reply.u8(0);
+                }
+                else {
+                    reply.u8(1);
+                    reply.raw(*encodedCatalog(catalog));
+                }
+                break;
+            }
+            case Ipc::eSearchStreams: {
+                auto query = request.string();
+                auto limit = static_cast<int>(request.varint());
+                auto offset = static_cast<int>(request.varint());
+                auto streams = _rdb.searchStreams(query, limit, offset);
+                reply.u8(Ipc::eOk);
+                reply.varint(streams.size());
+                for (const auto& stream : streams) {
+                    reply.stream(stream);
+                }
+                break;
+            }
+            case Ipc::eSearchTracks: {
+                auto query = request.string();
+                auto filter = static_cast<ReLiveDB::FindTracksFilter>(request.u8());
+                auto limit = static_cast<int>(request.varint());
+                auto offset = static_cast<int>(request.varint());
+                auto tracks = _rdb.searchTracks(query, filter, limit, offset);
+                reply.u8(Ipc::eOk);
+                reply.varint(tracks.size());
+                for (const auto& track : tracks) {
+                    reply.svarint(track._trackId);
+                    reply.string(track._streamName);
+                    reply.string(track._artist);
+                    reply.string(track._trackName);
+                    reply.svarint(track._timestamp);
+                }
+                break;
+            }
+            case Ipc::eChat: {
+                auto streamId = request.svarint();
+                auto stream = _rdb.catalog()->stream(streamId);
+                if (!stream) {
+                    throw std::runtime_error("Unknown stream " + std::to_string(streamId));
+                }
+                auto chat = _rdb.fetchChat(*stream);
+                reply.u8(Ipc::eOk);
+                reply.chat(chat);
+                break;
+            }
+            case Ipc::eSync: {
+                auto force = request.u8() != 0;
+                requestSync(force);
+                reply.u8(Ipc::eOk);
+                break;
+            }
+            case Ipc::eSetPlayed: {
+                auto streamId = request.svarint();
+                auto stream = _rdb.catalog()->stream(streamId);
+                if (!stream) {
+                    throw std::runtime_error("Unknown stream " + std::to_string(streamId));
+                }
+                _rdb.setPlayed(*stream);
+                reply.u8(Ipc::eOk);
+                break;
+            }
+            default:
+                throw std::runtime_error("Unknown request");
+        }
+    }
+    // the encoding of the latest catalog is shared by all clients asking for it
+    std::shared_ptr<const std::string> encodedCatalog(const std::shared_ptr<const Catalog>& catalog)
+    {
+        std::lock_guard<std::mutex> lock{_encodedMutex};
+        if (!_encoded || _encodedVersion != catalog->version()) {
+            IpcWriter writer;
+            writer.catalog(*catalog);
+            _encoded = std::make_shared<std::string>(writer.data());
+            _encodedVersion = catalog->version();
+        }
+        return _encoded;
+    }
+    void requestSync(bool force)
+    {
+        {
+            std::lock_guard<std::mutex> lock{_syncMutex};
+            _syncRequested = true;
+            _forceSync = _forceSync || force;
+        }
+        _syncCond.notify_one();
+    }
+    void syncLoop()
+    {
+        // the first round runs right away, refreshStations() skips it if the last sync is recent
+        auto next = Clock::now();
+        std::unique_lock<std::mutex> lock{_syncMutex};
+        while (!_shutdown) {
+            if (!_syncRequested && Clock::now() < next) {
+                _syncCond.wait_until(lock, next);
+                continue;
+            }
+            auto force = _forceSync;
+            _syncRequested = _forceSync = false;
+            _syncing = true;
+            lock.unlock();
+            try {
+                _rdb.refreshStations(std::function<void()>(), force);
+            }
+            catch (const std::exception& ex) {
+                ERROR_LOG3(SyncDaemon, 0, "Sync failed: " << ex.what());
+            }
+            lock.lock();
+            _syncing = false;
+            next = Clock::now() + _config.syncInterval;
+        }
+    }
+    size_t numClients()
+    {
+        std::lock_guard<std::mutex> lock{_clientsMutex};
+        size_t result = 0;
+        for (const auto& client : _clients) {
+            result += client._done ? 0 : 1;
+        }
+        return result;
+    }
+    ReLiveDB& _rdb;
+    Config _config;
+    int _listenFd = -1;
+    int _wakePipe[2] = {-1, -1};
+    std::atomic_bool _shutdown{false};
+    std::atomic_bool _syncing{false};
+    std::thread _acceptThread;
+    std::thread _syncThread;
+    std::mutex _clientsMutex;
+    std::list<Client> _clients;
+    std::mutex _syncMutex;
+    std::condition_variable _syncCond;
+    bool _syncRequested = false;
+    bool _forceSync = false;
+    std::mutex _encodedMutex;
+    std::shared_ptr<const std::string> _encoded;
+    uint64_t _encodedVersion = 0;
+};
+
+SyncDaemon::SyncDaemon(ReLiveDB& rdb, const Config& config)
+    : _impl(std::make_unique<impl>(rdb, config))
+{
+}
+
+SyncDaemon::~SyncDaemon()
+{
+    stop();
+}
+
+void SyncDaemon::start()
+{
+    const auto& path = _impl->_config.socketPath;
+    auto addr = socketAddress(path);
+    if (isServed(path)) {
+        throw std::runtime_error("Another daemon serves " + path);
+    }
+    // a socket file left by a daemon that didn't stop cleanly
+    ::unlink(path.c_str());
+    _impl->_listenFd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (_impl->_listenFd < 0 || ::bind(_impl->_listenFd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) < 0 || ::chmod(path.c_str(), S_IRUSR | S_IWUSR) < 0 ||
+        ::listen(_impl->_listenFd, 16) < 0 || ::pipe(_impl->_wakePipe) < 0) {
+        auto error = std::string(std::strerror(errno));
+        stop();
+        throw std::runtime_error("Couldn't listen on " + path + ": " + error);
+    }
+    DEBUG_LOG(1, "Listening on " << path);
+    _impl->_acceptThread = std::thread(&impl::acceptLoop, _impl.get());
+    _impl->_syncThread = std::thread(&impl::syncLoop, _impl.get());
+}
+
+void SyncDaemon::stop()
+{
+    {
+        std::lock_guard<std::mutex> lock{_impl->_syncMutex};
+        _impl->_shutdown = true;
+    }
+    _impl->_syncCond.notify_all();
+    if (_impl->_wakePipe[1] >= 0) {
+        char wake = 0;
+        while (::write(_impl->_wakePipe[1], &wake, 1) < 0 && errno == EINTR) {
+        }
+    }
+    if (_impl->_acceptThread.joinable()) {
+        _impl->_acceptThread.join();
+    }
+    std::list<impl::Client> clients;
+    {
+        std::lock_guard<std::mutex> lock{_impl->_clientsMutex};
+        clients.splice(clients.end(), _impl->_clients);
+    }
+    // clients blocked in recv() see the connection closed, joined unlocked as they may ask for numClients()
+    for (auto& client : clients) {
+        ::shutdown(client._fd, SHUT_RDWR);
+    }
+    for (auto& client : clients) {
+        client._thread.join();
+        ::close(client._fd);
+    }
+    if (_impl->_syncThread.joinable()) {
+        _impl->_syncThread.join();
+    }
+    if (_impl->_listenFd >= 0) {
+        ::close(_impl->_listenFd);
+        ::unlink(_impl->_config.socketPath.c_str());
+        _impl->_listenFd = -1;
+    }
+    for (auto& fd : _impl->_wakePipe) {
+        if (fd >= 0) {
+            ::close(fd);
+            fd = -1;
+        }
+    }
+}
+
+void SyncDaemon::requestSync(bool force)
+{
+    _impl->requestSync(force);
+}
+
+size_t SyncDaemon::numClients() const
+{
+    return _impl->numClients();
+}
+
+}  // namespace relive
@@ -0,0 +1,48 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "ipcprotocol.hpp"
+#include "relivedb.hpp"
+#include <chrono>
+#include <memory>
+#include <string>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Headless backend serving a ReLiveDB to frontends over a Unix domain socket, see
+// Ipc for the protocol. It syncs on a schedule and on request of a client, so all
+// frontends share one sync and one warm catalog. Every client connection gets its
+// own thread, catalog replies are encoded once per catalog version.
+//---------------------------------------------------------------------------------------
+class SyncDaemon
+{
+public:
+    struct Config {
+        std::string socketPath = daemonSocketPath();
+        std::chrono::seconds syncInterval{3600};
+        int maxClients = 16;
+    };
+    SyncDaemon(ReLiveDB& rdb, const Config& config);
+    // stops, waits for a running sync to finish
+    ~SyncDaemon();
+    SyncDaemon(const SyncDaemon&) = delete;
+    SyncDaemon& operator=(const SyncDaemon&) = delete;
+
+    // binds the socket and starts serving, throws std::runtime_error if that fails
+    // or another daemon serves the socket already
+    void start();
+    void stop();
+    void requestSync(bool force = false);
+    size_t numClients() const;
+
+private:
+    struct impl;
+    std::unique_ptr<impl> _impl;
+};
+
+}  // namespace relive
@@ -197,11 +197,16 @@ std::string dataPath()
         fs::create_directories(g_dataPath);
         return g_dataPath;
     }
+    return appDataPath(appName());
+}
+
+std::string appDataPath(const std::string& appName)
+{
     std::string dir;
 #ifdef GHC_OS_WINDOWS
     auto localAppData = getSysEnv("localappdata");
     if (!localAppData.empty()) {
-		dir = (fs::path(localAppData) / appName()).string();
+		dir = (fs::path(localAppData) / appName).string();
 	}
     else {
         throw std::runtime_error("Need %localappdata% to create configuration directory!");
@@ -210,9 +215,9 @@ std::string dataPath()
     auto home = ::getenv("HOME");
     if(home) {
 #ifdef GHC_OS_MACOS
-        dir = fs::path(home) / "Library/Application Support" / appName();
+        dir = fs::path(home) / "Library/Application Support" / appName;
 #elif defined(GHC_OS_LINUX)
-        dir = fs::path(home) / ".local/share" / appName();
+        dir = fs::path(home) / ".local/share" / appName;
 #else
 #error "Unsupported OS!"
 #endif
@@ -21,6 +21,8 @@ std::string formattedDate(int64_t unixTimestamp);
 
 void dataPath(const std::string& path);
 std::string dataPath();
+// the default data path of the app with the given name
+std::string appDataPath(const std::string& appName);
 bool isInstanceRunning();
 
 std::string heuristicUtf8(const std::string& str);
@@ -0,0 +1,129 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "timeline.hpp"
+
+#include <algorithm>
+
+namespace relive {
+
+// index of the last entry at or before t, -1 if all are later
+static int lastAtOrBefore(const std::vector<int64_t>& times, int64_t t)
+{
+    return static_cast<int>(std::upper_bound(times.begin(), times.end(), t) - times.begin()) - 1;
+}
+
+void Timeline::setTracks(const std::vector<Track>& tracks)
+{
+    _trackTimes.clear();
+    _trackIds.clear();
+    _trackTimes.reserve(tracks.size());
+    _trackIds.reserve(tracks.size());
+    for (const auto& track : tracks) {
+        _trackTimes.push_back(track._time);
+        _trackIds.push_back(track._id);
+    }
+}
+
+void Timeline::setChat(const ChatLog& chat)
+{
+    _chatTimes.clear();
+    _chatTimes.reserve(chat.size());
+    for (size_t i = 0; i < chat.size(); ++i) {
+        _chatTimes.push_back(chat.time(i));
+    }
+    resetChatHeights(0.0f);
+}
+
+void Timeline::setChatHeights(const std::vector<float>& heights)
+{
+    _chatHeights.assign(_chatTimes.size(), 0.0f);
+    std::copy_n(heights.begin(), (std::min)(heights.size(), _chatHeights.size()), _chatHeights.begin());
+    // linear construction, every node passes its sum on to its parent
+    _chatHeightTree.assign(_chatHeights.size() + 1, 0.0f);
+    for (size_t i = 1; i < _chatHeightTree.size(); ++i) {
+        _chatHeightTree[i] += _chatHeights[i - 1];
+        auto parent = i + (i & (~i + 1));
+        if (parent < _chatHeightTree.size()) {
+            _chatHeightTree[parent] += _chatHeightTree[i];
+        }
+    }
+}
+
+void Timeline::resetChatHeights(float height)
+{
+    setChatHeights(std::vector<float>(_chatTimes.size(), height));
+}
+
+void Timeline::setChatHeight(int index, float height)
+{
+    if (index < 0 || static_cast<size_t>(index) >= _chatHeights.size()) {
+        return;
+    }
+    auto delta = height - _chatHeights[index];
+    _chatHeights[index] = height;
+    for (auto i = static_cast<size_t>(index) + 1; i < _chatHeightTree.size(); i += i & (~i + 1)) {
+        _chatHeightTree[i] += delta;
+    }
+}
+
+void Timeline::clear()
+{
+    _trackTimes.clear();
+    _trackIds.clear();
+    _chatTimes.clear();
+    _chatHeights.clear();
+    _chatHeightTree.clear();
+}
+
+int Timeline::trackIndexAt(int64_t t) const
+{
+    return lastAtOrBefore(_trackTimes, t);
+}
+
+int64_t Timeline::trackIdAt(int64_t t) const
+{
+    auto index = trackIndexAt(t);
+    return index >= 0 ? _trackIds[index] : 0;
+}
+
+int Timeline::chatIndexAt(int64_t t) const
+{
+    return lastAtOrBefore(_chatTimes, t);
+}
+
+float Timeline::chatHeightUpTo(int index) const
+{
+    if (index < 0 || _chatHeights.empty()) {
+        return 0.0f;
+    }
+    float sum = 0.0f;
+    for (auto i = (std::min)(static_cast<size_t>(index) + 1, _chatHeights.size()); i > 0; i -= i & (~i + 1)) {
+        sum += _chatHeightTree[i];
+    }
+    return sum;
+}
+
+int Timeline::chatIndexAtHeight(float y) const
+{
+    if (_chatHeights.empty()) {
+        return -1;
+    }
+    // descend the tree, count ends up as the number of messages that end above y
+    size_t count = 0;
+    size_t step = 1;
+    while (step * 2 <= _chatHeights.size()) {
+        step *= 2;
+    }
+    for (; step; step /= 2) {
+        if (count + step <= _chatHeights.size() && _chatHeightTree[count + step] <= y) {
+            count += step;
+            y -= _chatHeightTree[count];
+        }
+    }
+    return static_cast<int>((std::min)(count, _chatHeights.size() - 1));
+}
+
+}  // namespace relive
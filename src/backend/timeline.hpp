@@ -0,0 +1,61 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#pragma once
+
+#include "chatlog.hpp"
+#include "rldata.hpp"
+#include <cstdint>
+#include <vector>
+
+namespace relive {
+
+//---------------------------------------------------------------------------------------
+// Play time lookups for the tracks and chat of one stream. Start times are kept in
+// sorted arrays apart from the objects, so the questions a frontend asks every
+// time the play position moves are binary searches over contiguous memory. Chat
+// message heights live in a Fenwick tree, so single rows can be re-measured and
+// the row at a scroll offset found in O(log n) for virtualized rendering.
+//---------------------------------------------------------------------------------------
+class Timeline
+{
+public:
+    Timeline() = default;
+
+    // tracks and chat messages are expected in time order as they come from the backend
+    void setTracks(const std::vector<Track>& tracks);
+    void setChat(const ChatLog& chat);
+    // rendered height of every chat message, in the order of setChat()
+    void setChatHeights(const std::vector<float>& heights);
+    // give all messages the same (estimated) height, e.g. before measuring lazily
+    void resetChatHeights(float height);
+    void setChatHeight(int index, float height);
+    void clear();
+
+    // index of the track playing at time t, -1 before the first one
+    int trackIndexAt(int64_t t) const;
+    // id of the track playing at time t, 0 before the first one
+    int64_t trackIdAt(int64_t t) const;
+    // index of the last chat message posted at or before t, -1 if there is none
+    int chatIndexAt(int64_t t) const;
+    // summed height of the chat messages up to and including index
+    float chatHeightUpTo(int index) const;
+    float chatHeightAt(int64_t t) const { return chatHeightUpTo(chatIndexAt(t)); }
+    float totalChatHeight() const { return chatHeightUpTo(static_cast<int>(_chatTimes.size()) - 1); }
+    // index of the chat message covering the vertical offset y, -1 if there are none
+    int chatIndexAtHeight(float y) const;
+
+    size_t numTracks() const { return _trackTimes.size(); }
+    size_t numChatMessages() const { return _chatTimes.size(); }
+
+private:
+    std::vector<int64_t> _trackTimes;
+    std::vector<int64_t> _trackIds;
+    std::vector<int64_t> _chatTimes;
+    std::vector<float> _chatHeights;
+    std::vector<float> _chatHeightTree;  // Fenwick tree over _chatHeights, one based
+};
+
+}  // namespace relive
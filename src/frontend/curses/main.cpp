@@ -3,10 +3,13 @@
 // relive-client - A C++ implementation of the reLive protocol and an sqlite backend
 // Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
 //---------------------------------------------------------------------------------------
+#include <backend/chatservice.hpp>
+#include <backend/daemonclient.hpp>
 #include <backend/logging.hpp>
 #include <backend/relivedb.hpp>
 #include <backend/player.hpp>
 #include <backend/system.hpp>
+#include <backend/timeline.hpp>
 #include <ghc/cui.hpp>
 #include <ghc/options.hpp>
 #include <version/version.hpp>
@@ -15,6 +18,7 @@
 #elif defined(RELIVE_MINIAUDIO_BACKEND)
 #include <mackron/miniaudio.h>
 #endif
+#include <algorithm>
 #include <atomic>
 #include <csignal>
 #include <iostream>
@@ -60,7 +64,7 @@ public:
     ~StationsModel() override {}
     int size() const override
     {
-        return _stations.size();
+        return _catalog ? _catalog->stations().size() : 0;
     }
     std::vector<ghc::cui::cell> line(int index, int width) const override
     {
@@ -70,20 +74,20 @@ public:
             result.emplace_back(ghc::cui::cell::eRight, 7, 0, "Streams");
             result.emplace_back(ghc::cui::cell::eLeft, 40, 0, "URL");
         }
-        else if (index < _stations.size()) {
-            const Station& station = _stations[index];
+        else if (index < size()) {
+            const Station& station = *_catalog->stations()[index];
             int attr = 0;
             if(station._id == _activeStation) {
                 attr = A_BOLD;
             }
             result.emplace_back(ghc::cui::cell::eLeft, 30, attr, station._name);
-            result.emplace_back(ghc::cui::cell::eRight, 7, attr, std::to_string(station._streams.size()));
+            result.emplace_back(ghc::cui::cell::eRight, 7, attr, std::to_string(_catalog->streams(station._id)->size()));
             result.emplace_back(ghc::cui::cell::eLeft, 40, attr, station._webSiteUrl);
         }
         return result;
     }
     
-    std::vector<Station> _stations;
+    std::shared_ptr<const Catalog> _catalog;
     int64_t _activeStation = 0;
 };
 
@@ -93,7 +97,7 @@ public:
     ~StreamsModel() override {}
     int size() const override
     {
-        return _streams.size();
+        return _streams ? _streams->size() : 0;
     }
     std::vector<ghc::cui::cell> line(int index, int width) const override
     {
@@ -106,8 +110,8 @@ public:
             result.emplace_back(ghc::cui::cell::eRight,   8, 0, "Duration");
             result.emplace_back(ghc::cui::cell::eCenter,  4, 0, "Chat");
         }
-        if(index < _streams.size()) {
-            const Stream& stream = _streams[index];
+        if(index >= 0 && index < size()) {
+            const Stream& stream = *(*_streams)[index];
             int attr = 0;
             if(stream._id == _activeStream) {
                 attr = A_BOLD;
@@ -122,7 +126,7 @@ public:
         return result;
     }
     
-    std::vector<Stream> _streams;
+    Catalog::StreamListPtr _streams;
     int64_t _activeStream = 0;
 };
 
@@ -132,7 +136,12 @@ public:
     ~TracksModel() override {}
     int size() const override
     {
-        return _tracks.size();
+        return tracks().size();
+    }
+    const std::vector<Track>& tracks() const
+    {
+        static const std::vector<Track> noTracks;
+        return _stream ? _stream->_tracks : noTracks;
     }
     std::vector<ghc::cui::cell> line(int index, int width) const override
     {
@@ -152,8 +161,8 @@ public:
             result.emplace_back(ghc::cui::cell::eRight,  8, 0, "Duration");
             result.emplace_back(ghc::cui::cell::eCenter, 4, 0, "Type");
         }
-        if(index < _tracks.size()) {
-            const Track& track = _tracks[index];
+        if(index >= 0 && index < size()) {
+            const Track& track = tracks()[index];
             int attr = 0;
             if(track._id == _activeTrack) {
                 attr = A_BOLD;
@@ -169,8 +178,7 @@ public:
         return result;
     }
     
-    std::shared_ptr<Stream> _stream;
-    std::vector<Track> _tracks;
+    Catalog::StreamPtr _stream;
     int64_t _activeTrack = 0;
 };
 
@@ -186,43 +194,45 @@ public:
     {
         std::vector<ghc::cui::cell> result;
         if(index >= 0 && index < _chat.size()) {
-            const auto& msg = _chat[index];
-            result.emplace_back(ghc::cui::cell::eLeft, 10, 0, "[" + formattedDuration(msg._time) + "]");
-            switch(msg._type) {
+            auto first = "*" + std::string(_chat.string(index, 0));
+            auto last = std::string(_chat.lastString(index));
+            auto reason = _chat.numStrings(index) > 1 ? "(" + std::string(_chat.string(index, 1)) + ")" : std::string();
+            result.emplace_back(ghc::cui::cell::eLeft, 10, 0, "[" + formattedDuration(_chat.time(index)) + "]");
+            switch(_chat.type(index)) {
                 case ChatMessage::eMe:
                 case ChatMessage::eMode:
                 case ChatMessage::eKick:
-                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, "*"+msg._strings.front());
-                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD,  msg._strings.back());
+                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, first);
+                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, last);
                     break;
                 case ChatMessage::eNick:
-                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, "*"+msg._strings.front());
-                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, "is now known as " + msg._strings.back());
+                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, first);
+                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, "is now known as " + last);
                     break;
                 case ChatMessage::eJoin:
-                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, "*"+msg._strings.front());
+                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, first);
                     result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, "has joined the channel");
                     break;
                 case ChatMessage::eLeave:
-                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, "*"+msg._strings.front());
-                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, "has left the channel " + (msg._strings.size()>1 ? "("+msg._strings[1]+")":""));
+                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, first);
+                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, "has left the channel " + reason);
                     break;
                 case ChatMessage::eQuit:
-                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, "*"+msg._strings.front());
-                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, "has quit " + (msg._strings.size()>1 ? "("+msg._strings[1]+")":""));
+                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, first);
+                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, "has quit " + reason);
                     break;
                 case ChatMessage::eTopic:
-                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, "*"+msg._strings.front());
-                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, "has changed the topic to: " + msg._strings.back());
+                    result.emplace_back(ghc::cui::cell::eRight, _nickLen, A_BOLD, first);
+                    result.emplace_back(ghc::cui::cell::eLeft, 0, A_BOLD, "has changed the topic to: " + last);
                     break;
                 default:
-                    if(msg._strings.size() == 1) {
+                    if(_chat.numStrings(index) == 1) {
                         result.emplace_back(ghc::cui::cell::eRight, _nickLen, 0, "");
                     }
                     else {
-                        result.emplace_back(ghc::cui::cell::eRight, _nickLen, 0, msg._strings.front()+":");
+                        result.emplace_back(ghc::cui::cell::eRight, _nickLen, 0, std::string(_chat.string(index, 0))+":");
                     }
-                    result.emplace_back(ghc::cui::cell::eLeft, 0, 0, msg._strings.back());
+                    result.emplace_back(ghc::cui::cell::eLeft, 0, 0, last);
                     break;
             }
         }
@@ -231,9 +241,10 @@ public:
     void rescan()
     {
         int maxNick = 8;
-        for(const auto& msg : _chat) {
-            if(!msg._strings.empty() && msg._type != ChatMessage::eUnknown && msg._strings.front().size() > maxNick) {
-                auto l = ghc::cui::detail::utf8Length(msg._strings.front());
+        for(size_t i = 0; i < _chat.size(); ++i) {
+            auto nick = _chat.string(i, 0);
+            if(_chat.numStrings(i) && _chat.type(i) != ChatMessage::eUnknown && nick.size() > maxNick) {
+                auto l = ghc::cui::detail::utf8Length(std::string(nick));
                 if(l > maxNick) {
                     maxNick = l;
                 }
@@ -241,7 +252,7 @@ public:
         }
         _nickLen = maxNick + 1;
     }
-    std::vector<ChatMessage> _chat;
+    ChatLog _chat;
     int _nickLen = 10;
 };
 
@@ -252,6 +263,7 @@ public:
     ReLiveCUI(int argc, char* argv[], ghc::options& parser)
         : ghc::cui::application(argc, argv)
         , _rdb([&](int percent){ progress(percent); })
+        , _chatService(_rdb)
         , _lastFetch(0)
         , _activeMain(eNone)
         , _needsRefresh(false)
@@ -261,6 +273,14 @@ public:
         std::signal(SIGINT, sigintHandler);
         _title = " Stations List ";
         calculatePlayBar();
+        _player.mediaCacheSize(_rdb.getConfigValue(Keys::media_cache_size, _player.mediaCacheSize()));
+        if(_daemon.connect()) {
+            // the daemon keeps the catalog in sync, the own database is only used for config
+            DEBUG_LOG(1, "Using the sync daemon at " << daemonSocketPath());
+            _useDaemon = true;
+            _chatService.useDaemon(daemonSocketPath());
+        }
+        _catalogSubscription = _rdb.subscribeCatalog([this](std::shared_ptr<const Catalog>) { _catalogChanged = true; });
         fetchStations();
         auto defaultStation = _rdb.getConfigValue(Keys::default_station, std::string());
         if(!selectStation(defaultStation)) {
@@ -271,6 +291,11 @@ public:
         ::refresh();
     }
 
+    ~ReLiveCUI()
+    {
+        _rdb.unsubscribeCatalog(_catalogSubscription);
+    }
+
     bool validTerminal()
     {
         return width() >= 40 && height() >= 10;
@@ -279,12 +304,12 @@ public:
     bool selectStation(const std::string& name)
     {
         DEBUG_LOG(1, "Switching to default station '" << name << "'");
-        for(const auto& station : _stationsModel._stations) {
-            DEBUG_LOG(2, "comparing to '" << station._name << "'");
-            if(station._name == name) {
-                DEBUG_LOG(2, "found '" << station._name << "'");
-                _stationsModel._activeStation = station._id;
-                _streamsModel._streams = station._streams;
+        for(const auto& station : _stationsModel._catalog->stations()) {
+            DEBUG_LOG(2, "comparing to '" << station->_name << "'");
+            if(station->_name == name) {
+                DEBUG_LOG(2, "found '" << station->_name << "'");
+                _stationsModel._activeStation = station->_id;
+                _streamsModel._streams = _stationsModel._catalog->streams(station->_id);
                 _tracksModel.select(0);
                 updateMainWindow(eStreamList);
                 return true;
@@ -303,32 +328,39 @@ public:
     void on_idle() override
     {
         static int lastPlayPos = 0;
-        if(currentTime() - _lastFetch > 3600) {
+        if(_useDaemon) {
+            // the daemon syncs on its own, only its catalog is polled
+            if(currentTime() - _lastFetch > 10) {
+                _lastFetch = currentTime();
+                if(currentCatalog() != _stationsModel._catalog) {
+                    fetchStations();
+                    updateMainWindow(_activeMain, true);
+                }
+            }
+        }
+        else if(currentTime() - _lastFetch > 3600) {
             _rdb.refreshStations([this](){ yield(); });
             fetchStations();
             updateMainWindow(_activeMain, true);
             _lastFetch = currentTime();
         }
+        else if(_catalogChanged) {
+            fetchStations();
+            _needsRefresh = true;
+        }
+        ChatService::Result chat;
+        if(_chatService.poll(chat) && _tracksModel._stream && chat._streamId == _tracksModel._stream->_id) {
+            setChat(std::move(chat._chat));
+        }
         auto playTime = _player.playTime();
         if(playTime != lastPlayPos) {
             lastPlayPos = playTime;
             auto stream = _player.currentStream();
             if(stream) {
                 if(_tracksModel._stream && stream->_id == _tracksModel._stream->_id) {
-                    // find active track
-                    int64_t lastId = 0;
-                    for(const auto& track : _tracksModel._tracks) {
-                        if(track._time > playTime) {
-                            if(_tracksModel._activeTrack != lastId) {
-                                _tracksModel._activeTrack = lastId;
-                                _needsRefresh = true;
-                            }
-                            break;
-                        }
-                        lastId = track._id;
-                    }
-                    if(_tracksModel._activeTrack != lastId) {
-                        _tracksModel._activeTrack = lastId;
+                    auto activeId = _timeline.trackIdAt(playTime);
+                    if(_tracksModel._activeTrack != activeId) {
+                        _tracksModel._activeTrack = activeId;
                         _needsRefresh = true;
                     }
                 }
@@ -338,16 +370,7 @@ public:
                         _needsRefresh = true;
                     }
                 }
-                int chatPos = -1;
-                for(const auto& msg : _chatModel._chat) {
-                    if(msg._time <= playTime) {
-                        ++chatPos;
-                    }
-                    else {
-                        break;
-                    }
-                }
-                _chatModel.position(chatPos);
+                _chatModel.position(_timeline.chatIndexAt(playTime));
                 if(_activeMain == eChat) {
                     _needsRefresh = true;
                 }
@@ -360,6 +383,17 @@ public:
         }
     }
     
+    void setChat(ChatLog chat)
+    {
+        _chatModel._chat = std::move(chat);
+        _timeline.setChat(_chatModel._chat);
+        _chatModel.rescan();
+        _chatModel.position(_timeline.chatIndexAt(_player.playTime()));
+        if(_activeMain == eChat) {
+            _needsRefresh = true;
+        }
+    }
+
     void on_mouse(const ::MEVENT& event) override
     {
     }
@@ -383,43 +417,41 @@ public:
                     int selected = std::dynamic_pointer_cast<ghc::cui::list_view>(_main)->selected();
                     switch (_activeMain) {
                         case eStationList: {
-                            if(selected >= 0 && selected < _stationsModel._stations.size()) {
-                                auto& station = _stationsModel._stations[selected];
-                                _stationsModel._activeStation = station._id;
-                                _streamsModel._streams = station._streams;
+                            if(selected >= 0 && selected < _stationsModel.size()) {
+                                auto& station = _stationsModel._catalog->stations()[selected];
+                                _stationsModel._activeStation = station->_id;
+                                _streamsModel._streams = _stationsModel._catalog->streams(station->_id);
                                 _tracksModel.select(0);
                                 updateMainWindow(eStreamList);
                             }
                             break;
                         }
                         case eStreamList: {
-                            if(selected >= 0 && selected < _streamsModel._streams.size()) {
-                                auto stream = _streamsModel._streams[selected];
-                                _streamsModel._activeStream = stream._id;
-                                _rdb.deepFetch(stream);
-                                _tracksModel._stream = std::make_shared<Stream>(stream);
-                                _tracksModel._tracks = stream._tracks;
+                            if(selected >= 0 && selected < _streamsModel.size()) {
+                                auto stream = (*_streamsModel._streams)[selected];
+                                _streamsModel._activeStream = stream->_id;
+                                _tracksModel._stream = stream;
+                                _timeline.setTracks(stream->_tracks);
                                 _tracksModel.select(0);
                                 _tracksModel._activeTrack = 0;
                                 updateMainWindow(eTrackList);
                                 // play
-                                _rdb.setPlayed(stream);
-                                _player.setSource(stream);
+                                setPlayed(*stream);
+                                _player.setSource(*stream);
                                 _player.play();
-                                _chatModel._chat = _rdb.fetchChat(stream);
-                                _chatModel.rescan();
+                                // the chat is loaded in the background and picked up in on_idle()
+                                setChat(ChatLog());
+                                _chatService.load(*stream);
                             }
                             break;
                         }
                         case eTrackList: {
-                            if(selected >= 0 && selected < _tracksModel._tracks.size()) {
-                                auto track = _tracksModel._tracks[selected];
-                                _rdb.deepFetch(track);
-                                _rdb.deepFetch(*track._stream);
+                            if(selected >= 0 && selected < _tracksModel.size()) {
+                                const auto& track = _tracksModel.tracks()[selected];
                                 // play
-                                _rdb.setPlayed(*track._stream);
-                                _player.setSource(track);
-                                _player.play();
+                                setPlayed(*_tracksModel._stream);
+                                _player.setSource(*_tracksModel._stream);
+                                _player.seekTo(track._time);
                             }
                             break;
                         }
@@ -571,9 +603,16 @@ public:
 
     void fetchStations()
     {
-        _stationsModel._stations = _rdb.fetchStations();
-        for(auto& station : _stationsModel._stations) {
-            _rdb.deepFetch(station);
+        _catalogChanged = false;
+        auto catalog = currentCatalog();
+        // the selection stays, but uses the objects of the new snapshot
+        _stationsModel._catalog = catalog;
+        _streamsModel._streams = catalog->streams(_stationsModel._activeStation);
+        if(_tracksModel._stream) {
+            if(auto stream = catalog->stream(_tracksModel._stream->_id)) {
+                _tracksModel._stream = stream;
+                _timeline.setTracks(stream->_tracks);
+            }
         }
     }
     
@@ -729,8 +768,44 @@ private:
         _progress = percent;
         _needsRefresh = true;
     }
+    std::shared_ptr<const Catalog> currentCatalog()
+    {
+        if(_useDaemon) {
+            try {
+                return _daemon.catalog();
+            }
+            catch(const IpcError& ex) {
+                ERROR_LOG(0, "Lost the sync daemon, continuing with the own database: " << ex.what());
+                _daemon.disconnect();
+                _useDaemon = false;
+                // sync on our own right away
+                _lastFetch = 0;
+            }
+        }
+        return _rdb.catalog();
+    }
+    void setPlayed(const Stream& stream)
+    {
+        if(_useDaemon) {
+            try {
+                _daemon.setPlayed(stream._id);
+                // pick up the changed catalog with the next poll
+                _lastFetch = 0;
+                return;
+            }
+            catch(const IpcError& ex) {
+                ERROR_LOG(0, "Couldn't mark stream " << stream._id << " as played by the sync daemon: " << ex.what());
+            }
+        }
+        _rdb.setPlayed(stream);
+    }
     std::mutex _mutex;
     ReLiveDB _rdb;
+    DaemonClient _daemon;  // serves catalog and chat while a sync daemon runs
+    bool _useDaemon = false;
+    std::atomic_bool _catalogChanged{false};
+    int _catalogSubscription = 0;
+    ChatService _chatService;
     int64_t _lastFetch;
     Player _player;
     ghc::cui::window_ptr _main;
@@ -738,6 +813,7 @@ private:
     StreamsModel _streamsModel;
     TracksModel _tracksModel;
     ChatModel _chatModel;
+    Timeline _timeline;  // tracks of the track list and the chat
     std::string _title;
     ActiveMainView _activeMain;
     std::atomic_bool _needsRefresh;
@@ -810,6 +886,13 @@ int main(int argc, char* argv[])
 #endif
             exit(0);
         });
+        parser.onOpt({"-c!", "--media-cache!"}, "<MiB>\tSet the size of the on-disk media cache in MiB, 0 keeps nothing, default is 512.", [&](const std::string& str){
+            ReLiveDB db;
+            auto bytes = int64_t(std::max(0, std::stoi(str))) * 1024 * 1024;
+            db.setConfigValue(Keys::media_cache_size, bytes);
+            std::cout << "Set the media cache size to " << bytes / (1024 * 1024) << " MiB." << std::endl;
+            exit(0);
+        });
         parser.onOpt({"-s?", "--default-station?"}, "[<name>]\tSet the default station to switch to on startup, only significant part of the name is needed. Without a parameter, this resets to starting on station screen.", [&](const std::string& str){
             ReLiveDB db;
             if(str.empty()) {
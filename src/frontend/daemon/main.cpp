@@ -0,0 +1,86 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include <backend/logging.hpp>
+#include <backend/relivedb.hpp>
+#include <backend/syncdaemon.hpp>
+#include <backend/system.hpp>
+#include <ghc/options.hpp>
+#include <version/version.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <thread>
+
+using namespace relive;
+
+#define RELIVE_APP_NAME "reLiveD"
+
+namespace {
+
+static std::atomic_bool g_quit{false};
+
+static void quitHandler(int)
+{
+    g_quit = true;
+}
+
+}
+
+int main(int argc, char* argv[])
+{
+    try {
+        relive::setAppName(RELIVE_APP_NAME);
+        SyncDaemon::Config config;
+        std::string frontend = "reLiveG";
+        ghc::options parser(argc, argv);
+        parser.onOpt({"-?", "-h", "--help"}, "Output this help text", [&](const std::string&){
+            parser.usage(std::cout);
+            exit(0);
+        });
+        parser.onOpt({"-v", "--version"}, "Show program version and exit.", [&](const std::string&){
+            std::cout << "reLiveD " << RELIVE_VERSION_STRING_LONG << std::endl;
+            exit(0);
+        });
+        parser.onOpt({"-s!", "--socket!"}, "<path>\tListen on the given Unix domain socket instead of " + daemonSocketPath() + ".", [&](const std::string& str){
+            config.socketPath = str;
+        });
+        parser.onOpt({"-i!", "--interval!"}, "<minutes>\tCheck for new streams every <minutes> minutes, default is 60.", [&](const std::string& str){
+            config.syncInterval = std::chrono::minutes(std::max(1, std::stoi(str)));
+        });
+        parser.onOpt({"-f!", "--frontend!"}, "<name>\tSync the database of the frontend <name> (reLiveG or reLiveCUI), default is reLiveG.", [&](const std::string& str){
+            frontend = str;
+        });
+        parser.parse();
+
+        // the frontends find the catalog the daemon syncs in their own database
+        relive::dataPath(relive::appDataPath(frontend));
+        relive::LogManager::setOutputFile(relive::dataPath() + "/" + appName() + ".log");
+        relive::LogManager::instance()->defaultLevel(1);
+        if(relive::isInstanceRunning()) {
+            throw std::runtime_error("Instance already running.");
+        }
+
+        std::signal(SIGINT, quitHandler);
+        std::signal(SIGTERM, quitHandler);
+        ReLiveDB rdb;
+        SyncDaemon daemon(rdb, config);
+        daemon.start();
+        std::cout << "reLiveD serving " << relive::dataPath() << " on " << config.socketPath << std::endl;
+        while(!g_quit) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        }
+        std::cout << "Stopping..." << std::endl;
+        // the daemon waits for its sync, the journal keeps what is left for the next start
+        rdb.cancelSync();
+    }
+    catch(std::exception& ex) {
+        std::cerr << "Error: " << ex.what() << std::endl;
+        exit(1);
+    }
+    return 0;
+}
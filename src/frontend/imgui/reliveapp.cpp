@@ -19,6 +19,8 @@
 #include <ghc/options.hpp>
 #include <version/version.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <regex>
 #include <set>
@@ -27,11 +29,20 @@ using namespace std::literals;
 
 #define RELIVE_APP_NAME "reLiveG"
 
+namespace {
+
+// close enough to the process start for the time to the first frame
+const auto g_startTime = std::chrono::steady_clock::now();
+
+}
+
 namespace relive {
 
 ReLiveApp::ReLiveApp()
     : ImGui::Application(RELIVE_APP_NAME " " RELIVE_VERSION_STRING_LONG " - \u00a9 2020 by Gulrak", "reLiveG")
     , _rdb([&](int percent) { progress(percent); })
+    , _search(_rdb)
+    , _chatService(_rdb)
     , _lastFetch(0)
     , _activeStation(0)
     , _activeStream(0)
@@ -40,6 +51,25 @@ ReLiveApp::ReLiveApp()
     const GLFWvidmode* mode = glfwGetVideoMode(glfwGetPrimaryMonitor());
     setWindowSize(static_cast<unsigned>(mode->width * 0.5), static_cast<unsigned>(mode->height * 0.5));
     // LogManager::instance()->defaultLevel(1);
+    // only flag the change here, the ui picks up the new snapshot on its own thread
+    _catalogSubscription = _rdb.subscribeCatalog([this](std::shared_ptr<const Catalog>) {
+        _catalogChanged = true;
+        _needsRefresh = true;
+    });
+}
+
+ReLiveApp::~ReLiveApp()
+{
+    if (_syncThread.joinable()) {
+        // only the running requests are waited for, the next start resumes the rest
+        DEBUG_LOG(1, "Cancelling the running sync...");
+        _rdb.cancelSync();
+        _syncThread.join();
+    }
+    // streams played since the last poll go to the shared database directly
+    _useDaemon = false;
+    sendPlayed();
+    _rdb.unsubscribeCatalog(_catalogSubscription);
 }
 
 void ReLiveApp::progress(int percent)
@@ -57,37 +87,35 @@ ImU32 ReLiveApp::colorForString(const std::string& str)
     return ImGui::ColorConvertFloat4ToU32(ImVec4(r, g, b, 255));
 }
 
-std::string ReLiveApp::generateMessage(const ChatMessage& msg)
+std::string ReLiveApp::generateMessage(const ChatLog& chat, int index)
 {
-    switch (msg._type) {
-        case ChatMessage::eMe:
-        case ChatMessage::eMode:
-        case ChatMessage::eKick:
-            return msg._strings.back();
+    auto reason = [&]() { return chat.numStrings(index) > 1 ? "(" + std::string(chat.string(index, 1)) + ")" : std::string(); };
+    switch (chat.type(index)) {
         case ChatMessage::eNick:
-            return "is now known as " + msg._strings.back();
+            return "is now known as " + std::string(chat.lastString(index));
         case ChatMessage::eJoin:
             return "has joined the channel";
         case ChatMessage::eLeave:
-            return "has left the channel " + (msg._strings.size() > 1 ? "(" + msg._strings[1] + ")" : "");
+            return "has left the channel " + reason();
         case ChatMessage::eQuit:
-            return "has quit " + (msg._strings.size() > 1 ? "(" + msg._strings[1] + ")" : "");
+            return "has quit " + reason();
         case ChatMessage::eTopic:
-            return "has changed the topic to: " + msg._strings.back();
+            return "has changed the topic to: " + std::string(chat.lastString(index));
         default:
-            return msg._strings.back();
+            return std::string(chat.lastString(index));
     }
 }
 
 void ReLiveApp::scanForMaxNickSize()
 {
     ZoneScopedN("scanForMaxNickSize");
-    std::set<std::string> nicks;
-    for (const auto& msg : _chat) {
-        auto nick = msg.nick();
+    std::set<std::string_view> nicks;
+    for (size_t i = 0; i < _chat.size(); ++i) {
+        auto nick = _chat.nick(i);
         if (!nick.empty() && !nicks.count(nick)) {
             nicks.insert(nick);
-            auto l = ImGui::CalcTextSize(msg._strings.front().c_str()).x;
+            auto first = _chat.string(i, 0);
+            auto l = ImGui::CalcTextSize(first.data(), first.data() + first.size()).x;
             if (l > _maxNickSize) {
                 _maxNickSize = l;
             }
@@ -98,49 +126,76 @@ void ReLiveApp::scanForMaxNickSize()
 void ReLiveApp::recalcMessageSize()
 {
     ZoneScopedN("recalcMessageSize");
-    _messageSizes.clear();
-    _messageSizes.reserve(_chat.size());
-    _chatLogHeight = 0;
+    // rows are measured lazily once they get visible, until then each counts as one line
     _chatMessageWidth = _width - _maxNickSize - 130;
-    for (const ChatMessage& msg : _chat) {
-        auto text = generateMessage(msg);
-        _messageSizes.push_back(ImGui::CalcTextSize(text.c_str(), nullptr, false, _chatMessageWidth));
-        _chatLogHeight += _messageSizes.back().y;
-    }
+    ++_chatLayout;
+    _timeline.resetChatHeights(ImGui::GetTextLineHeight());
+    _chatLogHeight = _timeline.chatHeightUpTo(_chatPosition);
 }
 
-void ReLiveApp::fetchStreams(const Station& station)
+const ReLiveApp::ChatLine& ReLiveApp::chatLine(int index)
 {
-    if (!station._streams.empty()) {
-        _streams = station._streams;
-        _rdb.deepFetch(_streams.front(), true);
-        auto parent = _streams.front()._station;
-        for (auto& stream : _streams) {
-            stream._station = parent;
+    auto& line = _chatLines[index];
+    if (line._time.empty()) {
+        line._time = formattedDuration(_chat.time(index));
+        line._text = generateMessage(_chat, index);
+        if (_chat.hasNick(index)) {
+            line._nick = _chat.nick(index);
+            line._nickWidth = ImGui::CalcTextSize(line._nick.c_str()).x;
         }
     }
+    if (line._layout != _chatLayout) {
+        line._layout = _chatLayout;
+        _timeline.setChatHeight(index, ImGui::CalcTextSize(line._text.c_str(), nullptr, false, _chatMessageWidth).y);
+    }
+    return line;
+}
+
+const std::vector<Track>& ReLiveApp::tracks() const
+{
+    static const std::vector<Track> noTracks;
+    return _selectedStream ? _selectedStream->_tracks : noTracks;
 }
 
-void ReLiveApp::fetchTracks(Stream& stream)
+void ReLiveApp::fetchStreams(const Station& station)
+{
+    _streams = _catalog->streams(station._id);
+}
+
+void ReLiveApp::fetchTracks(const Stream& stream)
 {
     _activeStream = stream._id;
-    _rdb.deepFetch(stream);
-    _tracks = stream._tracks;
-    auto parent = std::make_shared<Stream>(stream);
-    for (auto& track : _tracks) {
-        track._stream = parent;
-    }
-    /*if(!_tracks.empty()) {
-        _rdb.deepFetch(_tracks.front(), true);
-    }*/
+    _selectedStream = _catalog->stream(stream._id);
+    if (!_selectedStream || (_fromSnapshot && _selectedStream->_tracks.empty())) {
+        // not in the snapshot yet, e.g. found by a search while a sync is running,
+        // or the startup snapshot that only has the tracks of its active stream,
+        // the cached stream has the station the player needs
+        auto fetched = std::make_shared<Stream>(_selectedStream ? *_selectedStream : stream);
+        _rdb.deepFetch(*fetched);
+        auto parent = std::make_shared<Stream>(*fetched);
+        parent->_tracks.clear();
+        for (auto& track : fetched->_tracks) {
+            track._stream = parent;
+        }
+        _selectedStream = fetched;
+    }
+    _timeline.setTracks(_selectedStream->_tracks);
     _activeTrack = 0;
 }
 
 void ReLiveApp::fetchStations()
 {
-    _stations = _rdb.fetchStations();
-    for (auto& station : _stations) {
-        _rdb.deepFetch(station);
+    _catalogChanged = false;
+    _catalog = currentCatalog();
+    _fromSnapshot = false;
+    _catalogLoading = false;
+    // keep the selection, but switch to the objects of the new snapshot
+    _streams = _catalog->streams(_activeStation);
+    if (_selectedStream) {
+        if (auto stream = _catalog->stream(_selectedStream->_id)) {
+            _selectedStream = stream;
+            _timeline.setTracks(_selectedStream->_tracks);
+        }
     }
 }
 
@@ -220,22 +275,174 @@ void ReLiveApp::doSetup()
     _startAtLastPosition = _rdb.getConfigValue(Keys::start_at_last_position, _startAtLastPosition);
     _nameColorSeed = _rdb.getConfigValue(Keys::name_color_seed, _nameColorSeed);
     _player.volume(_rdb.getConfigValue(Keys::player_volume, _player.volume()));
-    fetchStations();
+    _player.mediaCacheSize(_rdb.getConfigValue(Keys::media_cache_size, _player.mediaCacheSize()));
+    if (!restoreSnapshot()) {
+        // no snapshot yet, the sync thread loads the catalog after the first frame
+        _catalog = std::make_shared<Catalog>(0, std::vector<Catalog::StationPtr>(), std::unordered_map<int64_t, Catalog::StreamListPtr>());
+        _fromSnapshot = true;
+        _catalogLoading = true;
+        _streams = _catalog->streams(_activeStation);
+    }
 }
 
 void ReLiveApp::doTeardown()
 {
     savePosition();
+    if (_catalog && !_catalogLoading) {
+        StartupSnapshot snapshot(_catalog, _activeStation, _selectedStream ? _selectedStream->_id : 0, _rdb.getConfigValue(Keys::play_position, std::string()), _currentPage);
+        snapshot.save(StartupSnapshot::defaultFile());
+    }
+}
+
+bool ReLiveApp::restoreSnapshot()
+{
+    StartupSnapshot snapshot;
+    if (!snapshot.load(StartupSnapshot::defaultFile()) || !snapshot.catalog()->station(snapshot.activeStation())) {
+        return false;
+    }
+    _catalog = snapshot.catalog();
+    _fromSnapshot = true;
+    _activeStation = snapshot.activeStation();
+    _streams = _catalog->streams(_activeStation);
+    _currentPage = _streams->empty() ? pSTATIONS : pSTREAMS;
+    auto stream = _catalog->stream(snapshot.activeStream());
+    if (stream && !stream->_tracks.empty()) {
+        _activeStream = stream->_id;
+        _selectedStream = stream;
+        _timeline.setTracks(_selectedStream->_tracks);
+        _chatPending = true;
+        _chatService.load(*_selectedStream);
+        _currentPage = pTRACKS;
+    }
+    // the saved page, unless it would show something the snapshot lacks
+    auto page = snapshot.page();
+    if (page == pSETTINGS || (page == pCHAT && _selectedStream) || (page >= pSTATIONS && page < _currentPage)) {
+        _currentPage = static_cast<CurrentPage>(page);
+    }
+    DEBUG_LOG(1, "Restored station " << _activeStation << " and stream " << _activeStream << " from the startup snapshot");
+    return true;
+}
+
+void ReLiveApp::startBackgroundSync()
+{
+    if (_syncThread.joinable()) {
+        _syncThread.join();
+    }
+    _syncRunning = true;
+    _lastFetch = currentTime();
+    // all daemon ipc happens here, the ui only picks up the results
+    _daemonChecked = true;
+    _syncThread = std::thread([this, loadCatalog = _fromSnapshot, connect = !_daemonChecked]() {
+        if (connect) {
+            connectDaemon();
+        }
+        bool lostDaemon = false;
+        if (_useDaemon) {
+            sendPlayed();
+            if (pollDaemon()) {
+                _syncRunning = false;
+                return;
+            }
+            lostDaemon = true;
+        }
+        if (loadCatalog || lostDaemon) {
+            // handleInput() switches from the snapshot or the empty catalog to it with fetchStations()
+            _rdb.catalog();
+            _catalogChanged = true;
+            _needsRefresh = true;
+        }
+        _rdb.refreshStations();
+        _syncRunning = false;
+        _needsRefresh = true;
+    });
+}
+
+void ReLiveApp::connectDaemon()
+{
+    if (_daemon.connect()) {
+        // the daemon keeps the catalog in sync, the own database is only used for config
+        DEBUG_LOG(1, "Using the sync daemon at " << daemonSocketPath());
+        _search.useDaemon(daemonSocketPath());
+        _chatService.useDaemon(daemonSocketPath());
+        _useDaemon = true;
+    }
+}
+
+bool ReLiveApp::pollDaemon()
+{
+    try {
+        auto catalog = _daemon.catalog();
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (catalog != _daemonCatalog) {
+            _daemonCatalog = catalog;
+            _catalogChanged = true;
+            _needsRefresh = true;
+        }
+        return true;
+    }
+    catch (const IpcError& ex) {
+        ERROR_LOG(0, "Lost the sync daemon, continuing with the own database: " << ex.what());
+        _daemon.disconnect();
+        _useDaemon = false;
+        return false;
+    }
+}
+
+std::shared_ptr<const Catalog> ReLiveApp::currentCatalog()
+{
+    if (_useDaemon) {
+        std::lock_guard<std::mutex> lock{_mutex};
+        if (_daemonCatalog) {
+            return _daemonCatalog;
+        }
+    }
+    return _rdb.catalog();
+}
+
+void ReLiveApp::setPlayed(const Stream& stream)
+{
+    if (_useDaemon) {
+        // sent by the sync thread, it starts with the next frame
+        std::lock_guard<std::mutex> lock{_mutex};
+        _playedStreams.push_back(stream._id);
+        _lastFetch = 0;
+        return;
+    }
+    _rdb.setPlayed(stream);
+}
+
+void ReLiveApp::sendPlayed()
+{
+    std::vector<int64_t> played;
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        played.swap(_playedStreams);
+    }
+    for (auto streamId : played) {
+        if (_useDaemon) {
+            try {
+                _daemon.setPlayed(streamId);
+                continue;
+            }
+            catch (const IpcError& ex) {
+                ERROR_LOG(0, "Couldn't mark stream " << streamId << " as played by the sync daemon: " << ex.what());
+            }
+        }
+        // only the id and the flags are used
+        Stream stream;
+        stream._id = streamId;
+        _rdb.setPlayed(stream);
+    }
 }
 
 bool ReLiveApp::selectStation(const std::string& name)
 {
     DEBUG_LOG(1, "Switching to default station '" << name << "'");
-    for (const auto& station : _stations) {
-        DEBUG_LOG(2, "comparing to '" << station._name << "'");
-        if (station._name == name) {
-            DEBUG_LOG(2, "found '" << station._name << "'");
-            selectStation(station);
+    for (const auto& station : _catalog->stations()) {
+        DEBUG_LOG(2, "comparing to '" << station->_name << "'");
+        if (station->_name == name) {
+            DEBUG_LOG(2, "found '" << station->_name << "'");
+            selectStation(*station);
             return true;
         }
     }
@@ -245,40 +452,67 @@ bool ReLiveApp::selectStation(const std::string& name)
 void ReLiveApp::selectStation(const Station& station)
 {
     _activeStation = station._id;
-    _streams = station._streams;
-    if (!_streams.empty()) {
-        _rdb.deepFetch(_streams.front(), true);
-    }
+    fetchStreams(station);
     //_tracksModel.select(0);
     _currentPage = CurrentPage::pSTREAMS;
 }
 
-void ReLiveApp::selectStream(Stream& stream, bool play)
+void ReLiveApp::selectStream(const Stream& stream, bool play)
 {
     fetchTracks(stream);
-    _rdb.setPlayed(stream);
-    _player.setSource(stream);
+    auto selected = _selectedStream;
+    setPlayed(*selected);
+    _player.setSource(*selected);
     if (play) {
         _player.play();
     }
-    _chat = _rdb.fetchChat(stream);
+    // tracks and playback are ready, the chat follows from the chat service
+    setChat(ChatLog());
+    _chatPending = true;
+    _chatService.load(*selected);
+    _currentPage = CurrentPage::pTRACKS;
+    _needsRefresh = true;
+}
+
+void ReLiveApp::setChat(ChatLog chat)
+{
+    _chat = std::move(chat);
+    _chatLines.assign(_chat.size(), ChatLine());
+    _timeline.setChat(_chat);
+    // let updatePlayRelatedInfo() find the chat position in the new chat
+    _chatPosition = -1;
+    _lastPlayPos = -1;
     scanForMaxNickSize();
     recalcMessageSize();
-    _currentPage = CurrentPage::pTRACKS;
     _needsRefresh = true;
 }
 
-void ReLiveApp::selectTrack(Track track)
+void ReLiveApp::updateChat()
 {
-    _rdb.deepFetch(track);
-    if (track._stream) {
-        selectStream(*track._stream, false);
-        _player.setSource(track);
-        _player.play();
-        _currentPage = CurrentPage::pTRACKS;
+    ChatService::Result result;
+    if (_chatService.poll(result) && _selectedStream && result._streamId == _selectedStream->_id) {
+        setChat(std::move(result._chat));
+        _chatPending = false;
     }
 }
 
+void ReLiveApp::selectTrack(const Track& track)
+{
+    if (auto cached = _catalog->stream(track._streamId)) {
+        selectStream(*cached, false);
+    }
+    else {
+        Track fetched = track;
+        _rdb.deepFetch(fetched);
+        if (!fetched._stream) {
+            return;
+        }
+        selectStream(*fetched._stream, false);
+    }
+    _player.seekTo(track._time, true);
+    _currentPage = CurrentPage::pTRACKS;
+}
+
 void ReLiveApp::savePosition()
 {
     auto dbPosition = _rdb.getConfigValue(Keys::play_position, std::string());
@@ -287,10 +521,8 @@ void ReLiveApp::savePosition()
         newPos = _activeTrackInfo.reLiveURL(_player.playTime());
     }
     else if (_activeStation) {
-        for (const auto& station : _stations) {
-            if (_activeStation == station._id) {
-                newPos = station.reLiveURL();
-            }
+        if (auto station = _catalog->station(_activeStation)) {
+            newPos = station->reLiveURL();
         }
     }
     if(!newPos.empty() && dbPosition != newPos) {
@@ -304,15 +536,15 @@ bool ReLiveApp::openURL(std::string url, bool play)
     auto [stationId, streamId, timeOffset] = parseUrl(url);
     if (stationId >= 0) {
         _needsRefresh = true;
-        for (const auto& station : _stations) {
-            DEBUG_LOG(2, "comparing to '" << station._name << "'");
-            if (station._reliveId == stationId) {
-                DEBUG_LOG(2, "found '" << station._name << "'");
-                selectStation(station);
+        for (const auto& station : _catalog->stations()) {
+            DEBUG_LOG(2, "comparing to '" << station->_name << "'");
+            if (station->_reliveId == stationId) {
+                DEBUG_LOG(2, "found '" << station->_name << "'");
+                selectStation(*station);
                 if (streamId >= 0) {
-                    for (auto& stream : _streams) {
-                        if (stream._reliveId == streamId) {
-                            selectStream(stream, false);
+                    for (const auto& stream : *_streams) {
+                        if (stream->_reliveId == streamId) {
+                            selectStream(*stream, false);
                             if (timeOffset >= 0) {
                                 _player.seekTo(timeOffset, play);
                             }
@@ -339,20 +571,23 @@ void ReLiveApp::handleInput(ImGuiIO& io)
         auto defaultStation = _rdb.getConfigValue(Keys::default_station, std::string());
         auto savedPosition = _rdb.getConfigValue(Keys::play_position, std::string());
         if (savedPosition.empty() || !_startAtLastPosition || !openURL(savedPosition, false)) {
-            for (const auto& station : _stations) {
-                if (station._name == defaultStation) {
-                    DEBUG_LOG(2, "found default station '" << station._name << "'");
-                    selectStation(station);
+            for (const auto& station : _catalog->stations()) {
+                if (station->_name == defaultStation) {
+                    DEBUG_LOG(2, "found default station '" << station->_name << "'");
+                    selectStation(*station);
                 }
             }
         }
          */
     }
-    if (currentTime() - _lastFetch > 3600) {
+    // nothing may delay the first frame, the sync follows in the background
+    // with a sync daemon only its catalog is polled, it syncs on its own
+    if (!_firstFrame && !_syncRunning && currentTime() - _lastFetch > (_useDaemon ? 10 : 3600)) {
         DEBUG_LOG(1, "Fetching station info...");
-        _rdb.refreshStations([this]() { handleRedraw(); });
+        startBackgroundSync();
+    }
+    if (_catalogChanged) {
         fetchStations();
-        _lastFetch = currentTime();
     }
     if (currentTime() - _lastSavepoint >= 60) {
         savePosition();
@@ -379,6 +614,10 @@ void ReLiveApp::renderFrame()
     if (_wheelAction > 0) {
         --_wheelAction;
     }
+    if (_firstFrame) {
+        _firstFrame = false;
+        DEBUG_LOG(1, "First frame after " << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - g_startTime).count() << "ms" << (_fromSnapshot ? " from the startup snapshot" : ""));
+    }
 }
 
 void ReLiveApp::handleRedraw()
@@ -514,7 +753,8 @@ void ReLiveApp::renderStations(ImVec2 pageSize)
     ImGui::TableHeadersRow();
     renderTopPanelShadow();
     ImGui::PopFont();
-    for (const auto& station : _stations) {
+    for (const auto& stationPtr : _catalog->stations()) {
+        const Station& station = *stationPtr;
         ImGui::TableNextRow();
         bool isActive = false;
         if (station._id == _activeStation) {
@@ -526,13 +766,18 @@ void ReLiveApp::renderStations(ImVec2 pageSize)
             selectStation(station);
         }
         ImGui::TableSetColumnIndex(1);
-        ImGui::Text("%lu", station._streams.size());
+        ImGui::Text("%lu", _catalog->streams(station._id)->size());
         ImGui::TableSetColumnIndex(2);
         ImGui::Text("%s", station._webSiteUrl.c_str());
         if (isActive) {
             ImGui::PopStyleColor();
         }
     }
+    if (_catalogLoading) {
+        ImGui::TableNextRow();
+        ImGui::TableSetColumnIndex(0);
+        ImGui::TextDisabled("Loading stations...");
+    }
     renderBottomPanelShadow();
     ImGui::EndTable();
 }
@@ -540,7 +785,7 @@ void ReLiveApp::renderStations(ImVec2 pageSize)
 void ReLiveApp::renderStreams(ImVec2 pageSize)
 {
     ZoneScopedN("renderStreams");
-    std::string station = _activeStation && !_streams.empty() ? _streams.front()._station->_name : "reLive - <no station selected>";
+    std::string station = _activeStation && !_streams->empty() ? _streams->front()->_station->_name : "reLive - <no station selected>";
     setWindowTitle(station);
     ImGui::BeginTable("StreamsTable", 6, ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY /*| ImGuiTableFlags_ScrollFreezeTopRow*/, pageSize);
     ImGui::TableSetupColumn(" ##Streams", ImGuiTableColumnFlags_WidthFixed, 20);
@@ -555,7 +800,7 @@ void ReLiveApp::renderStreams(ImVec2 pageSize)
     renderTopPanelShadow();
     ImGui::PopFont();
     static const char* playAnim[4] = {ICON_FTH_VOLUME "##strm", ICON_FTH_VOLUME_1 "##strm", ICON_FTH_VOLUME_2 "##strm", "##strm"};
-    if(!_streams.empty() && _streams.front()._station && !_streams.front()._station->_liveStream.empty()) {
+    if(!_streams->empty() && _streams->front()->_station && !_streams->front()->_station->_liveStream.empty()) {
         ImGui::TableNextRow();
         _style.pushColor(ImGuiCol_Text, reLiveCol_TableUnplayed);
         ImGui::TableSetColumnIndex(0);
@@ -575,7 +820,8 @@ void ReLiveApp::renderStreams(ImVec2 pageSize)
         ImGui::Text("   -");
         ImGui::PopStyleColor();
     }
-    for (auto& stream : _streams) {
+    for (const auto& streamPtr : *_streams) {
+        const Stream& stream = *streamPtr;
         ImGui::TableNextRow();
         bool isActive = false;
         static int64_t lastActiveStream = 0;
@@ -618,7 +864,7 @@ void ReLiveApp::renderTracks(ImVec2 pageSize)
     ZoneScopedN("renderTracks");
     static const char* types[] = {"-", ICON_FTH_MUSIC, ICON_FTH_MESSAGE_CIRCLE, ICON_FTH_BELL, ICON_FTH_MESSAGE_SQUARE};
 
-    std::string stream = !_tracks.empty() ? _tracks.front()._stream->_station->_name + ": " + _tracks.front()._stream->_name + " [" + formattedDate(_tracks.front()._stream->_timestamp) + "]" : "reLive - <no stream selected>";
+    std::string stream = _selectedStream && _selectedStream->_station ? _selectedStream->_station->_name + ": " + _selectedStream->_name + " [" + formattedDate(_selectedStream->_timestamp) + "]" : "reLive - <no stream selected>";
     setWindowTitle(stream);
     ImGui::BeginTable("TracksTable", 6, ImGuiTableFlags_ScrollX | ImGuiTableFlags_ScrollY /*| ImGuiTableFlags_ScrollFreezeTopRow*/, pageSize);
     ImGui::TableSetupColumn(" ##tracks", ImGuiTableColumnFlags_WidthFixed, 20);
@@ -633,7 +879,7 @@ void ReLiveApp::renderTracks(ImVec2 pageSize)
     renderTopPanelShadow();
     ImGui::PopFont();
     static const char* playAnim[4] = {ICON_FTH_VOLUME "##trk", ICON_FTH_VOLUME_1 "##trk", ICON_FTH_VOLUME_2 "##strm", "##trk"};
-    for (auto& track : _tracks) {
+    for (const auto& track : tracks()) {
         ImGui::TableNextRow();
         bool isActive = false;
         if (track._id == _activeTrack) {
@@ -647,8 +893,8 @@ void ReLiveApp::renderTracks(ImVec2 pageSize)
         }
         ImGui::TableSetColumnIndex(0);
         if (ImGui::Selectable((std::string(track._id == _activeTrack ? playAnim[std::time(nullptr) % 3] : playAnim[3]) + std::to_string(track._id)).c_str(), track._id == _activeTrack, ImGuiSelectableFlags_SpanAllColumns)) {
-            _player.setSource(track);
-            _player.play();
+            _player.setSource(*_selectedStream);
+            _player.seekTo(track._time, true);
             _currentPage = CurrentPage::pTRACKS;
             savePosition();
         }
@@ -683,10 +929,13 @@ void ReLiveApp::renderTracks(ImVec2 pageSize)
 void ReLiveApp::renderChat(ImVec2 pageSize)
 {
     ZoneScopedN("renderChat");
-    std::string stream = !_tracks.empty() ? _tracks.front()._stream->_station->_name + ": " + _tracks.front()._stream->_name + " [" + formattedDate(_tracks.front()._stream->_timestamp) + "]" : "reLive - <no stream selected>";
+    std::string stream = _selectedStream && _selectedStream->_station ? _selectedStream->_station->_name + ": " + _selectedStream->_name + " [" + formattedDate(_selectedStream->_timestamp) + "]" : "reLive - <no stream selected>";
     setWindowTitle(stream);
     ImGui::SetNextWindowContentSize(ImVec2(pageSize.x - 20, _chatLogHeight + ImGui::GetTextLineHeight()));
     ImGui::BeginChild("##ChatLog", ImVec2(pageSize.x - 4, pageSize.y));
+    if (_chatPending && _chat.empty()) {
+        ImGui::TextDisabled("Loading chat...");
+    }
     if (_forceScroll) {
         ImGui::SetScrollY(ImGui::GetScrollMaxY());
         _forceScroll = false;
@@ -694,25 +943,30 @@ void ReLiveApp::renderChat(ImVec2 pageSize)
     ImDrawList* drawList = ImGui::GetWindowDrawList();
     auto pos = ImGui::GetCursorScreenPos();
     auto scrollPos = ImGui::GetScrollY();
-    float yoffset = 0;
-    for (int i = 0; i <= _chatPosition; ++i) {
+    bool atBottom = scrollPos >= ImGui::GetScrollMaxY();
+    // only the rows overlapping the visible area get formatted, measured and drawn
+    for (int i = (std::max)(_timeline.chatIndexAtHeight(scrollPos), 0); i <= _chatPosition; ++i) {
+        const auto& line = chatLine(i);
+        auto yoffset = _timeline.chatHeightUpTo(i - 1);
+        if (yoffset >= scrollPos + pageSize.y) {
+            break;
+        }
         auto msgcol = _style.getColor(ImGuiCol_Text);
-        if (yoffset >= scrollPos - 16 && yoffset < scrollPos + pageSize.y) {
-            const auto& msg = _chat[i];
-            drawList->AddText(ImVec2(pos.x, pos.y + yoffset), msgcol, formattedDuration(msg._time).c_str());
-            if (msg.hasNick()) {
-                auto nick = msg.nick();
-                auto col = colorForString(nick);
-                if (msg._type != ChatMessage::eMessage) {
-                    msgcol = col;
-                }
-
-                drawList->AddText(ImVec2(pos.x + 80 + _maxNickSize - ImGui::CalcTextSize(nick.c_str()).x, pos.y + yoffset), col, nick.c_str());
+        drawList->AddText(ImVec2(pos.x, pos.y + yoffset), msgcol, line._time.c_str());
+        if (!line._nick.empty()) {
+            auto col = colorForString(line._nick);
+            if (_chat.type(i) != ChatMessage::eMessage) {
+                msgcol = col;
             }
-            auto text = generateMessage(_chat[i]);
-            drawList->AddText(nullptr, 0, ImVec2(pos.x + _maxNickSize + 100, pos.y + yoffset), msgcol, text.c_str(), nullptr, _chatMessageWidth);
+            drawList->AddText(ImVec2(pos.x + 80 + _maxNickSize - line._nickWidth, pos.y + yoffset), col, line._nick.c_str());
         }
-        yoffset += _messageSizes[i].y;
+        drawList->AddText(nullptr, 0, ImVec2(pos.x + _maxNickSize + 100, pos.y + yoffset), msgcol, line._text.c_str(), nullptr, _chatMessageWidth);
+    }
+    // measuring replaced estimated heights, stay at the bottom if we were there
+    auto chatLogHeight = _timeline.chatHeightUpTo(_chatPosition);
+    if (chatLogHeight != _chatLogHeight) {
+        _chatLogHeight = chatLogHeight;
+        _forceScroll = _forceScroll || atBottom;
     }
     renderTopPanelShadow();
     renderBottomPanelShadow();
@@ -727,37 +981,17 @@ void ReLiveApp::updatePlayRelatedInfo()
         _lastPlayPos = playTime;
         auto stream = _player.currentStream();
         if (stream) {
-            // find active track
-            int64_t lastId = 0;
-            const Track* lastTrackInfo = nullptr;
-            for (const auto& track : _tracks) {
-                if (track._time > playTime) {
-                    if (_activeTrack != lastId) {
-                        _activeTrack = lastId;
-                        _activeTrackInfo = *lastTrackInfo;
-                        _needsRefresh = true;
-                    }
-                    break;
-                }
-                lastId = track._id;
-                lastTrackInfo = &track;
-            }
-            if (_activeTrack != lastId) {
-                _activeTrack = lastId;
-                _activeTrackInfo = *lastTrackInfo;
+            // active track and chat position are binary searches in the timeline
+            const auto& trackList = tracks();
+            auto trackIndex = _timeline.trackIndexAt(playTime);
+            int64_t activeId = trackIndex >= 0 && trackIndex < static_cast<int>(trackList.size()) ? trackList[trackIndex]._id : 0;
+            if (_activeTrack != activeId) {
+                _activeTrack = activeId;
+                _activeTrackInfo = activeId ? trackList[trackIndex] : Track();
                 _needsRefresh = true;
             }
-            int chatPos = -1;
-            _chatLogHeight = 0;
-            for (const auto& msg : _chat) {
-                if (msg._time <= playTime) {
-                    ++chatPos;
-                    _chatLogHeight += _messageSizes[chatPos].y;
-                }
-                else {
-                    break;
-                }
-            }
+            auto chatPos = _timeline.chatIndexAt(playTime);
+            _chatLogHeight = _timeline.chatHeightUpTo(chatPos);
             if (_chatPosition != chatPos) {
                 _forceScroll = true;
                 _chatPosition = chatPos;
@@ -769,6 +1003,7 @@ void ReLiveApp::updatePlayRelatedInfo()
 void ReLiveApp::renderMainWindow()
 {
     ZoneScopedN("renderMainWindow");
+    updateChat();
     updatePlayRelatedInfo();
 
     auto style = ImGui::GetStyle();
@@ -862,31 +1097,29 @@ void ReLiveApp::renderMainWindow()
 
                 maxResultWidth = 0;
                 if (inputStr != lastSearch) {
+                    lastSearch = inputStr;
                     if (starts_with(inputStr, "t:") || starts_with(inputStr, "m:")) {
-                        inputStr.erase(0, 2);
-                        foundStreams.clear();
-                        foundTracks = _rdb.findTracksInfo("%" + inputStr + "%", ReLiveDB::eTracks);
+                        _search.search(inputStr.substr(2), SearchService::eTracks, ReLiveDB::eTracks);
                     }
                     else if (starts_with(inputStr, "j:")) {
-                        inputStr.erase(0, 2);
-                        foundStreams.clear();
-                        foundTracks = _rdb.findTracksInfo("%" + inputStr + "%", ReLiveDB::eJingle);
+                        _search.search(inputStr.substr(2), SearchService::eTracks, ReLiveDB::eJingle);
                     }
                     else if (starts_with(inputStr, "n:") || starts_with(inputStr, "c:")) {
-                        inputStr.erase(0, 2);
-                        foundStreams.clear();
-                        foundTracks = _rdb.findTracksInfo("%" + inputStr + "%", ReLiveDB::eNarration);
+                        _search.search(inputStr.substr(2), SearchService::eTracks, ReLiveDB::eNarration);
                     }
                     else if (starts_with(inputStr, "s:")) {
-                        inputStr.erase(0, 2);
-                        foundStreams = _rdb.findStreams("%" + inputStr + "%");
-                        foundTracks.clear();
+                        _search.search(inputStr.substr(2), SearchService::eStreams);
                     }
                     else {
-                        foundStreams = _rdb.findStreams("%" + inputStr + "%");
-                        foundTracks = _rdb.findTracksInfo("%" + inputStr + "%");
+                        _search.search(inputStr);
                     }
                 }
+                // results arrive page by page from the search worker, the frame never waits for them
+                SearchService::Results results;
+                if (_search.poll(results)) {
+                    foundStreams = std::move(results._streams);
+                    foundTracks = std::move(results._tracks);
+                }
                 if (!foundStreams.empty()) {
                     ImGui::Spacing();
                     ImGui::Text("Matching Streams:");
@@ -1038,6 +1271,13 @@ int main(int argc, char* argv[])
             }
             exit(0);
         });
+        parser.onOpt({"-c!", "--media-cache!"}, "<MiB>\tSet the size of the on-disk media cache in MiB, 0 keeps nothing, default is 512.", [&](const std::string& str) {
+            ReLiveDB db;
+            auto bytes = int64_t(std::max(0, std::stoi(str))) * 1024 * 1024;
+            db.setConfigValue(Keys::media_cache_size, bytes);
+            std::cout << "Set the media cache size to " << bytes / (1024 * 1024) << " MiB." << std::endl;
+            exit(0);
+        });
         parser.onOpt({"-s?", "--default-station?"}, "[<name>]\tSet the default station to switch to on startup, only significant part of the name is needed. Without a parameter, this resets to starting on station screen.", [&](std::string str) {
             ReLiveDB db;
             if (str.empty()) {
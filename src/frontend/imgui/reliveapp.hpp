@@ -6,9 +6,16 @@
 #pragma once
 
 #include <backend/player.hpp>
+#include <backend/chatservice.hpp>
+#include <backend/daemonclient.hpp>
 #include <backend/relivedb.hpp>
+#include <backend/searchservice.hpp>
+#include <backend/startupsnapshot.hpp>
+#include <backend/timeline.hpp>
 #include <imguix/application.h>
 
+#include <thread>
+
 #include "stylemanager.h"
 
 namespace relive
@@ -28,19 +35,19 @@ class ReLiveApp : public ImGui::Application
 
 public:
     ReLiveApp();
-    ~ReLiveApp() override = default;
+    ~ReLiveApp() override;
 
     void doSetup() override;
     void doTeardown() override;
 
     void fetchStations();
     void fetchStreams(const Station& station);
-    void fetchTracks(Stream& stream);
+    void fetchTracks(const Stream& stream);
 
     bool selectStation(const std::string& name);
     void selectStation(const Station& station);
-    void selectStream(Stream& stream, bool play = true);
-    void selectTrack(Track track);
+    void selectStream(const Stream& stream, bool play = true);
+    void selectTrack(const Track& track);
 
     void savePosition();
     bool openURL(std::string url, bool play);
@@ -58,12 +65,30 @@ public:
     void renderChat(ImVec2 pageSize);
     void renderMainWindow();
 
+    void updateChat();
     void updatePlayRelatedInfo();
 
 private:
     void progress(int percent);
+    bool restoreSnapshot();
+    void startBackgroundSync();
+    void connectDaemon();
+    bool pollDaemon();
+    std::shared_ptr<const Catalog> currentCatalog();
+    void setPlayed(const Stream& stream);
+    void sendPlayed();
+    const std::vector<Track>& tracks() const;
     ImU32 colorForString(const std::string& str);
-    static std::string generateMessage(const ChatMessage& msg);
+    static std::string generateMessage(const ChatLog& chat, int index);
+    struct ChatLine {
+        std::string _time;  // formatted on first display, empty until then
+        std::string _nick;
+        std::string _text;
+        float _nickWidth = 0;
+        int _layout = 0;  // _chatLayout the height in the timeline was measured for
+    };
+    const ChatLine& chatLine(int index);
+    void setChat(ChatLog chat);
     void scanForMaxNickSize();
     void recalcMessageSize();
     void renderAppMenu();
@@ -74,9 +99,19 @@ private:
     float _height = 0;
     bool _show_demo_window = true;
     bool _lateSetup = true;
+    bool _firstFrame = true;
     std::mutex _mutex;
     ReLiveDB _rdb;
+    SearchService _search;
+    ChatService _chatService;
     int64_t _lastFetch = 0;
+    std::thread _syncThread;  // loads the catalog after a snapshot start, then syncs
+    std::atomic_bool _syncRunning = false;
+    DaemonClient _daemon;  // serves catalog, search and chat while a sync daemon runs
+    std::atomic_bool _useDaemon = false;
+    std::shared_ptr<const Catalog> _daemonCatalog;  // latest one of the daemon, guarded by _mutex
+    std::vector<int64_t> _playedStreams;            // to mark as played by the daemon, guarded by _mutex
+    bool _daemonChecked = false;                    // the sync thread tried to connect
     int64_t _lastSavepoint = 0;
     int _lastPlayPos = 0;
     int _wheelAction = 0;
@@ -87,16 +122,23 @@ private:
     ImFont* _monoFont = nullptr;
     std::atomic_bool _needsRefresh = true;
     CurrentPage _currentPage = pSTATIONS;
-    std::vector<Station> _stations;
+    std::shared_ptr<const Catalog> _catalog;
+    std::atomic_bool _catalogChanged = false;
+    bool _fromSnapshot = false;    // _catalog is the small one of the startup snapshot, or empty while loading
+    bool _catalogLoading = false;  // _catalog is empty until the sync thread loaded the real one
+    int _catalogSubscription = 0;
     int64_t _activeStation = 0;
-    std::vector<Stream> _streams;
+    Catalog::StreamListPtr _streams;
     Stream _liveStream;
     int64_t _activeStream = 0;
-    std::vector<Track> _tracks;
+    Catalog::StreamPtr _selectedStream;  // the stream the tracks and chat pages show
     int64_t _activeTrack = 0;
     Track _activeTrackInfo;
-    std::vector<ChatMessage> _chat;
-    std::vector<ImVec2> _messageSizes;
+    ChatLog _chat;
+    bool _chatPending = false;  // the chat of _selectedStream is still loading
+    Timeline _timeline;  // tracks of _selectedStream and _chat with their message heights
+    std::vector<ChatLine> _chatLines;
+    int _chatLayout = 0;
     float _maxNickSize = 0;
     float _chatLogHeight = 0;
     float _chatMessageWidth = 0;
@@ -66,10 +66,12 @@ void ReLiveApp::renderAppMenu()
     //-----------------------------------------------------------------------------------------
     static std::vector<Player::Device> outputDevices;
     static std::string defaultStation;
+    static int mediaCacheMiB = 0;
     if(openSettings) {
         ImGui::OpenPopup("reLiveG Settings");
         outputDevices = _player.getOutputDevices();
         defaultStation = _rdb.getConfigValue(Keys::default_station, defaultStation);
+        mediaCacheMiB = static_cast<int>(_player.mediaCacheSize() / (1024 * 1024));
     }
     ImGui::SetNextWindowPos(ImVec2(_width *0.5f, _height *0.5f), ImGuiCond_Appearing, ImVec2(0.5f, 0.5f));
     ImGui::SetNextWindowSize(ImVec2(600, 350));
@@ -87,13 +89,13 @@ void ReLiveApp::renderAppMenu()
                     _rdb.setConfigValue(Keys::start_at_last_position, _startAtLastPosition);
                 }
                 if(ImGui::BeginCombo("Default station##settings", defaultStation.c_str())) {
-                    for(const auto& station : _stations) {
-                        ImGui::PushID(station._name.c_str());
-                        if (ImGui::Selectable(station._name.c_str(), defaultStation == station._name)) {
-                            if (defaultStation != station._name) {
-                                _rdb.setConfigValue(Keys::default_station, station._name);
+                    for(const auto& station : _catalog->stations()) {
+                        ImGui::PushID(station->_name.c_str());
+                        if (ImGui::Selectable(station->_name.c_str(), defaultStation == station->_name)) {
+                            if (defaultStation != station->_name) {
+                                _rdb.setConfigValue(Keys::default_station, station->_name);
                             }
-                            defaultStation = station._name;
+                            defaultStation = station->_name;
                         }
                         ImGui::PopID();
                     }
@@ -148,6 +150,14 @@ void ReLiveApp::renderAppMenu()
                     }
                     ImGui::EndCombo();
                 }
+                ImGui::SliderInt("Media cache size", &mediaCacheMiB, 0, 8192, "%d MiB");
+                if (ImGui::IsItemDeactivated()) {
+                    auto bytes = int64_t(mediaCacheMiB) * 1024 * 1024;
+                    if (bytes != _player.mediaCacheSize()) {
+                        _player.mediaCacheSize(bytes);
+                        _rdb.setConfigValue(Keys::media_cache_size, bytes);
+                    }
+                }
                 ImGui::EndTabItem();
             }
             ImGui::EndTabBar();
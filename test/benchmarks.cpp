@@ -0,0 +1,472 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+// Micro benchmarks, not registered with ctest, run relive-bench manually.
+//---------------------------------------------------------------------------------------
+#define CATCH_CONFIG_MAIN
+#include "catch.hpp"
+#include "helper.hpp"
+#include <backend/catalog.hpp>
+#include <backend/chatlog.hpp>
+#include <backend/chatservice.hpp>
+#include <backend/jsonrecords.hpp>
+#include <backend/relivedb.hpp>
+#include <backend/ringbuffer.hpp>
+#include <backend/scheduler.hpp>
+#include <backend/searchservice.hpp>
+#include <backend/startupsnapshot.hpp>
+#include <backend/system.hpp>
+#include <pearce/threadpool.hpp>
+#include <sqlite3.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <nlohmann/json.hpp>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+// the former mutex guarded element-wise implementation as reference
+template <class T>
+class MutexRingBuffer
+{
+public:
+    MutexRingBuffer(unsigned int size)
+        : _buffer(size)
+    {
+    }
+    int push(const T* data, unsigned int size)
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        size = (std::min)(size, static_cast<unsigned int>(_buffer.size()) - _filled - 1);
+        for (unsigned int i = 0; i < size; ++i) {
+            _buffer[(_read + _filled + i) % _buffer.size()] = data[i];
+        }
+        _filled += size;
+        return size;
+    }
+    int pull(T* data, unsigned int size)
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        size = (std::min)(size, _filled);
+        for (unsigned int i = 0; i < size; ++i) {
+            data[i] = _buffer[(_read + i) % _buffer.size()];
+        }
+        _read = (_read + size) % _buffer.size();
+        _filled -= size;
+        return size;
+    }
+
+private:
+    std::mutex _mutex;
+    std::vector<T> _buffer;
+    unsigned int _read = 0;
+    unsigned int _filled = 0;
+};
+
+template <class Buffer>
+void runRingBufferBenchmark(const std::string& name, Buffer& buffer)
+{
+    // producer pushes decoded frame sized blocks, consumer pulls audio callback sized blocks
+    const int64_t total = INT64_C(64) * 1024 * 1024;
+    std::thread producer([&]() {
+        std::vector<int16_t> frame(2304, 1);
+        int64_t pushed = 0;
+        while (pushed < total) {
+            auto count = buffer.push(frame.data(), static_cast<unsigned int>((std::min)(int64_t(frame.size()), total - pushed)));
+            if (!count) {
+                std::this_thread::yield();
+            }
+            pushed += count;
+        }
+    });
+    std::vector<int16_t> out(1024);
+    int64_t pulled = 0;
+    int64_t worstNs = 0;
+    int64_t calls = 0;
+    auto start = Clock::now();
+    while (pulled < total) {
+        auto t1 = Clock::now();
+        auto count = buffer.pull(out.data(), static_cast<unsigned int>(out.size()));
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - t1).count();
+        worstNs = (std::max)(worstNs, ns);
+        if (!count) {
+            std::this_thread::yield();
+        }
+        pulled += count;
+        ++calls;
+    }
+    auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+    producer.join();
+    std::cout << name << ": " << (total * sizeof(int16_t) / seconds / 1024 / 1024) << " MiB/s, " << calls << " pulls, worst pull latency " << worstNs << "ns" << std::endl;
+}
+
+// replace the catalog in the test database with a synthetic one, one stream per 100 tracks
+void createSyntheticCatalog(int numTracks)
+{
+    // words of two or three syllables give a vocabulary of about 8000 words
+    static const char* syllables[] = {"la", "mo", "ri", "sun", "da", "ke", "ni", "tor", "vel", "am", "be", "cro", "fi", "gan", "hu", "jo", "lin", "mar", "sta", "zu"};
+    const int numSyllables = sizeof(syllables) / sizeof(syllables[0]);
+    std::mt19937 rng(4711);
+    auto word = [&]() {
+        std::string result = std::string(syllables[rng() % numSyllables]) + syllables[rng() % numSyllables];
+        return rng() % 2 ? result + syllables[rng() % numSyllables] : result;
+    };
+    // the schema comes from the ReLiveDB of the caller, only the rows of former cases are left
+    REQUIRE(execSql("DELETE FROM tracks; DELETE FROM streams; DELETE FROM stations; DELETE FROM urls;"));
+    sqlite3* db = nullptr;
+    REQUIRE(sqlite3_open((testDataPath() / "relive.sqlite").string().c_str(), &db) == SQLITE_OK);
+    sqlite3_busy_timeout(db, 5000);
+    REQUIRE(sqlite3_exec(db, "BEGIN; INSERT INTO stations(id, relive_id, protocol, name, last_update, flags, meta_info) VALUES (1, 1, 11, 'Station', 0, 0, '')", nullptr, nullptr, nullptr) == SQLITE_OK);
+    sqlite3_stmt* stream = nullptr;
+    sqlite3_stmt* track = nullptr;
+    REQUIRE(sqlite3_prepare_v2(db, "INSERT INTO streams(id, relive_id, station_id, name, host, description, timestamp, duration, size, format, media_offset, info_chk, chat_chk, media_chk, last_update, flags, meta_info) "
+                       "VALUES (?1, ?1, 1, ?2, ?3, '', ?1, 7200, 0, 'mp3', 0, 0, 0, 0, 0, 0, '')", -1, &stream, nullptr) == SQLITE_OK);
+    REQUIRE(sqlite3_prepare_v2(db, "INSERT INTO tracks(stream_id, name, artist, type, time, last_update, flags, meta_info) VALUES (?1, ?2, ?3, ?4, ?5, 0, 0, '')", -1, &track, nullptr) == SQLITE_OK);
+    for (int i = 0; i < numTracks; ++i) {
+        int streamId = i / 100 + 1;
+        if (i % 100 == 0) {
+            auto name = word() + " " + word() + " show " + std::to_string(streamId);
+            auto host = "host" + std::to_string(rng() % 500);
+            sqlite3_bind_int64(stream, 1, streamId);
+            sqlite3_bind_text(stream, 2, name.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stream, 3, host.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stream) != SQLITE_DONE) {
+                FAIL("inserting a stream failed: " << sqlite3_errmsg(db));
+            }
+            sqlite3_reset(stream);
+        }
+        auto name = word() + " " + word() + " " + word() + " " + std::to_string(rng() % 100000);
+        auto artist = "artist" + std::to_string(rng() % 20000) + " " + word();
+        sqlite3_bind_int64(track, 1, streamId);
+        sqlite3_bind_text(track, 2, name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(track, 3, artist.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(track, 4, i % 5 ? 1 : 3);
+        sqlite3_bind_int64(track, 5, (i % 100) * 60);
+        if (sqlite3_step(track) != SQLITE_DONE) {
+            FAIL("inserting a track failed: " << sqlite3_errmsg(db));
+        }
+        sqlite3_reset(track);
+    }
+    sqlite3_finalize(stream);
+    sqlite3_finalize(track);
+    REQUIRE(sqlite3_exec(db, "COMMIT", nullptr, nullptr, nullptr) == SQLITE_OK);
+    sqlite3_close(db);
+}
+
+template <typename Func>
+void measure(const std::string& name, int runs, Func func)
+{
+    size_t results = 0;
+    auto start = Clock::now();
+    for (int i = 0; i < runs; ++i) {
+        results = func();
+    }
+    auto ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count() / runs;
+    std::cout << name << ": " << ms << "ms per query, " << results << " results" << std::endl;
+}
+
+}  // namespace
+
+TEST_CASE("Track search on a catalog of 1M tracks", "[benchmark][search]")
+{
+    relive::dataPath(testDataPath());
+    relive::ReLiveDB rdb;
+    auto start = Clock::now();
+    createSyntheticCatalog(1000000);
+    std::cout << "created catalog in " << std::chrono::duration<double>(Clock::now() - start).count() << "s" << std::endl;
+    for (const std::string query : {"sun", "mar", "artist123", "lamo fi"}) {
+        measure("LIKE '%" + query + "%'     ", 3, [&]() { return rdb.findTracksInfo("%" + query + "%").size(); });
+        measure("LIKE '%" + query + "%' first 100", 3, [&]() {
+            relive::ReLiveDB::FindTracksCursor cursor("%" + query + "%");
+            return rdb.findTracksInfo(cursor, 100).size();
+        });
+        measure("LIKE '%" + query + "%' jingles, first 100", 3, [&]() {
+            relive::ReLiveDB::FindTracksCursor cursor("%" + query + "%", relive::ReLiveDB::eJingle);
+            return rdb.findTracksInfo(cursor, 100).size();
+        });
+        measure("FTS5 '" + query + "' top 100", 3, [&]() { return rdb.searchTracks(query).size(); });
+        measure("FTS5 '" + query + "' page 10", 3, [&]() { return rdb.searchTracks(query, relive::ReLiveDB::eNone, 100, 1000).size(); });
+    }
+    // simulate typing into the search popup at 60fps, a key every 100ms, with the search service
+    relive::SearchService search(rdb);
+    const std::string typed = "artist12 lamo";
+    int64_t worstFrameUs = 0;
+    size_t length = 0;
+    relive::SearchService::Results results;
+    auto nextKey = Clock::now();
+    auto lastKey = nextKey;
+    while (length < typed.size() || search.busy()) {
+        auto frameStart = Clock::now();
+        if (length < typed.size() && frameStart >= nextKey) {
+            ++length;
+            lastKey = frameStart;
+            nextKey += std::chrono::milliseconds(100);
+            if (length >= 3) {
+                search.search(typed.substr(0, length));
+            }
+        }
+        search.poll(results);
+        worstFrameUs = (std::max)(worstFrameUs, int64_t(std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - frameStart).count()));
+        std::this_thread::sleep_until(frameStart + std::chrono::microseconds(16667));
+    }
+    search.poll(results);
+    std::cout << "typing with search service: worst frame time " << worstFrameUs << "us, " << results._tracks.size() << " results " << std::chrono::duration<double>(Clock::now() - lastKey).count() * 1000 << "ms after the last key" << std::endl;
+}
+
+TEST_CASE("Latency of the frequent ReLiveDB queries", "[benchmark][relivedb]")
+{
+    relive::dataPath(testDataPath());
+    relive::ReLiveDB rdb;
+    createSyntheticCatalog(200000);
+    auto station = rdb.fetchStations().front();
+    rdb.deepFetch(station);
+    auto stream = station._streams[station._streams.size() / 2];
+    rdb.deepFetch(stream);
+    auto trackId = stream._tracks.front()._id;
+    auto perQuery = [](const std::string& name, int runs, auto func) {
+        auto start = Clock::now();
+        for (int i = 0; i < runs; ++i) {
+            func();
+        }
+        std::cout << name << ": " << std::chrono::duration<double, std::micro>(Clock::now() - start).count() / runs << "us per call" << std::endl;
+    };
+    perQuery("getConfigValue        ", 10000, [&]() { rdb.getConfigValue(relive::Keys::version, 0); });
+    perQuery("fetchTrack            ", 10000, [&]() { rdb.fetchTrack(trackId); });
+    perQuery("deepFetch(track)      ", 1000, [&]() {
+        relive::Track track;
+        track._streamId = stream._id;
+        rdb.deepFetch(track);
+    });
+    perQuery("deepFetch(stream)     ", 100, [&]() {
+        auto s = stream;
+        rdb.deepFetch(s);
+    });
+    perQuery("deepFetch(station)    ", 10, [&]() {
+        auto s = station;
+        rdb.deepFetch(s);
+    });
+    perQuery("searchTracks          ", 1000, [&]() { rdb.searchTracks("artist1234"); });
+    perQuery("findTracksInfo cursor ", 100, [&]() {
+        relive::ReLiveDB::FindTracksCursor cursor("%artist1234%");
+        rdb.findTracksInfo(cursor, 20);
+    });
+}
+
+TEST_CASE("Catalog load versus startup snapshot load (warm connections)", "[benchmark][startup]")
+{
+    relive::dataPath(testDataPath());
+    int64_t activeStream = 0;
+    {
+        relive::ReLiveDB rdb;
+        createSyntheticCatalog(200000);
+        auto catalog = rdb.catalog();
+        activeStream = catalog->streams(1)->front()->_id;
+        REQUIRE(relive::StartupSnapshot(catalog, 1, activeStream, "", 2).save(relive::StartupSnapshot::defaultFile()));
+    }
+    std::cout << "startup snapshot: " << fs::file_size(relive::StartupSnapshot::defaultFile()) << " bytes" << std::endl;
+    // The sqlite connections are process wide and stay open after the first ReLiveDB, so
+    // this compares the catalog query with the snapshot file only. Opening the database,
+    // the rest of the time to the first frame, is the same for both and not measured.
+    measure("full catalog from the database", 5, [&]() {
+        relive::ReLiveDB rdb;
+        return rdb.catalog()->streams(1)->size();
+    });
+    measure("startup snapshot from its file", 5, [&]() {
+        relive::StartupSnapshot snapshot;
+        snapshot.load(relive::StartupSnapshot::defaultFile());
+        return snapshot.catalog()->stream(activeStream)->_tracks.size();
+    });
+}
+
+TEST_CASE("Startup to the first frame without a startup snapshot", "[benchmark][startup]")
+{
+    relive::dataPath(testDataPath());
+    {
+        relive::ReLiveDB rdb;
+        createSyntheticCatalog(200000);
+    }
+    fs::remove(relive::StartupSnapshot::defaultFile());
+    // a first start after an update that recreated the tables also has to set up the search index
+    REQUIRE(execSql("DROP TABLE tracks_fts; DROP TABLE streams_fts; DROP TRIGGER tracks_fts_ai; DROP TRIGGER tracks_fts_ad; DROP TRIGGER tracks_fts_au;"
+                    "DROP TRIGGER streams_fts_ai; DROP TRIGGER streams_fts_ad; DROP TRIGGER streams_fts_au;"));
+    // What ReLiveApp does on the ui thread up to its first frame, minus the fonts and the
+    // window: construct the backend, read the settings, miss the snapshot and go on with
+    // an empty catalog. The sqlite connections stay open from the case before, so the
+    // time to open the database file is not in it.
+    std::atomic_bool catalogLoaded{false};
+    auto start = Clock::now();
+    relive::ReLiveDB rdb;
+    relive::SearchService search(rdb);
+    relive::ChatService chatService(rdb);
+    auto subscription = rdb.subscribeCatalog([&](std::shared_ptr<const relive::Catalog>) { catalogLoaded = true; });
+    rdb.getConfigValue(relive::Keys::output_device, std::string());
+    rdb.getConfigValue(relive::Keys::use_dark_theme, false);
+    rdb.getConfigValue(relive::Keys::show_buffer_bar, false);
+    rdb.getConfigValue(relive::Keys::start_at_last_position, false);
+    rdb.getConfigValue(relive::Keys::name_color_seed, 0);
+    rdb.getConfigValue(relive::Keys::player_volume, 100);
+    rdb.getConfigValue(relive::Keys::media_cache_size, int64_t(0));
+    relive::StartupSnapshot snapshot;
+    REQUIRE_FALSE(snapshot.load(relive::StartupSnapshot::defaultFile()));
+    auto catalog = std::make_shared<relive::Catalog>(0, std::vector<relive::Catalog::StationPtr>(), std::unordered_map<int64_t, relive::Catalog::StreamListPtr>());
+    CHECK(catalog->streams(0)->empty());
+    auto firstFrameMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    // the sync thread of the app loads the catalog after the first frame
+    std::thread loader([&]() { rdb.catalog(); });
+    loader.join();
+    auto catalogMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    CHECK(catalogLoaded);
+    while (!rdb.hasFullTextSearch() && std::chrono::duration<double>(Clock::now() - start).count() < 60) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto searchMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "first frame after " << firstFrameMs << "ms, catalog after " << catalogMs << "ms, search index after " << searchMs << "ms" << std::endl;
+    // neither the catalog nor the search index may be waited for before the first frame
+    CHECK(rdb.hasFullTextSearch());
+    REQUIRE(firstFrameMs < (catalogMs - firstFrameMs) / 2);
+    REQUIRE(firstFrameMs < (searchMs - firstFrameMs) / 2);
+}
+
+TEST_CASE("Chat storage of a long show", "[benchmark][chat]")
+{
+    // about eight hours of a busy channel with a few hundred distinct nicks
+    std::mt19937 rng(42);
+    nlohmann::json messages = nlohmann::json::array();
+    for (int i = 0; i < 100000; ++i) {
+        auto nick = "listener" + std::to_string(rng() % 300);
+        messages.push_back({{"time", i / 4}, {"messageType", i % 20 ? "Message" : "Join"}, {"strings", i % 20 ? nlohmann::json{nick, "message number " + std::to_string(i) + " about the current track"} : nlohmann::json{nick}}});
+    }
+    auto body = nlohmann::json{{"messages", messages}}.dump();
+    auto start = Clock::now();
+    std::vector<relive::ChatMessage> chat;
+    auto parsed = nlohmann::json::parse(body);
+    for (const auto& message : parsed.at("messages")) {
+        relive::ChatMessage msg;
+        msg._time = message.at("time").get<int>();
+        msg._type = relive::ChatMessage::eMessage;
+        for (const auto& str : message.at("strings")) {
+            msg._strings.push_back(str);
+        }
+        chat.push_back(msg);
+    }
+    auto vectorMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    size_t vectorBytes = chat.capacity() * sizeof(relive::ChatMessage);
+    for (const auto& msg : chat) {
+        vectorBytes += msg._strings.capacity() * sizeof(std::string);
+        for (const auto& str : msg._strings) {
+            vectorBytes += str.capacity() > 15 ? str.capacity() + 1 : 0;
+        }
+    }
+    start = Clock::now();
+    relive::ChatLog::Builder builder;
+    std::vector<std::string> strings;
+    parsed = nlohmann::json();
+    relive::JsonRecordReader reader("messages", [&](const nlohmann::json& message) {
+        strings.clear();
+        for (const auto& str : message.at("strings")) {
+            strings.push_back(str);
+        }
+        builder.add(message.at("time").get<int>(), relive::ChatMessage::eMessage, strings);
+    });
+    reader.parse(body);
+    auto chatLog = builder.build();
+    auto chatLogMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    TemporaryDirectory t;
+    auto filename = (t.path() / "chat.chat").string();
+    chatLog.save(filename);
+    start = Clock::now();
+    relive::ChatLog mapped;
+    mapped.load(filename);
+    auto mappedMs = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    std::cout << "vector<ChatMessage>: " << vectorMs << "ms to parse, " << vectorBytes / chat.size() << " bytes per message" << std::endl;
+    std::cout << "ChatLog (SAX):       " << chatLogMs << "ms to parse, " << chatLog.byteSize() / chatLog.size() << " bytes per message" << std::endl;
+    std::cout << "ChatLog from cache:  " << mappedMs << "ms to map " << mapped.size() << " messages" << std::endl;
+}
+
+TEST_CASE("RingBuffer throughput and worst case pull latency", "[benchmark][ringbuffer]")
+{
+    {
+        MutexRingBuffer<int16_t> rb(16 * 1024);
+        runRingBufferBenchmark("mutex ring buffer   ", rb);
+    }
+    {
+        RingBuffer<int16_t> rb(16 * 1024);
+        runRingBufferBenchmark("lock-free ring buffer", rb);
+    }
+}
+
+TEST_CASE("Sync job scheduling and progress reporting", "[benchmark][scheduler]")
+{
+    // a sync in miniature: one job fans out into station jobs, each into stream jobs
+    const int numStations = 10, numStreams = 100;
+    std::atomic<int64_t> lastCompletion{0};
+    auto work = [&](int ms) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+        lastCompletion = Clock::now().time_since_epoch().count();
+    };
+    auto report = [&](const std::string& name, Clock::time_point start, int progressReports) {
+        auto end = Clock::now();
+        auto idleMs = std::chrono::duration<double, std::milli>(end.time_since_epoch() - Clock::duration(lastCompletion.load())).count();
+        std::cout << name << ": " << std::chrono::duration<double, std::milli>(end - start).count() << "ms, " << progressReports << " progress reports, " << idleMs << "ms from the last job to the end" << std::endl;
+    };
+    {
+        pearce::ThreadPool pool(8);
+        std::mutex jobsMutex;
+        std::list<pearce::ThreadPool::TaskFuture<void>> jobs;
+        std::function<void(int)> job = [&](int level) {
+            work(level == 2 ? 2 : 5);
+            if (level < 2) {
+                std::lock_guard<std::mutex> lock{jobsMutex};
+                for (int i = 0; i < (level ? numStreams : numStations); ++i) {
+                    jobs.push_back(pool.submit(job, level + 1));
+                }
+            }
+        };
+        auto start = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock{jobsMutex};
+            jobs.push_back(pool.submit(job, 0));
+        }
+        int progressReports = 0;
+        while (true) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+            std::lock_guard<std::mutex> lock{jobsMutex};
+            ++progressReports;
+            jobs.remove_if([](pearce::ThreadPool::TaskFuture<void>& future) { return future.isReady(); });
+            if (jobs.empty() && !pool.workLeft()) {
+                break;
+            }
+        }
+        report("ThreadPool, polled futures  ", start, progressReports);
+    }
+    {
+        relive::TaskScheduler scheduler(8);
+        int progressReports = 0;
+        auto counter = std::make_shared<relive::TaskScheduler::Counter>([&](size_t, size_t) { ++progressReports; });
+        std::function<void(int)> job = [&](int level) {
+            work(level == 2 ? 2 : 5);
+            for (int i = 0; level < 2 && i < (level ? numStreams : numStations); ++i) {
+                scheduler.submit([&job, level]() { job(level + 1); }, level ? relive::TaskScheduler::eNormal : relive::TaskScheduler::eHigh, counter);
+            }
+        };
+        auto start = Clock::now();
+        scheduler.submit([&job]() { job(0); }, relive::TaskScheduler::eHigh, counter);
+        counter->wait();
+        report("TaskScheduler, counter     ", start, progressReports);
+    }
+}
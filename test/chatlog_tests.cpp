@@ -0,0 +1,86 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include "helper.hpp"
+#include <backend/chatlog.hpp>
+
+using relive::ChatLog;
+using relive::ChatMessage;
+
+static ChatLog testChat()
+{
+    ChatLog::Builder builder;
+    builder.add(10, ChatMessage::eJoin, {"alice"});
+    builder.add(12, ChatMessage::eMessage, {"alice", "hello"});
+    builder.add(15, ChatMessage::eMessage, {"bob@", "hi alice"});
+    builder.add(20, ChatMessage::eQuit, {"alice", "bye", "Client exited"});
+    builder.add(25, ChatMessage::eUnknown, {"server notice"});
+    builder.add(30, ChatMessage::eMessage, {});
+    return builder.build();
+}
+
+TEST_CASE("ChatLog stores messages in columns with interned nicks", "[chatlog]")
+{
+    auto chat = testChat();
+    REQUIRE(chat.size() == 6);
+    CHECK(chat.numNicks() == 3);
+    CHECK(chat.time(2) == 15);
+    CHECK(chat.type(3) == ChatMessage::eQuit);
+    CHECK(chat.numStrings(0) == 1);
+    CHECK(chat.numStrings(3) == 3);
+    CHECK(chat.numStrings(5) == 0);
+    CHECK(chat.string(3, 0) == "alice");
+    CHECK(chat.string(3, 1) == "bye");
+    CHECK(chat.lastString(3) == "Client exited");
+    CHECK(chat.string(3, 3).empty());
+    CHECK(chat.lastString(5).empty());
+    CHECK(chat.nick(2) == "bob");
+    CHECK(chat.string(2, 0) == "bob@");
+    CHECK(!chat.hasNick(4));
+    CHECK(chat.nick(4).empty());
+    CHECK(!chat.hasNick(5));
+    for (size_t i = 0; i < chat.size(); ++i) {
+        auto msg = chat.message(i);
+        CHECK(msg._time == chat.time(i));
+        CHECK(msg.hasNick() == chat.hasNick(i));
+        CHECK(msg.nick() == std::string(chat.nick(i)));
+        CHECK(msg._strings.size() == chat.numStrings(i));
+    }
+    auto moved = std::move(chat);
+    CHECK(moved.size() == 6);
+    CHECK(chat.empty());
+    CHECK(ChatLog::Builder().build().empty());
+}
+
+TEST_CASE("ChatLog persistence", "[chatlog]")
+{
+    TemporaryDirectory t;
+    auto filename = (t.path() / "sub" / "1_2_3.chat").string();
+    auto chat = testChat();
+    REQUIRE(chat.save(filename));
+    ChatLog loaded;
+    REQUIRE(loaded.load(filename));
+    REQUIRE(loaded.size() == chat.size());
+    CHECK(loaded.byteSize() == chat.byteSize());
+    CHECK(loaded.lastString(2) == "hi alice");
+    CHECK(loaded.nick(3) == "alice");
+    CHECK(loaded.time(5) == 30);
+    {
+        fs::ofstream os(t.path() / "broken.chat");
+        os << "garbage";
+    }
+    CHECK(!loaded.load((t.path() / "broken.chat").string()));
+    CHECK(loaded.empty());
+    {
+        // a truncated image is rejected too
+        fs::ifstream is(fs::path(filename), std::ios::binary);
+        std::string image((std::istreambuf_iterator<char>(is)), std::istreambuf_iterator<char>());
+        fs::ofstream os(t.path() / "truncated.chat", std::ios::binary);
+        os.write(image.data(), image.size() - 3);
+    }
+    CHECK(!loaded.load((t.path() / "truncated.chat").string()));
+    CHECK(!loaded.load((t.path() / "missing.chat").string()));
+}
@@ -0,0 +1,90 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include "helper.hpp"
+#include <backend/chatservice.hpp>
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace std::chrono_literals;
+using relive::ChatService;
+
+static bool waitForChat(ChatService& service, ChatService::Result& result)
+{
+    auto timeout = std::chrono::steady_clock::now() + 5s;
+    while (std::chrono::steady_clock::now() < timeout) {
+        if (service.poll(result)) {
+            return true;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+    return false;
+}
+
+// a stream whose chat is already in the chat cache, so no download is needed
+static relive::Stream cachedStream(int64_t id, int messages)
+{
+    relive::Stream stream;
+    stream._id = id;
+    stream._stationId = 77;
+    stream._reliveId = id;
+    stream._chatChecksum = 4711;
+    relive::ChatLog::Builder builder;
+    for (int i = 0; i < messages; ++i) {
+        builder.add(i, relive::ChatMessage::eMessage, {"nick", "message " + std::to_string(i)});
+    }
+    builder.build().save((testDataPath() / "chatcache" / ("77_" + std::to_string(id) + "_4711.chat")).string());
+    return stream;
+}
+
+TEST_CASE("ChatService loads the chat of the latest request", "[chatservice]")
+{
+    relive::dataPath(testDataPath());
+    relive::ReLiveDB rdb;
+    ChatService service(rdb);
+    ChatService::Result result;
+    CHECK(!service.poll(result));
+
+    SECTION("a cached chat is delivered once")
+    {
+        auto generation = service.load(cachedStream(1001, 50));
+        REQUIRE(waitForChat(service, result));
+        CHECK(result._generation == generation);
+        CHECK(result._streamId == 1001);
+        CHECK(result._chat.size() == 50);
+        CHECK(result._chat.lastString(49) == "message 49");
+        CHECK(!service.poll(result));
+        CHECK(!service.busy());
+    }
+    SECTION("newer requests supersede older ones")
+    {
+        auto first = cachedStream(1002, 10);
+        auto second = cachedStream(1003, 20);
+        service.load(first);
+        auto generation = service.load(second);
+        REQUIRE(waitForChat(service, result));
+        CHECK(result._generation == generation);
+        CHECK(result._streamId == 1003);
+        CHECK(result._chat.size() == 20);
+    }
+    SECTION("a cancelled request delivers nothing")
+    {
+        service.load(cachedStream(1004, 10));
+        service.cancel();
+        std::this_thread::sleep_for(50ms);
+        CHECK(!service.poll(result));
+    }
+    SECTION("streams without a chat deliver an empty one")
+    {
+        relive::Stream stream;
+        stream._id = 1005;
+        service.load(stream);
+        REQUIRE(waitForChat(service, result));
+        CHECK(result._streamId == 1005);
+        CHECK(result._chat.empty());
+    }
+}
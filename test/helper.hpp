@@ -1,6 +1,7 @@
 #pragma once
 
 #include <backend/system.hpp>
+#include <sqlite3.h>
 namespace fs = ghc::filesystem;
 
 enum class TempOpt { none, change_path };
@@ -41,4 +42,20 @@ private:
     fs::path _orig_dir;
 };
 
+// the database connections live for the whole process, so all database tests share one data directory
+inline const fs::path& testDataPath()
+{
+    static TemporaryDirectory t;
+    return t.path();
+}
 
+// run sql on the test database through a separate connection, bypassing the backend
+inline bool execSql(const std::string& sql)
+{
+    sqlite3* db = nullptr;
+    bool ok = sqlite3_open((testDataPath() / "relive.sqlite").string().c_str(), &db) == SQLITE_OK;
+    // a ReLiveDB may be writing in the background, e.g. building the search index
+    ok = ok && sqlite3_busy_timeout(db, 5000) == SQLITE_OK && sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK;
+    sqlite3_close(db);
+    return ok;
+}
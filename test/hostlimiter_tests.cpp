@@ -0,0 +1,199 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include <backend/hostlimiter.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using relive::HostLimiter;
+using relive::TaskScheduler;
+using Clock = std::chrono::steady_clock;
+
+TEST_CASE("HostLimiter keeps a slow host from starving the others", "[hostlimiter]")
+{
+    TaskScheduler scheduler(4);
+    HostLimiter::Config config;
+    config.initialConcurrency = 2;
+    config.maxConcurrency = 2;
+    HostLimiter limiter(scheduler, config);
+    auto counter = std::make_shared<TaskScheduler::Counter>();
+    std::atomic<int> running{0}, maxRunning{0};
+    std::atomic<int64_t> slowDone{0}, fastDone{0};
+    auto start = Clock::now();
+    auto elapsed = [&]() { return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count(); };
+    for (int i = 0; i < 20; ++i) {
+        limiter.submit(ghc::net::uri("http://slow.invalid/api/"), [&]() {
+            auto now = ++running;
+            for (int max = maxRunning; now > max && !maxRunning.compare_exchange_weak(max, now);) {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+            --running;
+            slowDone = elapsed();
+            return HostLimiter::eDone;
+        }, TaskScheduler::eNormal, counter);
+    }
+    for (int i = 0; i < 10; ++i) {
+        limiter.submit(ghc::net::uri("http://fast.invalid/api/"), [&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            fastDone = elapsed();
+            return HostLimiter::eDone;
+        }, TaskScheduler::eNormal, counter);
+    }
+    CHECK(counter->submitted() == 30);
+    REQUIRE(counter->waitFor(std::chrono::seconds(30)));
+    CHECK(maxRunning <= 2);
+    // the slow host needs ten rounds of two, the fast one runs beside it
+    CHECK(fastDone < slowDone / 2);
+    auto stats = limiter.stats();
+    REQUIRE(stats.count("http://slow.invalid:80"));
+    CHECK(stats["http://slow.invalid:80"]._jobs == 20);
+    CHECK(stats["http://slow.invalid:80"]._latencyMs >= 15);
+    CHECK(stats["http://fast.invalid:80"]._jobs == 10);
+}
+
+TEST_CASE("HostLimiter retries transient failures with backoff", "[hostlimiter]")
+{
+    TaskScheduler scheduler(2);
+    HostLimiter::Config config;
+    config.maxRetries = 3;
+    config.baseBackoff = std::chrono::milliseconds(20);
+    HostLimiter limiter(scheduler, config);
+    auto counter = std::make_shared<TaskScheduler::Counter>();
+    std::atomic<int> attempts{0}, hopeless{0};
+    auto start = Clock::now();
+    limiter.submit(ghc::net::uri("https://flaky.invalid/"), [&]() { return ++attempts < 3 ? HostLimiter::eRetry : HostLimiter::eDone; }, TaskScheduler::eNormal, counter);
+    limiter.submit(ghc::net::uri("https://down.invalid/"), [&]() {
+        ++hopeless;
+        return HostLimiter::eRetry;
+    }, TaskScheduler::eNormal, counter);
+    REQUIRE(counter->waitFor(std::chrono::seconds(30)));
+    CHECK(attempts == 3);
+    CHECK(hopeless == 4);
+    // at least half of 20ms + 40ms + 80ms of backoff for the hopeless one
+    CHECK(Clock::now() - start >= std::chrono::milliseconds(70));
+    auto stats = limiter.stats();
+    CHECK(stats["https://flaky.invalid:443"]._retries == 2);
+    CHECK(stats["https://flaky.invalid:443"]._jobs == 1);
+    CHECK(stats["https://flaky.invalid:443"]._failures == 0);
+    CHECK(stats["https://down.invalid:443"]._retries == 3);
+    CHECK(stats["https://down.invalid:443"]._failures == 1);
+    CHECK(stats["https://down.invalid:443"]._concurrency == 1);
+}
+
+TEST_CASE("HostLimiter completes the counters of jobs dropped on shutdown", "[hostlimiter]")
+{
+    TaskScheduler scheduler(2);
+    auto counter = std::make_shared<TaskScheduler::Counter>();
+    std::atomic<int> executed{0};
+    {
+        HostLimiter::Config config;
+        config.initialConcurrency = 1;
+        config.maxConcurrency = 1;
+        config.baseBackoff = std::chrono::milliseconds(10000);
+        HostLimiter limiter(scheduler, config);
+        limiter.submit(ghc::net::uri("https://down.invalid/"), [&]() {
+            ++executed;
+            return HostLimiter::eRetry;
+        }, TaskScheduler::eNormal, counter);
+        for (int i = 0; i < 5; ++i) {
+            limiter.submit(ghc::net::uri("https://down.invalid/"), [&]() {
+                ++executed;
+                return HostLimiter::eDone;
+            }, TaskScheduler::eNormal, counter);
+        }
+        // the host pauses for the backoff of the first job, the others wait in the limiter
+        while (!limiter.stats()["https://down.invalid:443"]._retries) {
+            std::this_thread::yield();
+        }
+    }
+    REQUIRE(counter->waitFor(std::chrono::seconds(5)));
+    CHECK(counter->completed() == 6);
+    CHECK(executed == 1);
+}
+
+TEST_CASE("HostLimiter drops waiting and later jobs after cancel", "[hostlimiter]")
+{
+    TaskScheduler scheduler(2);
+    HostLimiter::Config config;
+    config.initialConcurrency = 1;
+    config.maxConcurrency = 1;
+    HostLimiter limiter(scheduler, config);
+    auto counter = std::make_shared<TaskScheduler::Counter>();
+    std::atomic<int> executed{0};
+    std::atomic_bool started{false};
+    std::atomic_bool release{false};
+    limiter.submit(ghc::net::uri("https://slow.invalid/"), [&]() {
+        started = true;
+        while (!release) {
+            std::this_thread::yield();
+        }
+        ++executed;
+        // not retried after the cancel
+        return HostLimiter::eRetry;
+    }, TaskScheduler::eNormal, counter);
+    for (int i = 0; i < 5; ++i) {
+        limiter.submit(ghc::net::uri("https://slow.invalid/"), [&]() {
+            ++executed;
+            return HostLimiter::eDone;
+        }, TaskScheduler::eNormal, counter);
+    }
+    while (!started) {
+        std::this_thread::yield();
+    }
+    limiter.cancel();
+    CHECK(counter->completed() == 5);
+    limiter.submit(ghc::net::uri("https://slow.invalid/"), [&]() {
+        ++executed;
+        return HostLimiter::eDone;
+    }, TaskScheduler::eNormal, counter);
+    CHECK(counter->submitted() == 6);
+    release = true;
+    REQUIRE(counter->waitFor(std::chrono::seconds(5)));
+    CHECK(executed == 1);
+    CHECK(limiter.stats()["https://slow.invalid:443"]._retries == 0);
+}
+
+TEST_CASE("HostLimiter raises the limit of a responsive host", "[hostlimiter]")
+{
+    TaskScheduler scheduler(8);
+    HostLimiter::Config config;
+    config.initialConcurrency = 1;
+    config.maxConcurrency = 6;
+    HostLimiter limiter(scheduler, config);
+    auto counter = std::make_shared<TaskScheduler::Counter>();
+    for (int i = 0; i < 60; ++i) {
+        limiter.submit(ghc::net::uri("http://quick.invalid/"), []() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            return HostLimiter::eDone;
+        }, TaskScheduler::eNormal, counter);
+    }
+    REQUIRE(counter->waitFor(std::chrono::seconds(30)));
+    CHECK(limiter.stats()["http://quick.invalid:80"]._concurrency > 1);
+}
+
+TEST_CASE("HostLimiter leaves pooled clients to playback by default", "[hostlimiter]")
+{
+    TaskScheduler scheduler(8);
+    HostLimiter limiter(scheduler);
+    auto counter = std::make_shared<TaskScheduler::Counter>();
+    std::atomic<int> running{0};
+    std::atomic<int> maxRunning{0};
+    for (int i = 0; i < 100; ++i) {
+        limiter.submit(ghc::net::uri("http://quick.invalid/"), [&]() {
+            auto now = ++running;
+            auto seen = maxRunning.load();
+            while (now > seen && !maxRunning.compare_exchange_weak(seen, now)) {
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(2));
+            --running;
+            return HostLimiter::eDone;
+        }, TaskScheduler::eNormal, counter);
+    }
+    REQUIRE(counter->waitFor(std::chrono::seconds(30)));
+    CHECK(maxRunning <= int(relive::HttpPool::DefaultMaxPerHost - relive::HttpPool::PlaybackReserve));
+}
@@ -0,0 +1,75 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include <backend/httppool.hpp>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+using relive::HttpPool;
+
+TEST_CASE("HttpPool reuses returned clients per host", "[httppool]")
+{
+    auto& pool = HttpPool::instance();
+    auto before = pool.stats();
+    httplib::Client* first = nullptr;
+    {
+        auto lease = pool.acquire(ghc::net::uri("http://pool-test-a.invalid/api/"));
+        REQUIRE(lease);
+        first = &*lease;
+        auto other = pool.acquire(ghc::net::uri("http://pool-test-a.invalid/other"));
+        CHECK(&*other != first);
+        auto otherHost = pool.acquire(ghc::net::uri("http://pool-test-a.invalid:8080/api/"));
+        CHECK(pool.stats()._leased == before._leased + 3);
+    }
+    auto stats = pool.stats();
+    CHECK(stats._created == before._created + 3);
+    CHECK(stats._leased == before._leased);
+    CHECK(stats._idle == before._idle + 3);
+    {
+        auto lease = pool.acquire(ghc::net::uri("http://pool-test-a.invalid/"));
+        auto again = pool.acquire(ghc::net::uri("http://pool-test-a.invalid/"));
+        CHECK((&*lease == first || &*again == first));
+        CHECK(pool.stats()._reused == stats._reused + 2);
+        lease.discard();
+    }
+    stats = pool.stats();
+    CHECK(stats._created == before._created + 3);
+    CHECK(stats._discarded == before._discarded + 1);
+    CHECK(stats._idle == before._idle + 2);
+    pool.clear();
+    CHECK(pool.stats()._idle == 0);
+}
+
+TEST_CASE("HttpPool bounds the clients leased per host", "[httppool]")
+{
+    auto& pool = HttpPool::instance();
+    auto maxPerHost = pool.maxPerHost();
+    pool.maxPerHost(1);
+    auto before = pool.stats();
+    auto lease = pool.acquire(ghc::net::uri("https://pool-test-b.invalid/"));
+    auto otherHost = pool.acquire(ghc::net::uri("https://pool-test-c.invalid/"));
+    httplib::Client* first = &*lease;
+    httplib::Client* second = nullptr;
+    std::atomic_bool done{false};
+    std::thread waiter([&]() {
+        auto next = pool.acquire(ghc::net::uri("https://pool-test-b.invalid/stream"));
+        second = &*next;
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    CHECK(!done);
+    lease.release();
+    waiter.join();
+    CHECK(done);
+    CHECK(second == first);
+    auto stats = pool.stats();
+    CHECK(stats._waits == before._waits + 1);
+    CHECK(stats._created == before._created + 2);
+    pool.maxPerHost(maxPerHost);
+    otherHost.release();
+    pool.clear();
+}
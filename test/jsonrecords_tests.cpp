@@ -0,0 +1,48 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include <backend/jsonrecords.hpp>
+#include <string>
+#include <vector>
+
+using relive::JsonRecordReader;
+
+TEST_CASE("JsonRecordReader hands out the records one by one", "[jsonrecords]")
+{
+    const std::string text = R"({"stationName": "Station", "version": 11, "meta": {"a": [1, 2]},
+        "streams": [{"id": 1, "streamName": "First", "mediaDirectUrls": ["http://a", "http://b"]},
+                    {"id": 2, "streamName": "Second", "mediaDirectUrls": [], "nested": {"deep": [[1], [2, {"x": null}]]}},
+                    42],
+        "liveStreamUrl": "http://live"})";
+    std::vector<nlohmann::json> records;
+    JsonRecordReader reader("streams", [&](const nlohmann::json& record) { records.push_back(record); });
+    REQUIRE(reader.parse(text));
+    CHECK(reader.numRecords() == 3);
+    REQUIRE(records.size() == 3);
+    CHECK(records[0] == nlohmann::json::parse(R"({"id": 1, "streamName": "First", "mediaDirectUrls": ["http://a", "http://b"]})"));
+    CHECK(records[1].at("nested").at("deep")[1][1].at("x").is_null());
+    CHECK(records[2] == 42);
+    CHECK(reader.header().at("stationName") == "Station");
+    CHECK(reader.header().at("version") == 11);
+    CHECK(reader.header().at("meta").at("a")[1] == 2);
+    CHECK(reader.header().at("liveStreamUrl") == "http://live");
+    CHECK(!reader.header().count("streams"));
+}
+
+TEST_CASE("JsonRecordReader reports invalid input", "[jsonrecords]")
+{
+    int count = 0;
+    JsonRecordReader reader("tracks", [&](const nlohmann::json&) { ++count; });
+    CHECK(!reader.parse(R"({"tracks": [{"time": 1}, {"time": )"));
+    CHECK(count == 1);
+    CHECK(!reader.error().empty());
+    CHECK(!reader.parse("[1, 2]"));
+    CHECK(reader.parse(R"({"other": []})"));
+    CHECK(reader.numRecords() == 0);
+    CHECK(reader.error().empty());
+    JsonRecordReader throwing("tracks", [](const nlohmann::json& record) { record.at("missing"); });
+    CHECK_THROWS_AS(throwing.parse(R"({"tracks": [{"time": 1}]})"), nlohmann::json::exception);
+}
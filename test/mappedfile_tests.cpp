@@ -0,0 +1,25 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include "helper.hpp"
+#include <backend/mappedfile.hpp>
+#include <cstring>
+
+TEST_CASE("MappedFile maps whole file read-only", "[mappedfile]")
+{
+    TemporaryDirectory t;
+    std::string content(100000, 'x');
+    content[99999] = 'y';
+    {
+        fs::ofstream os(t.path() / "test.bin", std::ios::binary);
+        os.write(content.data(), content.size());
+    }
+    relive::MappedFile file((t.path() / "test.bin").string());
+    REQUIRE(file.isOpen());
+    REQUIRE(file.size() == content.size());
+    CHECK(std::memcmp(file.data(), content.data(), content.size()) == 0);
+    CHECK(!relive::MappedFile((t.path() / "missing.bin").string()).isOpen());
+}
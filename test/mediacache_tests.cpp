@@ -0,0 +1,88 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include "helper.hpp"
+#include <backend/mediacache.hpp>
+#include <string>
+#include <vector>
+
+using relive::MediaCache;
+
+static std::vector<char> testBlock(char fill, size_t size = MediaCache::BlockSize)
+{
+    return std::vector<char>(size, fill);
+}
+
+TEST_CASE("MediaCache stores and reads blocks", "[mediacache]")
+{
+    TemporaryDirectory t;
+    MediaCache cache(t.path().string(), 16 * MediaCache::BlockSize);
+    MediaCache::Key key{1, 42, 0x1234};
+    auto block = testBlock('a');
+    block[100] = 'x';
+    CHECK(!cache.contains(key, 0));
+    cache.store(key, 0, block.data(), block.size());
+    CHECK(cache.contains(key, 0));
+    CHECK(cache.contains(key, MediaCache::BlockSize - 1));
+    CHECK(!cache.contains(key, MediaCache::BlockSize));
+    CHECK(cache.usedBytes() == MediaCache::BlockSize);
+    std::vector<char> buffer(1000);
+    CHECK(cache.read(key, 100, buffer.data(), buffer.size()) == 1000);
+    CHECK(buffer[0] == 'x');
+    CHECK(buffer[1] == 'a');
+    CHECK(cache.read(key, MediaCache::BlockSize - 10, buffer.data(), buffer.size()) == 10);
+    CHECK(cache.read(MediaCache::Key{1, 42, 0x4321}, 0, buffer.data(), buffer.size()) == 0);
+    // unaligned stores are ignored
+    cache.store(key, 10, block.data(), block.size());
+    CHECK(!cache.contains(key, MediaCache::BlockSize + 10));
+}
+
+TEST_CASE("MediaCache survives restart and evicts least recently used", "[mediacache]")
+{
+    TemporaryDirectory t;
+    MediaCache::Key key{1, 42, 0x1234};
+    {
+        MediaCache cache(t.path().string(), 3 * MediaCache::BlockSize);
+        for (int i = 0; i < 3; ++i) {
+            auto block = testBlock(char('a' + i));
+            cache.store(key, i * MediaCache::BlockSize, block.data(), block.size());
+        }
+    }
+    MediaCache cache(t.path().string(), 3 * MediaCache::BlockSize);
+    CHECK(cache.usedBytes() == 3 * MediaCache::BlockSize);
+    char c = 0;
+    // touch the first and last block, the second one is now the oldest
+    CHECK(cache.read(key, 0, &c, 1) == 1);
+    CHECK(c == 'a');
+    CHECK(cache.read(key, 2 * MediaCache::BlockSize, &c, 1) == 1);
+    CHECK(c == 'c');
+    auto block = testBlock('d', 1000);
+    cache.store(key, 3 * MediaCache::BlockSize, block.data(), block.size());
+    CHECK(cache.contains(key, 0));
+    CHECK(!cache.contains(key, MediaCache::BlockSize));
+    CHECK(cache.contains(key, 2 * MediaCache::BlockSize));
+    CHECK(cache.contains(key, 3 * MediaCache::BlockSize));
+    CHECK(cache.usedBytes() == 2 * MediaCache::BlockSize + 1000);
+    cache.budget(MediaCache::BlockSize);
+    CHECK(cache.usedBytes() <= MediaCache::BlockSize);
+    CHECK(cache.contains(key, 3 * MediaCache::BlockSize));
+}
+
+TEST_CASE("MediaCache drops blocks with outdated media checksum", "[mediacache]")
+{
+    TemporaryDirectory t;
+    MediaCache cache(t.path().string(), 16 * MediaCache::BlockSize);
+    MediaCache::Key oldKey{1, 42, 0x1234};
+    MediaCache::Key otherStream{1, 43, 0x1234};
+    auto block = testBlock('a');
+    cache.store(oldKey, 0, block.data(), block.size());
+    cache.store(otherStream, 0, block.data(), block.size());
+    MediaCache::Key newKey{1, 42, 0x5678};
+    cache.removeStale(newKey);
+    CHECK(!cache.contains(oldKey, 0));
+    CHECK(cache.contains(otherStream, 0));
+    CHECK(cache.usedBytes() == MediaCache::BlockSize);
+}
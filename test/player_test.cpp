@@ -25,6 +25,7 @@ int main(int argc, char* argv[])
         Player::Mode mode = Player::eFile;
         ghc::options parser(argc, argv);
         std::vector<ghc::net::uri> uris;
+        bool showStats = false;
         parser.onOpt({"-?", "-h", "--help"}, "Output this help text", [&](const std::string&){
           parser.usage(std::cout);
           exit(0);
@@ -41,6 +42,12 @@ int main(int argc, char* argv[])
         parser.onOpt({"-l", "--live"}, "Select Icecast/Shoutcast-Mode", [&](const std::string&){
           mode = Player::eSCastStream;
         });
+        parser.onOpt({"-s", "--stats"}, "Dump a histogram of audio callback durations at the end", [&](const std::string&){
+          showStats = true;
+        });
+        parser.onOpt({"-d!", "--decode-ahead!"}, "<ms>\tMilliseconds of audio to decode ahead of playback", [&](const std::string& arg){
+          player.decodeAhead(std::stoi(arg));
+        });
         parser.onPositional("URI to play", [&](const std::string& arg){ uris.emplace_back(arg); });
         parser.parse();
 
@@ -52,6 +59,15 @@ int main(int argc, char* argv[])
                 std::cout << "time: " << relive::formattedDuration(player.playTime()) << std::endl;
                 std::this_thread::sleep_for(std::chrono::seconds(1));
             }
+            if (showStats) {
+                auto histogram = player.callbackHistogram();
+                std::cout << "audio callbacks: " << histogram._count << ", max: " << histogram._maxMicroseconds << "us" << std::endl;
+                for (int i = 0; i < Player::CallbackHistogram::NumBuckets; ++i) {
+                    if (histogram._buckets[i]) {
+                        std::cout << "    < " << (1ll << i) << "us: " << histogram._buckets[i] << std::endl;
+                    }
+                }
+            }
         }
     }
     catch(std::exception& ex) {
@@ -0,0 +1,96 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include <backend/netutility.hpp>
+#include <backend/prefetcher.hpp>
+#include <chrono>
+#include <string>
+#include <thread>
+
+namespace {
+
+// serves a generated "media file" with getmediadata range semantics and artificial latency
+class MediaServer
+{
+public:
+    MediaServer(size_t size, std::chrono::milliseconds latency)
+    {
+        _data.resize(size);
+        for (size_t i = 0; i < size; ++i) {
+            _data[i] = static_cast<char>((i * 7 + i / 251) & 0xff);
+        }
+        _server.Get("/getmediadata/", [this, latency](const httplib::Request& req, httplib::Response& res) {
+            std::this_thread::sleep_for(latency);
+            auto start = std::stoll(req.get_param_value("start"));
+            auto length = std::stoll(req.get_param_value("length"));
+            if (start < 0 || start >= int64_t(_data.size())) {
+                res.status = 416;
+                return;
+            }
+            length = (std::min)(length, int64_t(_data.size()) - start);
+            res.set_content(_data.substr(static_cast<size_t>(start), static_cast<size_t>(length)), "application/octet-stream");
+        });
+        _port = _server.bind_to_any_port("127.0.0.1");
+        _thread = std::thread([this]() { _server.listen_after_bind(); });
+    }
+    ~MediaServer()
+    {
+        _server.stop();
+        _thread.join();
+    }
+    ghc::net::uri uri() const { return ghc::net::uri("http://127.0.0.1:" + std::to_string(_port) + "/getmediadata/?v=11&streamid=1"); }
+    const std::string& data() const { return _data; }
+
+private:
+    std::string _data;
+    httplib::Server _server;
+    int _port = 0;
+    std::thread _thread;
+};
+
+std::string readAll(relive::RangePrefetcher& prefetcher, size_t size)
+{
+    std::string result;
+    char buffer[10000];
+    auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+    while (result.size() < size && std::chrono::steady_clock::now() < timeout) {
+        if (prefetcher.waitForData(std::chrono::milliseconds(100))) {
+            auto len = prefetcher.read(buffer, (std::min)(sizeof(buffer), size - result.size()));
+            result.append(buffer, len);
+        }
+    }
+    return result;
+}
+
+}  // namespace
+
+TEST_CASE("RangePrefetcher delivers a stream in order", "[prefetcher]")
+{
+    MediaServer server(3 * 1024 * 1024 + 1234, std::chrono::milliseconds(20));
+    relive::RangePrefetcher::Config config;
+    config.maxAhead = 1024 * 1024;
+    relive::RangePrefetcher prefetcher(server.uri(), server.data().size(), config);
+    prefetcher.start(0);
+    auto result = readAll(prefetcher, server.data().size());
+    CHECK(result.size() == server.data().size());
+    CHECK(result == server.data());
+    CHECK(prefetcher.finished());
+    CHECK(prefetcher.throughput() > 0);
+    CHECK(prefetcher.concurrency() >= 1);
+    CHECK(prefetcher.concurrency() <= config.maxConcurrency);
+}
+
+TEST_CASE("RangePrefetcher restarts on seek", "[prefetcher]")
+{
+    MediaServer server(1024 * 1024, std::chrono::milliseconds(10));
+    relive::RangePrefetcher prefetcher(server.uri(), server.data().size());
+    prefetcher.start(0);
+    CHECK(readAll(prefetcher, 1000) == server.data().substr(0, 1000));
+    prefetcher.start(500000);
+    CHECK(prefetcher.position() == 500000);
+    auto result = readAll(prefetcher, server.data().size() - 500000);
+    CHECK(result == server.data().substr(500000));
+}
@@ -7,14 +7,106 @@
 #include "catch.hpp"
 #include "helper.hpp"
 #include <backend/relivedb.hpp>
+#include <backend/netutility.hpp>
 #include <backend/system.hpp>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
 
 using namespace std::string_literals;
 
+namespace {
+
+// a reLive master and station API with one station of three streams of two tracks each
+class ReLiveServer
+{
+public:
+    ReLiveServer()
+    {
+        _server.Get("/getstations/", [this](const httplib::Request&, httplib::Response& res) {
+            count("getstations");
+            res.set_content(R"({"stations":[{"id":1,"name":"Station","servers":[")" + api() + R"("]}]})", "application/json");
+        });
+        _server.Get("/api/getstationinfo", [this](const httplib::Request&, httplib::Response& res) {
+            count("getstationinfo");
+            std::string streams;
+            for (int i = 1; i <= 3; ++i) {
+                streams += std::string(i > 1 ? "," : "") + R"({"id":)" + std::to_string(i) + R"(,"streamName":"Show )" + std::to_string(i) + R"(","hostName":"Host","description":"","timestamp":)" +
+                           std::to_string(1000 * i) + R"(,"duration":3600,"size":0,"mediaDataFormat":"mp3","mediaDataOffset":0,"checksumStreamInfoData":)" + std::to_string(i) +
+                           R"(,"checksumChatData":0,"checksumMediaData":0,"mediaDirectUrls":[]})";
+            }
+            res.set_content(R"({"stationName":"Station","version":11,"webSiteUrl":"","liveStreamUrl":"","streams":[)" + streams + "]}", "application/json");
+        });
+        _server.Get("/api/getstreaminfo", [this](const httplib::Request& req, httplib::Response& res) {
+            count("getstreaminfo");
+            auto id = req.get_param_value("streamid");
+            res.set_content(R"({"tracks":[{"trackType":"Music","trackName":"First )" + id + R"(","artistName":"A","time":0},{"trackType":"Music","trackName":"Second )" + id + R"(","artistName":"B","time":600}]})",
+                            "application/json");
+        });
+        _port = _server.bind_to_any_port("127.0.0.1");
+        _thread = std::thread([this]() { _server.listen_after_bind(); });
+    }
+    ~ReLiveServer()
+    {
+        _server.stop();
+        _thread.join();
+    }
+    ghc::net::uri master() const { return ghc::net::uri("http://127.0.0.1:" + std::to_string(_port)); }
+    std::string api() const { return "http://127.0.0.1:" + std::to_string(_port) + "/api/"; }
+    int requests(const std::string& name)
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        return _requests[name];
+    }
+    void reset()
+    {
+        std::lock_guard<std::mutex> lock{_mutex};
+        _requests.clear();
+    }
+    // called on the server thread with the name of every request, set it before any
+    std::function<void(const std::string&)> onRequest;
+
+private:
+    void count(const std::string& name)
+    {
+        {
+            std::lock_guard<std::mutex> lock{_mutex};
+            ++_requests[name];
+        }
+        if (onRequest) {
+            onRequest(name);
+        }
+    }
+    httplib::Server _server;
+    int _port = 0;
+    std::thread _thread;
+    std::mutex _mutex;
+    std::map<std::string, int> _requests;
+};
+
+// the app name of the HTTP requests, it can only be set once per process
+void useTestAppName()
+{
+    static bool once = (relive::setAppName("relive-test"), true);
+    (void)once;
+}
+
+// the search index is built in the background when it was missing
+bool waitForFullTextSearch(relive::ReLiveDB& rdb)
+{
+    for (int i = 0; i < 500 && !rdb.hasFullTextSearch(); ++i) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    return rdb.hasFullTextSearch();
+}
+
+}  // namespace
+
 TEST_CASE("ReLiveDB config test", "[relivedb]")
 {
-    TemporaryDirectory t;
-    relive::dataPath(t.path());
+    relive::dataPath(testDataPath());
     relive::ReLiveDB rdb;
     // first check that we don't work on a real config database
     REQUIRE(rdb.getConfigValue(relive::Keys::relive_root_server, "---"s) == "---");
@@ -25,3 +117,252 @@ TEST_CASE("ReLiveDB config test", "[relivedb]")
     CHECK(rdb.getConfigValue("some-int", 42) == 1234);
 }
 
+TEST_CASE("ReLiveDB full-text search", "[relivedb]")
+{
+    relive::dataPath(testDataPath());
+    relive::ReLiveDB rdb;
+    REQUIRE(execSql("DELETE FROM tracks; DELETE FROM streams; DELETE FROM stations;"
+                    "INSERT INTO stations(id, relive_id, protocol, name, last_update, flags, meta_info) VALUES (1, 1, 11, 'Station', 0, 0, '');"
+                    "INSERT INTO streams(id, relive_id, station_id, name, host, description, timestamp, duration, size, format, media_offset, info_chk, chat_chk, media_chk, last_update, flags, meta_info) VALUES "
+                    "(1, 1, 1, 'Morning Show', 'Alice', '', 1000, 3600, 0, 'mp3', 0, 0, 0, 0, 0, 0, ''), (2, 2, 1, 'Evening Session', 'Bob', '', 2000, 3600, 0, 'mp3', 0, 0, 0, 0, 0, 0, '');"
+                    "INSERT INTO tracks(id, stream_id, name, artist, type, time, last_update, flags, meta_info) VALUES "
+                    "(1, 1, 'Sunrise', 'The Beatles', 1, 0, 0, 0, ''), (2, 2, 'Here Comes The Sun', 'Beatles', 1, 0, 0, 0, ''), (3, 2, 'Station Id', 'Beatles Jingle', 3, 60, 0, 0, ''),"
+                    "(4, 2, 'Café del Mar', 'Energy 52', 1, 120, 0, 0, '');"));
+    REQUIRE(waitForFullTextSearch(rdb));
+
+    SECTION("tokens and prefixes match")
+    {
+        CHECK(rdb.searchTracks("beat").size() == 3);
+        CHECK(rdb.searchTracks("sun").size() == 2);
+        CHECK(rdb.searchTracks("here sun").size() == 1);
+        CHECK(rdb.searchTracks("cafe").size() == 1);
+        CHECK(rdb.searchTracks("xyz").empty());
+        CHECK(rdb.searchTracks("\"").empty());
+        auto streams = rdb.searchStreams("sess");
+        REQUIRE(streams.size() == 1);
+        CHECK(streams.front()._id == 2);
+        CHECK(rdb.searchStreams("alice").size() == 1);
+    }
+    SECTION("filters and paging")
+    {
+        auto jingles = rdb.searchTracks("beatles", relive::ReLiveDB::eJingle);
+        REQUIRE(jingles.size() == 1);
+        CHECK(jingles.front()._trackId == 3);
+        CHECK(jingles.front()._streamName == "Evening Session");
+        CHECK(rdb.searchTracks("beatles", relive::ReLiveDB::eTracks).size() == 2);
+        auto page1 = rdb.searchTracks("beatles", relive::ReLiveDB::eNone, 2, 0);
+        auto page2 = rdb.searchTracks("beatles", relive::ReLiveDB::eNone, 2, 2);
+        CHECK(page1.size() == 2);
+        REQUIRE(page2.size() == 1);
+        CHECK(page2.front()._trackId != page1[0]._trackId);
+        CHECK(page2.front()._trackId != page1[1]._trackId);
+    }
+    SECTION("index follows updates and deletes")
+    {
+        REQUIRE(execSql("UPDATE tracks SET artist = 'Nobody' WHERE id = 1; DELETE FROM tracks WHERE id = 2; UPDATE streams SET host = 'Carol' WHERE id = 1;"));
+        CHECK(rdb.searchTracks("beatles").size() == 1);
+        CHECK(rdb.searchTracks("nobody").size() == 1);
+        CHECK(rdb.searchStreams("alice").empty());
+        CHECK(rdb.searchStreams("carol").size() == 1);
+    }
+}
+
+TEST_CASE("ReLiveDB builds a missing search index in the background", "[relivedb]")
+{
+    relive::dataPath(testDataPath());
+    {
+        relive::ReLiveDB rdb;
+        REQUIRE(execSql("DELETE FROM tracks; DELETE FROM streams; DELETE FROM stations;"
+                        "INSERT INTO stations(id, relive_id, protocol, name, last_update, flags, meta_info) VALUES (1, 1, 11, 'Station', 0, 0, '');"
+                        "INSERT INTO streams(id, relive_id, station_id, name, host, description, timestamp, duration, size, format, media_offset, info_chk, chat_chk, media_chk, last_update, flags, meta_info) VALUES "
+                        "(1, 1, 1, 'Morning Show', 'Alice', '', 1000, 3600, 0, 'mp3', 0, 0, 0, 0, 0, 0, '');"
+                        "INSERT INTO tracks(id, stream_id, name, artist, type, time, last_update, flags, meta_info) VALUES (1, 1, 'Sunrise', 'The Beatles', 1, 0, 0, 0, '');"));
+        REQUIRE(waitForFullTextSearch(rdb));
+    }
+    SECTION("a dropped index is recreated and filled")
+    {
+        // as if sync_schema had recreated the tables, rows written without triggers are missing
+        REQUIRE(execSql("DROP TRIGGER tracks_fts_ai; DROP TRIGGER tracks_fts_ad; DROP TRIGGER tracks_fts_au; DROP TABLE tracks_fts; INSERT INTO tracks(id, stream_id, name, artist, type, time, last_update, flags, meta_info) VALUES (2, 1, 'Here Comes The Sun', 'Beatles', 1, 600, 0, 0, '');"));
+    }
+    SECTION("a rebuild pending from the last run is done")
+    {
+        // the index lost a row, but all its parts exist
+        REQUIRE(execSql("INSERT INTO tracks(id, stream_id, name, artist, type, time, last_update, flags, meta_info) VALUES (2, 1, 'Here Comes The Sun', 'Beatles', 1, 600, 0, 0, '');"
+                        "INSERT INTO tracks_fts(tracks_fts, rowid, name, artist) VALUES ('delete', 1, 'Sunrise', 'The Beatles');"
+                        "REPLACE INTO config_values(key, value) VALUES ('fts_rebuild', '1');"));
+    }
+    relive::ReLiveDB rdb;
+    // searches work right away, on LIKE queries until the index is filled
+    CHECK(rdb.searchTracks("beatles").size() == 2);
+    CHECK(rdb.searchStreams("alice").size() == 1);
+    REQUIRE(waitForFullTextSearch(rdb));
+    CHECK(rdb.searchTracks("beatles").size() == 2);
+    CHECK(rdb.searchTracks("sun").size() == 2);
+    CHECK(rdb.searchStreams("alice").size() == 1);
+}
+
+TEST_CASE("ReLiveDB catalog snapshots", "[relivedb]")
+{
+    relive::dataPath(testDataPath());
+    relive::ReLiveDB rdb;
+    REQUIRE(execSql("DELETE FROM tracks; DELETE FROM streams; DELETE FROM stations; DELETE FROM urls;"
+                    "INSERT INTO stations(id, relive_id, protocol, name, last_update, flags, meta_info) VALUES (1, 1, 11, 'Station', 0, 0, ''), (2, 2, 11, 'Empty', 0, 0, '');"
+                    "INSERT INTO urls(id, owner_id, url, last_update, type, meta_info) VALUES (1, 1, 'https://api.example.com/', 0, 0, ''), (2, 1, 'https://example.com/', 0, 1, '');"
+                    "INSERT INTO streams(id, relive_id, station_id, name, host, description, timestamp, duration, size, format, media_offset, info_chk, chat_chk, media_chk, last_update, flags, meta_info) VALUES "
+                    "(1, 1, 1, 'Older', 'Alice', '', 1000, 3600, 0, 'mp3', 0, 0, 0, 0, 0, 0, ''), (2, 2, 1, 'Newer', 'Bob', '', 2000, 600, 0, 'mp3', 0, 0, 0, 0, 0, 0, '');"
+                    "INSERT INTO tracks(id, stream_id, name, artist, type, time, last_update, flags, meta_info) VALUES "
+                    "(1, 2, 'Second', 'B', 1, 100, 0, 0, ''), (2, 2, 'First', 'A', 1, 0, 0, 0, ''), (3, 1, 'Only', 'C', 1, 0, 0, 0, '');"));
+    // the first load is announced like every later snapshot, a frontend loads it in the background
+    std::shared_ptr<const relive::Catalog> loaded;
+    auto loadSubscription = rdb.subscribeCatalog([&](std::shared_ptr<const relive::Catalog> first) { loaded = first; });
+    auto catalog = rdb.catalog();
+    rdb.unsubscribeCatalog(loadSubscription);
+    CHECK(loaded == catalog);
+    REQUIRE(catalog->stations().size() == 2);
+    auto station = catalog->station(1);
+    REQUIRE(station);
+    CHECK(station->_webSiteUrl == "https://example.com/");
+    CHECK(station->_api.size() == 1);
+    CHECK(catalog->streams(2)->empty());
+    auto streams = catalog->streams(1);
+    REQUIRE(streams->size() == 2);
+    CHECK(streams->front()->_name == "Newer");
+    CHECK(streams->front()->_station == station);
+    const auto& tracks = streams->front()->_tracks;
+    REQUIRE(tracks.size() == 2);
+    CHECK(tracks[0]._name == "First");
+    CHECK(tracks[0]._duration == 100);
+    CHECK(tracks[1]._duration == 500);
+    REQUIRE(tracks[0]._stream);
+    CHECK(tracks[0]._stream->_id == 2);
+    CHECK(tracks[0].reLiveURL() == "track-1-2-0");
+    // navigation hands out the same objects
+    CHECK(rdb.catalog() == catalog);
+    CHECK(catalog->streams(1) == streams);
+
+    std::shared_ptr<const relive::Catalog> notified;
+    auto subscription = rdb.subscribeCatalog([&](std::shared_ptr<const relive::Catalog> changed) { notified = changed; });
+    rdb.setPlayed(*catalog->stream(1));
+    REQUIRE(notified);
+    CHECK(notified == rdb.catalog());
+    CHECK(notified->version() > catalog->version());
+    CHECK((notified->stream(1)->_flags & relive::Stream::ePlayed) != 0);
+    CHECK((catalog->stream(1)->_flags & relive::Stream::ePlayed) == 0);
+    // the untouched stream is shared between both snapshots
+    CHECK(notified->stream(2) == catalog->stream(2));
+    rdb.unsubscribeCatalog(subscription);
+    notified.reset();
+    rdb.setPlayed(*catalog->stream(2));
+    CHECK_FALSE(notified);
+}
+
+TEST_CASE("ReLiveDB track search with a cursor", "[relivedb]")
+{
+    relive::dataPath(testDataPath());
+    relive::ReLiveDB rdb;
+    std::string sql = "DELETE FROM tracks; DELETE FROM streams; DELETE FROM stations;"
+                      "INSERT INTO stations(id, relive_id, protocol, name, last_update, flags, meta_info) VALUES (1, 1, 11, 'Station', 0, 0, '');";
+    for (int i = 1; i <= 5; ++i) {
+        sql += "INSERT INTO streams(id, relive_id, station_id, name, host, description, timestamp, duration, size, format, media_offset, info_chk, chat_chk, media_chk, last_update, flags, meta_info) VALUES (" + std::to_string(i) + ", " +
+               std::to_string(i) + ", 1, 'Show', 'Host', '', " + std::to_string(1000 + (i % 3) * 100) + ", 3600, 0, 'mp3', 0, 0, 0, 0, 0, 0, '');";
+        for (int j = 0; j < 10; ++j) {
+            sql += "INSERT INTO tracks(stream_id, name, artist, type, time, last_update, flags, meta_info) VALUES (" + std::to_string(i) + ", 'Track', 'Artist', " + (j % 2 ? "1" : "3") + ", " + std::to_string(j * 60) + ", 0, 0, '');";
+        }
+    }
+    REQUIRE(execSql(sql));
+    auto all = rdb.findTracksInfo("%rack%");
+    REQUIRE(all.size() == 50);
+    CHECK(rdb.findTracksInfo("%rack%", relive::ReLiveDB::eJingle).size() == 25);
+
+    SECTION("chunks continue where the last one ended")
+    {
+        relive::ReLiveDB::FindTracksCursor cursor("%rack%");
+        std::vector<relive::ReLiveDB::FindTracksInfo> chunked;
+        while (cursor.more()) {
+            auto chunk = rdb.findTracksInfo(cursor, 7);
+            CHECK(chunk.size() <= 7);
+            chunked.insert(chunked.end(), chunk.begin(), chunk.end());
+        }
+        REQUIRE(chunked.size() == all.size());
+        for (size_t i = 0; i < all.size(); ++i) {
+            CHECK(chunked[i]._trackId == all[i]._trackId);
+            if (i) {
+                CHECK(chunked[i]._timestamp <= chunked[i - 1]._timestamp);
+            }
+        }
+    }
+    SECTION("more is only set if there are further results")
+    {
+        relive::ReLiveDB::FindTracksCursor cursor("%rack%", relive::ReLiveDB::eTracks);
+        CHECK(rdb.findTracksInfo(cursor, 25).size() == 25);
+        CHECK(!cursor.more());
+        CHECK(rdb.findTracksInfo(cursor, 25).empty());
+        relive::ReLiveDB::FindTracksCursor limited("%rack%", relive::ReLiveDB::eTracks);
+        CHECK(rdb.findTracksInfo(limited, 24).size() == 24);
+        CHECK(limited.more());
+    }
+}
+
+TEST_CASE("ReLiveDB resumes an interrupted sync from its journal", "[relivedb]")
+{
+    relive::dataPath(testDataPath());
+    useTestAppName();
+    ReLiveServer server;
+    relive::ReLiveDB rdb(std::function<void(int)>(), server.master());
+    REQUIRE(execSql("DELETE FROM tracks; DELETE FROM streams; DELETE FROM stations; DELETE FROM urls; DELETE FROM sync_journal;"));
+    rdb.refreshStations(std::function<void()>(), true);
+    CHECK(server.requests("getstations") == 1);
+    CHECK(server.requests("getstreaminfo") == 3);
+    REQUIRE(rdb.findTracksInfo("%").size() == 6);
+
+    // quit after the station info announced new tracks of stream 2, before they were fetched
+    REQUIRE(execSql("DELETE FROM tracks WHERE stream_id = (SELECT id FROM streams WHERE relive_id = 2);"
+                    "INSERT INTO sync_journal(type, owner_id, relive_id, url, status, attempts, last_update) SELECT 1, id, 2, '" + server.api() + "', 0, 1, 0 FROM streams WHERE relive_id = 2;"
+                    "UPDATE config_values SET value = '0' WHERE key = 'last_relive_sync';"));
+    REQUIRE(rdb.findTracksInfo("%").size() == 4);
+    server.reset();
+    rdb.refreshStations();
+    // only the pending job ran, the crawl it belongs to is recent
+    CHECK(server.requests("getstations") == 0);
+    CHECK(server.requests("getstationinfo") == 0);
+    CHECK(server.requests("getstreaminfo") == 1);
+    CHECK(rdb.findTracksInfo("Second 2").size() == 1);
+    CHECK(rdb.findTracksInfo("%").size() == 6);
+
+    // the journal is empty and the sync is up to date
+    server.reset();
+    rdb.refreshStations();
+    CHECK(server.requests("getstreaminfo") == 0);
+}
+
+TEST_CASE("ReLiveDB leaves the jobs of a cancelled sync in its journal", "[relivedb]")
+{
+    relive::dataPath(testDataPath());
+    useTestAppName();
+    ReLiveServer server;
+    {
+        relive::ReLiveDB rdb(std::function<void(int)>(), server.master());
+        REQUIRE(execSql("DELETE FROM tracks; DELETE FROM streams; DELETE FROM stations; DELETE FROM urls; DELETE FROM sync_journal;"));
+        // cancelled while the station info is fetched, before it submits the jobs of its streams
+        server.onRequest = [&](const std::string& name) {
+            if (name == "getstationinfo") {
+                rdb.cancelSync();
+            }
+        };
+        rdb.refreshStations(std::function<void()>(), true);
+        CHECK(server.requests("getstationinfo") == 1);
+        CHECK(server.requests("getstreaminfo") == 0);
+        CHECK(rdb.findTracksInfo("%").empty());
+        // later syncs return right away
+        rdb.refreshStations(std::function<void()>(), true);
+        CHECK(server.requests("getstations") == 1);
+    }
+    server.onRequest = nullptr;
+    server.reset();
+    relive::ReLiveDB rdb(std::function<void(int)>(), server.master());
+    rdb.refreshStations();
+    // the next start resumes the stream jobs, the crawl they belong to is recent
+    CHECK(server.requests("getstations") == 0);
+    CHECK(server.requests("getstreaminfo") == 3);
+    CHECK(rdb.findTracksInfo("%").size() == 6);
+}
@@ -0,0 +1,67 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include <backend/ringbuffer.hpp>
+#include <cstdint>
+#include <numeric>
+#include <thread>
+#include <vector>
+
+TEST_CASE("RingBuffer push, peek and pull across the wrap point", "[ringbuffer]")
+{
+    RingBuffer<int16_t> rb(16);
+    std::vector<int16_t> in(20), out(20);
+    std::iota(in.begin(), in.end(), 1);
+    CHECK(rb.bufferSize() == 16);
+    CHECK(rb.free() == 15);
+    CHECK(rb.push(in.data(), 20) == 15);
+    CHECK(rb.filled() == 15);
+    CHECK_FALSE(rb.canPush(1));
+    CHECK(rb.drop(10) == 10);
+    CHECK(rb.push(in.data() + 15, 5) == 5);
+    CHECK(rb.filled() == 10);
+    CHECK(rb.peek(out.data(), 20) == 10);
+    CHECK(rb.pull(out.data() + 10, 20) == 10);
+    for (int i = 0; i < 10; ++i) {
+        CHECK(out[i] == in[10 + i]);
+        CHECK(out[10 + i] == in[10 + i]);
+    }
+    CHECK(rb.filled() == 0);
+    CHECK(rb.pull(out.data(), 1) == 0);
+    rb.push(in.data(), 7);
+    rb.clear();
+    CHECK(rb.filled() == 0);
+    CHECK(rb.free() == 15);
+}
+
+TEST_CASE("RingBuffer transfers data between producer and consumer thread", "[ringbuffer]")
+{
+    const unsigned int total = 4 * 1024 * 1024;
+    RingBuffer<uint32_t> rb(1000);
+    std::thread producer([&]() {
+        uint32_t chunk[97];
+        uint32_t next = 0;
+        while (next < total) {
+            auto count = (std::min)(97u, total - next);
+            for (unsigned int i = 0; i < count; ++i) {
+                chunk[i] = next + i;
+            }
+            next += rb.push(chunk, count);
+        }
+    });
+    uint32_t expected = 0;
+    bool ok = true;
+    uint32_t chunk[61];
+    while (expected < total) {
+        auto count = rb.pull(chunk, 61);
+        for (int i = 0; i < count; ++i) {
+            ok = ok && chunk[i] == expected++;
+        }
+    }
+    producer.join();
+    CHECK(ok);
+    CHECK(rb.filled() == 0);
+}
@@ -0,0 +1,118 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include <backend/scheduler.hpp>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using relive::TaskScheduler;
+
+TEST_CASE("TaskScheduler counts nested tasks until all are done", "[scheduler]")
+{
+    TaskScheduler scheduler(4);
+    std::atomic<int> executed{0};
+    std::mutex mutex;
+    std::set<std::thread::id> threads;
+    size_t lastCompleted = 0;
+    bool ordered = true;
+    auto counter = std::make_shared<TaskScheduler::Counter>([&](size_t completed, size_t submitted) {
+        ordered = ordered && completed == lastCompleted + 1 && completed <= submitted;
+        lastCompleted = completed;
+    });
+    std::function<void(int)> job = [&](int level) {
+        ++executed;
+        {
+            std::lock_guard<std::mutex> lock{mutex};
+            threads.insert(std::this_thread::get_id());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        for (int i = 0; level < 3 && i < 5; ++i) {
+            scheduler.submit([&job, level]() { job(level + 1); }, TaskScheduler::eNormal, counter);
+        }
+    };
+    scheduler.submit([&job]() { job(0); }, TaskScheduler::eNormal, counter);
+    REQUIRE(counter->waitFor(std::chrono::seconds(30)));
+    CHECK(counter->done());
+    CHECK(executed == 1 + 5 + 25 + 125);
+    CHECK(counter->submitted() == 156);
+    CHECK(counter->completed() == 156);
+    CHECK(ordered);
+    CHECK(lastCompleted == 156);
+    // the tasks of the first one were stolen by the others
+    CHECK(threads.size() > 1);
+    CHECK(scheduler.queued() == 0);
+}
+
+TEST_CASE("TaskScheduler starts high priority tasks first", "[scheduler]")
+{
+    TaskScheduler scheduler(1);
+    std::mutex mutex;
+    std::vector<int> order;
+    std::atomic_bool release{false};
+    auto counter = std::make_shared<TaskScheduler::Counter>();
+    scheduler.submit([&]() {
+        while (!release) {
+            std::this_thread::yield();
+        }
+    }, TaskScheduler::eNormal, counter);
+    for (int i = 0; i < 3; ++i) {
+        scheduler.submit([&, i]() {
+            std::lock_guard<std::mutex> lock{mutex};
+            order.push_back(i);
+        }, TaskScheduler::eNormal, counter);
+    }
+    scheduler.submit([&]() {
+        std::lock_guard<std::mutex> lock{mutex};
+        order.push_back(100);
+    }, TaskScheduler::eHigh, counter);
+    release = true;
+    counter->wait();
+    CHECK(order == std::vector<int>{100, 0, 1, 2});
+}
+
+TEST_CASE("TaskScheduler completes failing tasks", "[scheduler]")
+{
+    TaskScheduler scheduler(2);
+    auto counter = std::make_shared<TaskScheduler::Counter>();
+    std::atomic<int> executed{0};
+    scheduler.submit([]() { throw std::runtime_error("failed"); }, TaskScheduler::eNormal, counter);
+    scheduler.submit([&]() { ++executed; }, TaskScheduler::eNormal, counter);
+    scheduler.submit([&]() { ++executed; });
+    REQUIRE(counter->waitFor(std::chrono::seconds(30)));
+    CHECK(counter->completed() == 2);
+    auto empty = std::make_shared<TaskScheduler::Counter>();
+    CHECK(empty->done());
+    CHECK(empty->waitFor(std::chrono::milliseconds(0)));
+}
+
+TEST_CASE("TaskScheduler completes the counters of tasks dropped on shutdown", "[scheduler]")
+{
+    auto counter = std::make_shared<TaskScheduler::Counter>();
+    std::atomic_bool started{false};
+    std::atomic<int> executed{0};
+    {
+        TaskScheduler scheduler(1);
+        scheduler.submit([&]() {
+            started = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }, TaskScheduler::eNormal, counter);
+        while (!started) {
+            std::this_thread::yield();
+        }
+        for (int i = 0; i < 10; ++i) {
+            scheduler.submit([&]() { ++executed; }, i % 2 ? TaskScheduler::eHigh : TaskScheduler::eNormal, counter);
+        }
+    }
+    CHECK(executed == 0);
+    CHECK(counter->done());
+    CHECK(counter->completed() == 11);
+}
@@ -0,0 +1,88 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include "helper.hpp"
+#include <backend/searchservice.hpp>
+#include <chrono>
+#include <string>
+#include <thread>
+
+using namespace std::chrono_literals;
+using relive::SearchService;
+
+static SearchService::Results waitForResults(SearchService& search, uint64_t generation)
+{
+    SearchService::Results results;
+    auto timeout = std::chrono::steady_clock::now() + 5s;
+    while (std::chrono::steady_clock::now() < timeout) {
+        if (search.poll(results) && results._generation == generation && results._complete) {
+            break;
+        }
+        std::this_thread::sleep_for(1ms);
+    }
+    return results;
+}
+
+TEST_CASE("SearchService delivers paged results of the latest request", "[searchservice]")
+{
+    relive::dataPath(testDataPath());
+    relive::ReLiveDB rdb;
+    std::string sql = "DELETE FROM tracks; DELETE FROM streams; DELETE FROM stations;"
+                      "INSERT INTO stations(id, relive_id, protocol, name, last_update, flags, meta_info) VALUES (1, 1, 11, 'Station', 0, 0, '');"
+                      "INSERT INTO streams(id, relive_id, station_id, name, host, description, timestamp, duration, size, format, media_offset, info_chk, chat_chk, media_chk, last_update, flags, meta_info) VALUES "
+                      "(1, 1, 1, 'Nightflight', 'Alice', '', 1000, 3600, 0, 'mp3', 0, 0, 0, 0, 0, 0, '');";
+    for (int i = 0; i < 120; ++i) {
+        sql += "INSERT INTO tracks(stream_id, name, artist, type, time, last_update, flags, meta_info) VALUES (1, 'Song " + std::to_string(i) + "', '" + (i % 2 ? "Odd" : "Even") + " Artist', " + (i % 4 ? "1" : "3") +
+               ", " + std::to_string(i * 60) + ", 0, 0, '');";
+    }
+    REQUIRE(execSql(sql));
+    SearchService::Config config;
+    config.debounce = 20ms;
+    config.pageSize = 16;
+    config.maxResults = 100;
+    SearchService search(rdb, config);
+
+    SECTION("results are paged up to the limit")
+    {
+        auto generation = search.search("song");
+        auto results = waitForResults(search, generation);
+        CHECK(results._generation == generation);
+        CHECK(results._complete);
+        CHECK(results._streams.empty());
+        CHECK(results._tracks.size() == 100);
+        CHECK(!search.busy());
+    }
+    SECTION("scope and filter are applied")
+    {
+        auto results = waitForResults(search, search.search("night", SearchService::eStreams));
+        CHECK(results._streams.size() == 1);
+        CHECK(results._tracks.empty());
+        results = waitForResults(search, search.search("even", SearchService::eTracks, relive::ReLiveDB::eJingle));
+        CHECK(results._tracks.size() == 30);
+    }
+    SECTION("newer requests supersede older ones")
+    {
+        search.search("song");
+        search.search("odd");
+        auto generation = search.search("even");
+        auto results = waitForResults(search, generation);
+        CHECK(results._generation == generation);
+        CHECK(results._tracks.size() == 60);
+        SearchService::Results later;
+        CHECK(!search.poll(later));
+    }
+    SECTION("cancel drops results")
+    {
+        search.search("song");
+        search.cancel();
+        std::this_thread::sleep_for(50ms);
+        SearchService::Results results;
+        search.poll(results);
+        CHECK(results._tracks.empty());
+        CHECK(results._complete);
+        CHECK(!search.busy());
+    }
+}
@@ -0,0 +1,108 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include "helper.hpp"
+#include <backend/seekindex.hpp>
+#include <cstring>
+#include <vector>
+
+using relive::SeekIndex;
+
+static void recordFrames(SeekIndex& index, int64_t startOffset, int64_t startSample, int frames)
+{
+    // constant frame size of 417 bytes and 1152 samples like 128kbit/44.1kHz
+    for (int i = 0; i < frames; ++i) {
+        index.record(startOffset + i * 417, startSample + i * 1152);
+    }
+}
+
+TEST_CASE("SeekIndex records contiguous entries", "[seekindex]")
+{
+    SeekIndex index;
+    SeekIndex::Entry entry;
+    CHECK(!index.lookup(0, entry));
+    recordFrames(index, 0, 0, 100);
+    REQUIRE(index.entries().size() == 4);
+    CHECK(index.modified());
+    CHECK(index.entries()[1]._offset == 32 * 417);
+    CHECK(index.entries()[1]._sample == 32 * 1152);
+    REQUIRE(index.lookup(40 * 1152 + 7, entry));
+    CHECK(entry._offset == 32 * 417);
+    CHECK(entry._sample == 32 * 1152);
+    CHECK(index.lookup(index.coveredSamples(), entry));
+    CHECK(!index.lookup(index.coveredSamples() + 1, entry));
+    // replaying already covered frames changes nothing, continuing behind the last entry extends it
+    recordFrames(index, 32 * 417, 32 * 1152, 100);
+    CHECK(index.entries().size() == 5);
+}
+
+TEST_CASE("SeekIndex starts at the first frame behind an ID3 tag", "[seekindex]")
+{
+    // a 300 byte ID3v2 tag, then frames of 128kbit/44.1kHz with the padding bit set on every third
+    std::vector<uint8_t> stream(300, 0);
+    std::memcpy(stream.data(), "ID3\x04\x00\x00\x00\x00\x02\x22", 10);
+    std::vector<int64_t> headers;
+    for (int i = 0; i < 100; ++i) {
+        bool padding = i % 3 == 2;
+        headers.push_back(int64_t(stream.size()));
+        uint8_t header[4] = {0xff, 0xfb, uint8_t(0x90 | (padding ? 2 : 0)), 0x00};
+        stream.insert(stream.end(), header, header + 4);
+        stream.resize(stream.size() + (padding ? 414 : 413), 0);
+    }
+    // like the decoder, the first frame consumes the tag as skipped junk
+    SeekIndex index;
+    int64_t position = 0;
+    for (int i = 0; i < 100; ++i) {
+        auto consumed = (i + 1 < 100 ? headers[i + 1] : int64_t(stream.size())) - position;
+        auto header = SeekIndex::headerOffset(stream.data() + position, consumed, 3, 128, 44100);
+        REQUIRE(header >= 0);
+        CHECK(position + header == headers[i]);
+        index.record(position + header, i * 1152);
+        position += consumed;
+    }
+    REQUIRE(index.entries().size() == 4);
+    CHECK(index.entries().front()._offset == 300);
+    CHECK(index.entries().front()._sample == 0);
+    SeekIndex::Entry entry;
+    REQUIRE(index.lookup(70 * 1152, entry));
+    CHECK(entry._offset == headers[64]);
+    // free format frames can't be located
+    CHECK(SeekIndex::headerOffset(stream.data(), 717, 3, 0, 44100) == -1);
+}
+
+TEST_CASE("SeekIndex doesn't cover samples before its first entry", "[seekindex]")
+{
+    SeekIndex index;
+    recordFrames(index, 417 * 100, 1152 * 100, 100);
+    REQUIRE(index.entries().front()._sample == 1152 * 100);
+    SeekIndex::Entry entry;
+    CHECK(!index.lookup(0, entry));
+    CHECK(!index.lookup(1152 * 100 - 1, entry));
+    REQUIRE(index.lookup(1152 * 100, entry));
+    CHECK(entry._offset == 417 * 100);
+}
+
+TEST_CASE("SeekIndex persistence", "[seekindex]")
+{
+    TemporaryDirectory t;
+    auto filename = (t.path() / "sub" / "test.idx").string();
+    SeekIndex index;
+    recordFrames(index, 0, 0, 1000);
+    REQUIRE(index.save(filename));
+    CHECK(!index.modified());
+    SeekIndex loaded;
+    REQUIRE(loaded.load(filename));
+    REQUIRE(loaded.entries().size() == index.entries().size());
+    CHECK(loaded.entries().back()._offset == index.entries().back()._offset);
+    CHECK(loaded.entries().back()._sample == index.entries().back()._sample);
+    {
+        fs::ofstream os(t.path() / "broken.idx");
+        os << "garbage";
+    }
+    CHECK(!loaded.load((t.path() / "broken.idx").string()));
+    CHECK(loaded.entries().empty());
+    CHECK(!loaded.load((t.path() / "missing.idx").string()));
+}
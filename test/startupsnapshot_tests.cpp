@@ -0,0 +1,103 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include "helper.hpp"
+#include <backend/startupsnapshot.hpp>
+#include <fstream>
+
+namespace {
+
+std::shared_ptr<const relive::Catalog> makeCatalog()
+{
+    std::vector<relive::Catalog::StationPtr> stations;
+    std::unordered_map<int64_t, relive::Catalog::StreamListPtr> streamsOfStation;
+    for (int64_t stationId = 1; stationId <= 3; ++stationId) {
+        auto station = std::make_shared<relive::Station>();
+        station->_id = stationId;
+        station->_name = "Station " + std::to_string(stationId);
+        station->_api = {"https://api.example.com/" + std::to_string(stationId) + "/"};
+        stations.push_back(station);
+        auto streams = std::make_shared<relive::Catalog::StreamList>();
+        for (int64_t i = 0; i < 10; ++i) {
+            auto stream = std::make_shared<relive::Stream>();
+            stream->_id = stationId * 100 + i;
+            stream->_stationId = stationId;
+            stream->_name = "Show " + std::to_string(stream->_id);
+            stream->_duration = 3600;
+            stream->_station = station;
+            for (int t = 0; t < 20; ++t) {
+                relive::Track track;
+                track._id = stream->_id * 100 + t;
+                track._streamId = stream->_id;
+                track._name = "Track " + std::to_string(t);
+                track._time = t * 180;
+                track._duration = 180;
+                stream->_tracks.push_back(track);
+            }
+            streams->push_back(stream);
+        }
+        streamsOfStation.emplace(stationId, streams);
+    }
+    return std::make_shared<relive::Catalog>(7, std::move(stations), std::move(streamsOfStation));
+}
+
+}  // namespace
+
+TEST_CASE("StartupSnapshot keeps the stations and the active stream", "[startupsnapshot]")
+{
+    TemporaryDirectory t;
+    auto file = (t.path() / "startup.snapshot").string();
+    relive::StartupSnapshot snapshot(makeCatalog(), 2, 205, "track-2-5-3-100", 2);
+    REQUIRE(snapshot.save(file));
+
+    relive::StartupSnapshot loaded;
+    REQUIRE(loaded.load(file));
+    CHECK(loaded.activeStation() == 2);
+    CHECK(loaded.activeStream() == 205);
+    CHECK(loaded.playPosition() == "track-2-5-3-100");
+    CHECK(loaded.page() == 2);
+    auto catalog = loaded.catalog();
+    REQUIRE(catalog);
+    CHECK(catalog->version() == 0);
+    REQUIRE(catalog->stations().size() == 3);
+    CHECK(catalog->stations()[2]->_api.front() == "https://api.example.com/3/");
+    CHECK(catalog->streams(1)->empty());
+    REQUIRE(catalog->streams(2)->size() == 10);
+    auto stream = catalog->stream(205);
+    REQUIRE(stream);
+    CHECK(stream->_station == catalog->station(2));
+    REQUIRE(stream->_tracks.size() == 20);
+    CHECK(stream->_tracks[3]._name == "Track 3");
+    CHECK(stream->_tracks[3]._duration == 180);
+    REQUIRE(stream->_tracks[3]._stream);
+    CHECK(stream->_tracks[3]._stream->_id == 205);
+    CHECK(catalog->stream(204)->_tracks.empty());
+}
+
+TEST_CASE("StartupSnapshot rejects missing and damaged files", "[startupsnapshot]")
+{
+    TemporaryDirectory t;
+    auto file = (t.path() / "startup.snapshot").string();
+    relive::StartupSnapshot snapshot;
+    CHECK_FALSE(snapshot.load(file));
+    REQUIRE(relive::StartupSnapshot(makeCatalog(), 1, 101, "", 1).save(file));
+    std::string data;
+    {
+        std::ifstream is(file, std::ios::binary);
+        data.assign(std::istreambuf_iterator<char>(is), std::istreambuf_iterator<char>());
+    }
+    {
+        std::ofstream os(file, std::ios::binary | std::ios::trunc);
+        os.write(data.data(), static_cast<std::streamsize>(data.size() / 2));
+    }
+    CHECK_FALSE(snapshot.load(file));
+    CHECK_FALSE(snapshot.catalog());
+    {
+        std::ofstream os(file, std::ios::binary | std::ios::trunc);
+        os << "not a snapshot";
+    }
+    CHECK_FALSE(snapshot.load(file));
+}
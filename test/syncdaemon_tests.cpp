@@ -0,0 +1,156 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include "helper.hpp"
+#include <backend/daemonclient.hpp>
+#include <backend/searchservice.hpp>
+#include <backend/syncdaemon.hpp>
+#include <backend/system.hpp>
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+TEST_CASE("IpcReader decodes what IpcWriter wrote and rejects truncated data", "[syncdaemon]")
+{
+    relive::Stream stream;
+    stream._id = 42;
+    stream._reliveId = -7;
+    stream._name = "Show";
+    stream._timestamp = INT64_C(1600000000);
+    stream._media = {"http://example.com/a.mp3"};
+    relive::IpcWriter writer;
+    writer.svarint(INT64_MIN);
+    writer.varint(UINT64_MAX);
+    writer.string("päck");
+    writer.stream(stream);
+    relive::IpcReader reader(writer.data());
+    CHECK(reader.svarint() == INT64_MIN);
+    CHECK(reader.varint() == UINT64_MAX);
+    CHECK(reader.string() == "päck");
+    auto decoded = reader.stream();
+    CHECK(decoded._id == 42);
+    CHECK(decoded._reliveId == -7);
+    CHECK(decoded._name == "Show");
+    CHECK(decoded._timestamp == INT64_C(1600000000));
+    CHECK(decoded._media == stream._media);
+    CHECK(reader.atEnd());
+
+    relive::IpcReader truncated(std::string_view(writer.data()).substr(0, writer.data().size() - 3));
+    truncated.svarint();
+    truncated.varint();
+    truncated.string();
+    CHECK_THROWS_AS(truncated.stream(), relive::IpcError);
+    relive::IpcWriter huge;
+    huge.varint(1000000);
+    CHECK_THROWS_AS(relive::IpcReader(huge.data()).count(), relive::IpcError);
+}
+
+TEST_CASE("SyncDaemon serves catalog and searches to clients", "[syncdaemon]")
+{
+    relive::dataPath(testDataPath());
+    relive::ReLiveDB rdb;
+    REQUIRE(execSql("DELETE FROM tracks; DELETE FROM streams; DELETE FROM stations; DELETE FROM urls;"
+                    "INSERT INTO stations(id, relive_id, protocol, name, last_update, flags, meta_info) VALUES (1, 1, 11, 'Station', 0, 0, '');"
+                    "INSERT INTO urls(id, owner_id, url, last_update, type, meta_info) VALUES (1, 1, 'https://api.example.com/', 0, 0, '');"
+                    "INSERT INTO streams(id, relive_id, station_id, name, host, description, timestamp, duration, size, format, media_offset, info_chk, chat_chk, media_chk, last_update, flags, meta_info) VALUES "
+                    "(1, 1, 1, 'Morning Show', 'Alice', '', 1000, 3600, 0, 'mp3', 0, 0, 0, 0, 0, 0, ''), (2, 2, 1, 'Evening Session', 'Bob', '', 2000, 600, 0, 'mp3', 0, 0, 0, 0, 0, 0, '');"
+                    "INSERT INTO tracks(id, stream_id, name, artist, type, time, last_update, flags, meta_info) VALUES "
+                    "(1, 2, 'Here Comes The Sun', 'Beatles', 1, 0, 0, 0, ''), (2, 2, 'Station Id', 'Jingle', 3, 100, 0, 0, ''), (3, 1, 'Sunrise', 'Alice', 1, 0, 0, 0, '');"));
+    // a daemon with its sync left to the test
+    relive::SyncDaemon::Config config;
+    config.socketPath = (testDataPath() / "relived.sock").string();
+    config.syncInterval = std::chrono::hours(24);
+    rdb.setConfigValue(relive::Keys::last_relive_sync, relive::currentTime());
+    relive::SyncDaemon daemon(rdb, config);
+    daemon.start();
+
+    relive::DaemonClient client;
+    REQUIRE(client.connect(config.socketPath));
+    auto catalog = client.catalog();
+    REQUIRE(catalog);
+    auto local = rdb.catalog();
+    CHECK(catalog->version() == local->version());
+    REQUIRE(catalog->stations().size() == 1);
+    CHECK(catalog->stations().front()->_api == std::vector<std::string>{"https://api.example.com/"});
+    auto streams = catalog->streams(1);
+    REQUIRE(streams->size() == 2);
+    CHECK(streams->front()->_name == "Evening Session");
+    CHECK(streams->front()->_station == catalog->stations().front());
+    const auto& tracks = streams->front()->_tracks;
+    REQUIRE(tracks.size() == 2);
+    CHECK(tracks[0]._name == "Here Comes The Sun");
+    CHECK(tracks[0]._duration == 100);
+    CHECK(tracks[1]._duration == 500);
+    REQUIRE(tracks[0]._stream);
+    CHECK(tracks[0]._stream->_id == 2);
+    CHECK(tracks[0]._stream->_tracks.empty());
+    // unchanged, so nothing is transferred and the snapshot stays the same
+    CHECK(client.catalog() == catalog);
+
+    auto found = client.searchTracks("sun");
+    REQUIRE(found.size() == 2);
+    CHECK(client.searchTracks("sun", relive::ReLiveDB::eJingle).empty());
+    auto foundStreams = client.searchStreams("alice");
+    REQUIRE(foundStreams.size() == 1);
+    CHECK(foundStreams.front()._name == "Morning Show");
+    client.setPlayed(2);
+    CHECK((rdb.catalog()->stream(2)->_flags & relive::Stream::ePlayed));
+
+    relive::SearchService search(rdb);
+    search.useDaemon(config.socketPath);
+    auto generation = search.search("sun", relive::SearchService::eTracks);
+    relive::SearchService::Results results;
+    auto timeout = std::chrono::steady_clock::now() + std::chrono::seconds(5);
+    while (!(search.poll(results) && results._generation == generation && results._complete) && std::chrono::steady_clock::now() < timeout) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    CHECK(results._tracks.size() == 2);
+
+    relive::DaemonClient second;
+    REQUIRE(second.connect(config.socketPath));
+    auto status = second.status();
+    // the search service keeps its own connection
+    CHECK(status._clients == 3);
+    CHECK(status._catalogVersion == rdb.catalog()->version());
+    CHECK(second.catalog()->stations().size() == 1);
+    CHECK_THROWS_AS(second.fetchChat(12345), relive::IpcError);
+    // errors of a query leave the connection usable
+    CHECK(second.connected());
+    CHECK_NOTHROW(second.requestSync());
+
+    relive::SyncDaemon other(rdb, config);
+    CHECK_THROWS_AS(other.start(), std::runtime_error);
+
+    daemon.stop();
+    CHECK_THROWS_AS(client.status(), relive::IpcError);
+    CHECK_FALSE(client.connected());
+    CHECK_FALSE(client.connect(config.socketPath));
+}
+
+TEST_CASE("DaemonClient gives up on a daemon that doesn't reply", "[syncdaemon]")
+{
+    // a socket nobody accepts on, the kernel still completes the connect
+    auto socketPath = (testDataPath() / "silent.sock").string();
+    ::unlink(socketPath.c_str());
+    int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(fd >= 0);
+    sockaddr_un addr{};
+    addr.sun_family = AF_UNIX;
+    std::strncpy(addr.sun_path, socketPath.c_str(), sizeof(addr.sun_path) - 1);
+    REQUIRE(::bind(fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) == 0);
+    REQUIRE(::listen(fd, 4) == 0);
+    relive::DaemonClient client;
+    auto start = std::chrono::steady_clock::now();
+    CHECK_FALSE(client.connect(socketPath, std::chrono::milliseconds(100)));
+    CHECK(std::chrono::steady_clock::now() - start < std::chrono::seconds(5));
+    CHECK_FALSE(client.connected());
+    ::close(fd);
+    ::unlink(socketPath.c_str());
+}
@@ -0,0 +1,94 @@
+//---------------------------------------------------------------------------------------
+// SPDX-License-Identifier: BSD-3-Clause
+// relive-client - A C++ implementation of the reLive protocol and an sqlite backend
+// Copyright (c) 2019, Steffen Schümann <s.schuemann@pobox.com>
+//---------------------------------------------------------------------------------------
+#include "catch.hpp"
+#include <backend/timeline.hpp>
+
+using relive::Timeline;
+
+static std::vector<relive::Track> testTracks()
+{
+    std::vector<relive::Track> tracks(3);
+    tracks[0]._id = 11;
+    tracks[0]._time = 10;
+    tracks[1]._id = 12;
+    tracks[1]._time = 100;
+    tracks[2]._id = 13;
+    tracks[2]._time = 250;
+    return tracks;
+}
+
+TEST_CASE("Timeline finds the active track", "[timeline]")
+{
+    Timeline timeline;
+    CHECK(timeline.trackIndexAt(0) == -1);
+    CHECK(timeline.trackIdAt(0) == 0);
+    timeline.setTracks(testTracks());
+    CHECK(timeline.numTracks() == 3);
+    CHECK(timeline.trackIndexAt(0) == -1);
+    CHECK(timeline.trackIdAt(9) == 0);
+    CHECK(timeline.trackIdAt(10) == 11);
+    CHECK(timeline.trackIdAt(99) == 11);
+    CHECK(timeline.trackIdAt(100) == 12);
+    CHECK(timeline.trackIdAt(10000) == 13);
+    relive::Stream stream;
+    stream._tracks = testTracks();
+    CHECK(stream.trackIndexForTime(0) == 0);
+    CHECK(stream.trackIndexForTime(100) == 1);
+    CHECK(stream.trackIndexForTime(249) == 1);
+    CHECK(stream.trackIndexForTime(10000) == 2);
+}
+
+TEST_CASE("Timeline finds chat position and scroll height", "[timeline]")
+{
+    relive::ChatLog::Builder builder;
+    for (int time : {5, 5, 20, 30}) {
+        builder.add(time, relive::ChatMessage::eMessage, {"nick", "text"});
+    }
+    Timeline timeline;
+    timeline.setChat(builder.build());
+    CHECK(timeline.chatIndexAt(4) == -1);
+    CHECK(timeline.chatIndexAt(5) == 1);
+    CHECK(timeline.chatIndexAt(29) == 2);
+    CHECK(timeline.chatIndexAt(31) == 3);
+    CHECK(timeline.chatHeightAt(100) == 0.0f);
+    timeline.setChatHeights({10.0f, 20.0f, 15.0f, 5.0f});
+    CHECK(timeline.chatHeightAt(4) == 0.0f);
+    CHECK(timeline.chatHeightAt(5) == 30.0f);
+    CHECK(timeline.chatHeightAt(20) == 45.0f);
+    CHECK(timeline.chatHeightUpTo(3) == 50.0f);
+    CHECK(timeline.chatHeightUpTo(10) == 50.0f);
+    CHECK(timeline.totalChatHeight() == 50.0f);
+    timeline.clear();
+    CHECK(timeline.chatIndexAt(100) == -1);
+    CHECK(timeline.totalChatHeight() == 0.0f);
+}
+
+TEST_CASE("Timeline updates single chat heights", "[timeline]")
+{
+    relive::ChatLog::Builder builder;
+    for (int i = 0; i < 1000; ++i) {
+        builder.add(i, relive::ChatMessage::eJoin, {"nick"});
+    }
+    Timeline timeline;
+    CHECK(timeline.chatIndexAtHeight(0.0f) == -1);
+    timeline.setChat(builder.build());
+    timeline.resetChatHeights(10.0f);
+    CHECK(timeline.totalChatHeight() == 10000.0f);
+    CHECK(timeline.chatIndexAtHeight(0.0f) == 0);
+    CHECK(timeline.chatIndexAtHeight(9.5f) == 0);
+    CHECK(timeline.chatIndexAtHeight(10.0f) == 1);
+    CHECK(timeline.chatIndexAtHeight(5005.0f) == 500);
+    CHECK(timeline.chatIndexAtHeight(1e9f) == 999);
+    timeline.setChatHeight(10, 40.0f);
+    CHECK(timeline.chatHeightUpTo(9) == 100.0f);
+    CHECK(timeline.chatHeightUpTo(10) == 140.0f);
+    CHECK(timeline.totalChatHeight() == 10030.0f);
+    CHECK(timeline.chatIndexAtHeight(139.0f) == 10);
+    CHECK(timeline.chatIndexAtHeight(140.0f) == 11);
+    timeline.setChatHeight(-1, 5.0f);
+    timeline.setChatHeight(1000, 5.0f);
+    CHECK(timeline.totalChatHeight() == 10030.0f);
+}